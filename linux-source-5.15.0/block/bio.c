@@ -86,8 +86,13 @@ static struct bio_slab *create_bio_slab(unsigned int size)
 		return NULL;
 
 	snprintf(bslab->name, sizeof(bslab->name), "bio-%d", size);
+	/*
+	 * Polling looks at bios that may have completed and been freed
+	 * under RCU, see iocb_bio_iopoll().
+	 */
 	bslab->slab = kmem_cache_create(bslab->name, size,
-			ARCH_KMALLOC_MINALIGN, SLAB_HWCACHE_ALIGN, NULL);
+			ARCH_KMALLOC_MINALIGN,
+			SLAB_HWCACHE_ALIGN | SLAB_TYPESAFE_BY_RCU, NULL);
 	if (!bslab->slab)
 		goto fail_alloc_slab;
 
@@ -262,6 +267,7 @@ void bio_init(struct bio *bio, struct bio_vec *table,
 	bio->bi_iter.bi_size = 0;
 	bio->bi_iter.bi_idx = 0;
 	bio->bi_iter.bi_bvec_done = 0;
+	bio->bi_cookie = BLK_QC_T_NONE;
 	bio->bi_end_io = NULL;
 	bio->bi_private = NULL;
 #ifdef CONFIG_BLK_CGROUP
@@ -303,6 +309,7 @@ void bio_reset(struct bio *bio)
 	bio_uninit(bio);
 	memset(bio, 0, BIO_RESET_BYTES);
 	atomic_set(&bio->__bi_remaining, 1);
+	bio->bi_cookie = BLK_QC_T_NONE;
 }
 EXPORT_SYMBOL(bio_reset);
 
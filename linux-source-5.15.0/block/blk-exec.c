@@ -71,7 +71,7 @@ static bool blk_rq_is_poll(struct request *rq)
 static void blk_rq_poll_completion(struct request *rq, struct completion *wait)
 {
 	do {
-		blk_poll(rq->q, request_to_qc_t(rq->mq_hctx, rq), true);
+		blk_mq_poll(rq->q, request_to_qc_t(rq->mq_hctx, rq), NULL, 0);
 		cond_resched();
 	} while (!completion_done(wait));
 }
@@ -272,15 +272,6 @@ void blk_mq_wake_waiters(struct request_queue *q)
 			blk_mq_tag_wakeup_all(hctx->tags, true);
 }
 
-/*
- * Only need start/end time stamping if we have iostat or
- * blk stats enabled, or using an IO scheduler.
- */
-static inline bool blk_mq_need_time_stamp(struct request *rq)
-{
-	return (rq->rq_flags & (RQF_IO_STAT | RQF_STATS)) || rq->q->elevator;
-}
-
 static struct request *blk_mq_rq_ctx_init(struct blk_mq_alloc_data *data,
 		unsigned int tag, u64 alloc_time_ns)
 {
@@ -352,6 +343,41 @@ static struct request *blk_mq_rq_ctx_init(struct blk_mq_alloc_data *data,
 	return rq;
 }
 
+/*
+ * Allocate up to data->nr_tags requests with a single tag bitmap operation.
+ * One request is returned, the rest are added to data->cached_rq. Each of
+ * them holds its own queue reference, the caller's covers the returned one.
+ */
+static struct request *
+__blk_mq_alloc_requests_batch(struct blk_mq_alloc_data *data,
+			      u64 alloc_time_ns)
+{
+	unsigned int tag, tag_offset;
+	struct request *rq;
+	unsigned long tag_mask;
+	int i, nr = 0;
+
+	tag_mask = blk_mq_get_tags(data, data->nr_tags, &tag_offset);
+	if (unlikely(!tag_mask))
+		return NULL;
+
+	for (i = 0; tag_mask; i++) {
+		if (!(tag_mask & (1UL << i)))
+			continue;
+		tag = tag_offset + i;
+		tag_mask &= ~(1UL << i);
+		rq = blk_mq_rq_ctx_init(data, tag, alloc_time_ns);
+		rq_list_add(data->cached_rq, rq);
+		nr++;
+	}
+	percpu_ref_get_many(&data->q->q_usage_counter, nr - 1);
+	data->nr_tags -= nr;
+
+	rq = rq_list_pop(data->cached_rq);
+	INIT_LIST_HEAD(&rq->queuelist);
+	return rq;
+}
+
 static struct request *__blk_mq_alloc_request(struct blk_mq_alloc_data *data)
 {
 	struct request_queue *q = data->q;
@@ -385,6 +411,18 @@ retry:
 	if (!e)
 		blk_mq_tag_busy(data->hctx);
 
+	/*
+	 * Try batched alloc if we want more than 1 tag.
+	 */
+	if (!e && data->nr_tags > 1) {
+		struct request *rq;
+
+		rq = __blk_mq_alloc_requests_batch(data, alloc_time_ns);
+		if (rq)
+			return rq;
+		data->nr_tags = 1;
+	}
+
 	/*
 	 * Waiting allocations only fail because of an inactive hctx.  In that
 	 * case just retry the hctx assignment and tag allocation as CPU hotplug
@@ -545,13 +583,18 @@ void blk_mq_free_request(struct request *rq)
 }
 EXPORT_SYMBOL_GPL(blk_mq_free_request);
 
-inline void __blk_mq_end_request(struct request *rq, blk_status_t error)
+void blk_mq_free_plug_rqs(struct blk_plug *plug)
 {
-	u64 now = 0;
+	struct request *rq;
 
-	if (blk_mq_need_time_stamp(rq))
-		now = ktime_get_ns();
+	while ((rq = rq_list_pop(&plug->cached_rq)) != NULL) {
+		INIT_LIST_HEAD(&rq->queuelist);
+		blk_mq_free_request(rq);
+	}
+}
 
+static inline void __blk_mq_end_request_acct(struct request *rq, u64 now)
+{
 	if (rq->rq_flags & RQF_STATS) {
 		blk_mq_poll_stats_start(rq->q);
 		blk_stat_add(rq, now);
@@ -560,6 +603,16 @@ inline void __blk_mq_end_request(struct request *rq, blk_status_t error)
 	blk_mq_sched_completed_request(rq, now);
 
 	blk_account_io_done(rq, now);
+}
+
+inline void __blk_mq_end_request(struct request *rq, blk_status_t error)
+{
+	u64 now = 0;
+
+	if (blk_mq_need_time_stamp(rq))
+		now = ktime_get_ns();
+
+	__blk_mq_end_request_acct(rq, now);
 
 	if (rq->end_io) {
 		rq_qos_done(rq->q, rq);
@@ -578,6 +631,84 @@ void blk_mq_end_request(struct request *rq, blk_status_t error)
 }
 EXPORT_SYMBOL(blk_mq_end_request);
 
+#define TAG_COMP_BATCH		32
+
+static inline void blk_mq_flush_tag_batch(struct blk_mq_hw_ctx *hctx,
+					  int *tag_array, int nr_tags)
+{
+	struct request_queue *q = hctx->queue;
+
+	blk_mq_put_tags(hctx->tags, tag_array, nr_tags);
+	blk_mq_sched_restart(hctx);
+	percpu_ref_put_many(&q->q_usage_counter, nr_tags);
+}
+
+/**
+ * blk_mq_end_request_batch - end and free a batch of completed requests
+ * @iob: batch gathered with blk_mq_add_to_batch()
+ *
+ * Does what blk_mq_end_request() does for each request of @iob without I/O
+ * errors, but returns the driver tags of each hardware queue with a single
+ * bitmap update and drops the matching queue references at once.
+ */
+void blk_mq_end_request_batch(struct io_comp_batch *iob)
+{
+	int tags[TAG_COMP_BATCH], nr_tags = 0;
+	struct blk_mq_hw_ctx *cur_hctx = NULL;
+	struct request *rq;
+	u64 now = 0;
+
+	if (iob->need_ts)
+		now = ktime_get_ns();
+
+	while ((rq = rq_list_pop(&iob->req_list)) != NULL) {
+		struct blk_mq_hw_ctx *hctx = rq->mq_hctx;
+
+		prefetch(rq->bio);
+		prefetch(rq->rq_next);
+
+		if (blk_update_request(rq, BLK_STS_OK, blk_rq_bytes(rq)))
+			BUG();
+		if (iob->need_ts)
+			__blk_mq_end_request_acct(rq, now);
+
+		rq->mq_ctx->rq_completed[rq_is_sync(rq)]++;
+		if (rq->rq_flags & RQF_MQ_INFLIGHT)
+			__blk_mq_dec_active_requests(hctx);
+
+		if (unlikely(laptop_mode && !blk_rq_is_passthrough(rq)))
+			laptop_io_completion(rq->q->disk->bdi);
+
+		rq_qos_done(rq->q, rq);
+
+		WRITE_ONCE(rq->state, MQ_RQ_IDLE);
+		if (!refcount_dec_and_test(&rq->ref))
+			continue;
+
+		/* reserved tags are rare, return them the slow way */
+		if (blk_mq_tag_is_reserved(hctx->tags, rq->tag)) {
+			__blk_mq_free_request(rq);
+			continue;
+		}
+
+		blk_crypto_free_request(rq);
+		blk_pm_mark_last_busy(rq);
+		rq->mq_hctx = NULL;
+
+		if (nr_tags == TAG_COMP_BATCH || cur_hctx != hctx) {
+			if (cur_hctx)
+				blk_mq_flush_tag_batch(cur_hctx, tags, nr_tags);
+			nr_tags = 0;
+			cur_hctx = hctx;
+		}
+		tags[nr_tags++] = rq->tag;
+	}
+
+	if (nr_tags)
+		blk_mq_flush_tag_batch(cur_hctx, tags, nr_tags);
+}
+EXPORT_SYMBOL_GPL(blk_mq_end_request_batch);
+
 static void blk_complete_reqs(struct llist_head *list)
 {
 	struct llist_node *entry = llist_reverse_order(llist_del_all(list));
@@ -2183,6 +2314,35 @@ static inline unsigned short blk_plug_max_rq_count(struct blk_plug *plug)
 	return BLK_MAX_REQUEST_COUNT;
 }
 
+/*
+ * Use a request cached in the plug by an earlier batched allocation if it
+ * is for this queue and would have been mapped to the same hardware queue.
+ */
+static struct request *blk_mq_get_cached_request(struct request_queue *q,
+		struct blk_plug *plug, struct bio *bio)
+{
+	struct request *rq;
+
+	if (!plug)
+		return NULL;
+	rq = rq_list_peek(&plug->cached_rq);
+	if (!rq || rq->q != q)
+		return NULL;
+	if (blk_mq_map_queue(q, bio->bi_opf, rq->mq_ctx) != rq->mq_hctx ||
+	    op_is_flush(rq->cmd_flags) != op_is_flush(bio->bi_opf))
+		return NULL;
+
+	plug->cached_rq = rq_list_next(rq);
+	INIT_LIST_HEAD(&rq->queuelist);
+	rq->cmd_flags = bio->bi_opf;
+	if (blk_mq_need_time_stamp(rq))
+		rq->start_time_ns = ktime_get_ns();
+
+	/* the cached request holds a queue reference of its own */
+	blk_queue_exit(q);
+	return rq;
+}
+
 /**
  * blk_mq_submit_bio - Create and send a request to block device.
  * @bio: Bio pointer.
@@ -2235,13 +2395,25 @@ blk_qc_t blk_mq_submit_bio(struct bio *bio)
 
 	hipri = bio->bi_opf & REQ_HIPRI;
 
-	data.cmd_flags = bio->bi_opf;
-	rq = __blk_mq_alloc_request(&data);//分配一个新的request，填充结构信息
-	if (unlikely(!rq)) { //分配失败
-		rq_qos_cleanup(q, bio);
-		if (bio->bi_opf & REQ_NOWAIT)
-			bio_wouldblock_error(bio);
-		goto queue_exit;
+	plug = blk_mq_plug(q, bio);
+	rq = blk_mq_get_cached_request(q, plug, bio);
+	if (rq) {
+		data.ctx = rq->mq_ctx;
+		data.hctx = rq->mq_hctx;
+	} else {
+		data.cmd_flags = bio->bi_opf;
+		if (plug) {
+			data.nr_tags = plug->nr_ios;
+			plug->nr_ios = 1;
+			data.cached_rq = &plug->cached_rq;
+		}
+		rq = __blk_mq_alloc_request(&data);//分配一个新的request，填充结构信息
+		if (unlikely(!rq)) { //分配失败
+			rq_qos_cleanup(q, bio);
+			if (bio->bi_opf & REQ_NOWAIT)
+				bio_wouldblock_error(bio);
+			goto queue_exit;
+		}
 	}
 
 	trace_block_getrq(bio);//跟踪分析点
@@ -2250,6 +2422,8 @@ blk_qc_t blk_mq_submit_bio(struct bio *bio)
 
 	cookie = request_to_qc_t(data.hctx, rq);
 	//获取该request的cookie，标识IO的轻量级队列，便于调度器或底层驱动跟踪rq的生命周期、优化合并或调度
+	if (hipri)
+		WRITE_ONCE(bio->bi_cookie, cookie);
 	blk_mq_bio_to_request(rq, bio, nr_segs);//真正完成bio  ->  request的字段拷贝
 
 	ret = blk_crypto_rq_get_keyslot(rq);//如果开启加密，分配加密的keyslot
@@ -2260,7 +2434,7 @@ blk_qc_t blk_mq_submit_bio(struct bio *bio)
 		return BLK_QC_T_NONE;
 	}
 
-	plug = blk_mq_plug(q, bio);//plug是块层IO批处理机制，防止频繁提交耽搁request，每个线程可以挂在一个plug，属于软层缓存
+	//plug是块层IO批处理机制，防止频繁提交耽搁request，每个线程可以挂在一个plug，属于软层缓存
 	if (unlikely(is_flush_fua)) { //flush请求必须立即提交到底层设备，绕过调度器，直接插入硬件队列
 		/* Bypass scheduler for flush requests */
 		blk_insert_flush(rq);
@@ -3975,18 +4149,21 @@ static bool blk_mq_poll_hybrid(struct request_queue *q,
 }
 
 /**
- * blk_poll - poll for IO completions
+ * blk_mq_poll - poll for IO completions
  * @q:  the queue
- * @cookie: cookie passed back at IO submission time
- * @spin: whether to spin for completions
+ * @cookie: cookie of the request to poll for, see bio_poll()
+ * @iob: batch to add completed requests to, may be %NULL
+ * @flags: BLK_POLL_* flags
  *
  * Description:
  *    Poll for completions on the passed in queue. Returns number of
- *    completed entries found. If @spin is true, then blk_poll will continue
+ *    completed entries found. Unless BLK_POLL_ONESHOT is set, this keeps
  *    looping until at least one completion is found, unless the task is
- *    otherwise marked running (or we need to reschedule).
+ *    otherwise marked running (or we need to reschedule). Requests added
+ *    to @iob are only completed once the caller runs iob->complete().
  */
-int blk_poll(struct request_queue *q, blk_qc_t cookie, bool spin)
+int blk_mq_poll(struct request_queue *q, blk_qc_t cookie,
+		struct io_comp_batch *iob, unsigned int flags)
 {
 	struct blk_mq_hw_ctx *hctx;
 	unsigned int state;
@@ -3995,9 +4172,6 @@ int blk_poll(struct request_queue *q, blk_qc_t cookie, bool spin)
 	    !test_bit(QUEUE_FLAG_POLL, &q->queue_flags))
 		return 0;
 
-	if (current->plug)
-		blk_flush_plug_list(current->plug, false);
-
 	hctx = q->queue_hw_ctx[blk_qc_t_to_queue_num(cookie)];
 
 	/*
@@ -4008,7 +4182,8 @@ int blk_poll(struct request_queue *q, blk_qc_t cookie, bool spin)
 	 * straight to the busy poll loop. If specified not to spin,
 	 * we also should not sleep.
 	 */
-	if (spin && blk_mq_poll_hybrid(q, hctx, cookie))
+	if (!(flags & (BLK_POLL_ONESHOT | BLK_POLL_NOSLEEP)) &&
+	    blk_mq_poll_hybrid(q, hctx, cookie))
 		return 1;
 
 	hctx->poll_considered++;
@@ -4019,7 +4194,7 @@ int blk_poll(struct request_queue *q, blk_qc_t cookie, bool spin)
 
 		hctx->poll_invoked++;
 
-		ret = q->mq_ops->poll(hctx);
+		ret = q->mq_ops->poll(hctx, iob);
 		if (ret > 0) {
 			hctx->poll_success++;
 			__set_current_state(TASK_RUNNING);
@@ -4031,7 +4206,7 @@ int blk_poll(struct request_queue *q, blk_qc_t cookie, bool spin)
 
 		if (task_is_running(current))
 			return 1;
-		if (ret < 0 || !spin)
+		if (ret < 0 || (flags & BLK_POLL_ONESHOT))
 			break;
 		cpu_relax();
 	} while (!need_resched());
@@ -4039,7 +4214,6 @@ int blk_poll(struct request_queue *q, blk_qc_t cookie, bool spin)
 	__set_current_state(TASK_RUNNING);
 	return 0;
 }
-EXPORT_SYMBOL_GPL(blk_poll);
 
 unsigned int blk_mq_rq_cpu(struct request *rq)
 {
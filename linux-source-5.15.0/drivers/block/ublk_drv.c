@@ -0,0 +1,1294 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Userspace block device - block device whose I/O is served by a userspace
+ * daemon through io_uring commands
+ *
+ * Each hardware queue is served by one daemon thread with its own io_uring.
+ * The thread fetches requests with UBLK_IO_FETCH_REQ commands, one per tag;
+ * when blk-mq dispatches a request, its descriptor is written to a buffer
+ * shared with the daemon and the fetch command of its tag is completed. The
+ * daemon reports the result and fetches the next request for the tag with
+ * a single UBLK_IO_COMMIT_AND_FETCH_REQ command, which completes the block
+ * request straight through blk_mq_complete_request().
+ *
+ * Request data is copied directly between the request pages and the buffer
+ * the daemon registered for the tag, in the context of the daemon thread,
+ * so no intermediate buffer, socket or extra context switch is involved.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/sched.h>
+#include <linux/sched/task.h>
+#include <linux/fs.h>
+#include <linux/file.h>
+#include <linux/errno.h>
+#include <linux/major.h>
+#include <linux/blkdev.h>
+#include <linux/init.h>
+#include <linux/slab.h>
+#include <linux/mutex.h>
+#include <linux/completion.h>
+#include <linux/highmem.h>
+#include <linux/miscdevice.h>
+#include <linux/uaccess.h>
+#include <linux/cdev.h>
+#include <linux/idr.h>
+#include <linux/io_uring.h>
+#include <linux/blk-mq.h>
+#include <linux/mm.h>
+#include <asm/page.h>
+#include <uapi/linux/ublk_cmd.h>
+
+#define UBLK_MINORS		(1U << MINORBITS)
+
+/* how often the daemons are checked for having died */
+#define UBLK_DAEMON_MONITOR_PERIOD	(5 * HZ)
+
+struct ublk_uring_cmd_pdu {
+	struct request *req;
+};
+
+/*
+ * io command is active: the fetch command of this tag has been received
+ * and is waiting for a request to be dispatched
+ */
+#define UBLK_IO_FLAG_ACTIVE	0x01
+
+/*
+ * the request of this tag has been handed to the daemon, which has not
+ * committed its result yet
+ */
+#define UBLK_IO_FLAG_OWNED_BY_SRV 0x02
+
+struct ublk_io {
+	/* userspace buffer address from io cmd */
+	__u64	addr;
+	unsigned int flags;
+	int res;
+
+	struct io_uring_cmd *cmd;
+};
+
+struct ublk_queue {
+	int q_id;
+	int q_depth;
+
+	struct task_struct	*ubq_daemon;
+	char *io_cmd_buf;
+
+	unsigned short nr_io_ready;	/* how many ios setup */
+	struct ublk_device *dev;
+	struct ublk_io ios[];
+};
+
+struct ublk_device {
+	struct gendisk		*ub_disk;
+
+	char	*__queues;
+
+	unsigned int	queue_size;
+	unsigned short  bs_shift;
+	struct ublksrv_ctrl_dev_info	dev_info;
+
+	struct blk_mq_tag_set	tag_set;
+
+	struct cdev		cdev;
+	struct device		cdev_dev;
+
+	atomic_t		ch_open_cnt;
+	int			ub_number;
+
+	/* serializes queue setup, start, stop and removal */
+	struct mutex		mutex;
+	bool			removed;
+
+	struct completion	completion;
+	unsigned int		nr_queues_ready;
+
+	/*
+	 * Our ubq->daemon may be killed without any notification, so
+	 * monitor each queue's daemon periodically
+	 */
+	struct delayed_work	monitor_work;
+	struct work_struct	stop_work;
+};
+
+static dev_t ublk_chr_devt;
+static struct class *ublk_chr_class;
+
+static DEFINE_IDR(ublk_index_idr);
+static DEFINE_SPINLOCK(ublk_idr_lock);
+
+/* serializes adding and removing devices */
+static DEFINE_MUTEX(ublk_ctl_mutex);
+
+static struct miscdevice ublk_misc;
+
+static inline struct ublksrv_io_desc *ublk_get_iod(struct ublk_queue *ubq,
+						   int tag)
+{
+	return (struct ublksrv_io_desc *)
+		&(ubq->io_cmd_buf[tag * sizeof(struct ublksrv_io_desc)]);
+}
+
+static inline struct ublk_queue *ublk_get_queue(struct ublk_device *dev,
+						int qid)
+{
+	return (struct ublk_queue *)&(dev->__queues[qid * dev->queue_size]);
+}
+
+static inline int ublk_queue_cmd_buf_size(struct ublk_device *ub, int q_id)
+{
+	struct ublk_queue *ubq = ublk_get_queue(ub, q_id);
+
+	return round_up(ubq->q_depth * sizeof(struct ublksrv_io_desc),
+			PAGE_SIZE);
+}
+
+static inline int ublk_max_cmd_buf_size(void)
+{
+	return round_up(UBLK_MAX_QUEUE_DEPTH * sizeof(struct ublksrv_io_desc),
+			PAGE_SIZE);
+}
+
+static inline bool ublk_queue_ready(struct ublk_queue *ubq)
+{
+	return ubq->nr_io_ready == ubq->q_depth;
+}
+
+static inline bool ubq_daemon_is_dying(struct ublk_queue *ubq)
+{
+	return ubq->ubq_daemon->flags & PF_EXITING;
+}
+
+static inline struct ublk_uring_cmd_pdu *ublk_get_uring_cmd_pdu(
+		struct io_uring_cmd *ioucmd)
+{
+	return (struct ublk_uring_cmd_pdu *)&ioucmd->pdu;
+}
+
+static struct ublk_device *ublk_get_device_from_id(int idx)
+{
+	struct ublk_device *ub = NULL;
+
+	if (idx < 0)
+		return NULL;
+
+	spin_lock(&ublk_idr_lock);
+	ub = idr_find(&ublk_index_idr, idx);
+	if (ub)
+		get_device(&ub->cdev_dev);
+	spin_unlock(&ublk_idr_lock);
+
+	return ub;
+}
+
+static void ublk_put_device(struct ublk_device *ub)
+{
+	put_device(&ub->cdev_dev);
+}
+
+static const struct block_device_operations ub_fops = {
+	.owner =	THIS_MODULE,
+};
+
+/* Only the READ and WRITE requests carry data */
+static inline bool ublk_rq_has_data(const struct request *rq)
+{
+	return rq->bio && bio_has_data(rq->bio) &&
+		(req_op(rq) == REQ_OP_READ || req_op(rq) == REQ_OP_WRITE);
+}
+
+/*
+ * Copy up to @max bytes between the pages of @req and the daemon buffer at
+ * @ubuf. Must run in the context of the daemon. Returns the number of
+ * bytes copied.
+ */
+static unsigned int ublk_copy_user_rq(struct request *req,
+				      void __user *ubuf, unsigned int max,
+				      bool to_user)
+{
+	struct req_iterator iter;
+	struct bio_vec bv;
+	unsigned int done = 0;
+
+	rq_for_each_segment(bv, req, iter) {
+		unsigned int len = min(bv.bv_len, max - done);
+		unsigned long left;
+		void *kaddr;
+
+		if (!len)
+			break;
+
+		kaddr = bvec_kmap_local(&bv);
+		if (to_user) {
+			left = copy_to_user(ubuf + done, kaddr, len);
+		} else {
+			left = copy_from_user(kaddr, ubuf + done, len);
+			flush_dcache_page(bv.bv_page);
+		}
+		kunmap_local(kaddr);
+
+		done += len - left;
+		if (left)
+			break;
+	}
+	return done;
+}
+
+static inline unsigned int ublk_req_build_flags(struct request *req)
+{
+	unsigned flags = 0;
+
+	if (req->cmd_flags & REQ_FAILFAST_DEV)
+		flags |= UBLK_IO_F_FAILFAST_DEV;
+
+	if (req->cmd_flags & REQ_FAILFAST_TRANSPORT)
+		flags |= UBLK_IO_F_FAILFAST_TRANSPORT;
+
+	if (req->cmd_flags & REQ_FAILFAST_DRIVER)
+		flags |= UBLK_IO_F_FAILFAST_DRIVER;
+
+	if (req->cmd_flags & REQ_META)
+		flags |= UBLK_IO_F_META;
+
+	if (req->cmd_flags & REQ_FUA)
+		flags |= UBLK_IO_F_FUA;
+
+	if (req->cmd_flags & REQ_NOUNMAP)
+		flags |= UBLK_IO_F_NOUNMAP;
+
+	if (req->cmd_flags & REQ_SWAP)
+		flags |= UBLK_IO_F_SWAP;
+
+	return flags;
+}
+
+static blk_status_t ublk_setup_iod(struct ublk_queue *ubq, struct request *req)
+{
+	struct ublksrv_io_desc *iod = ublk_get_iod(ubq, req->tag);
+	struct ublk_io *io = &ubq->ios[req->tag];
+	u32 ublk_op;
+
+	switch (req_op(req)) {
+	case REQ_OP_READ:
+		ublk_op = UBLK_IO_OP_READ;
+		break;
+	case REQ_OP_WRITE:
+		ublk_op = UBLK_IO_OP_WRITE;
+		break;
+	case REQ_OP_FLUSH:
+		ublk_op = UBLK_IO_OP_FLUSH;
+		break;
+	case REQ_OP_DISCARD:
+		ublk_op = UBLK_IO_OP_DISCARD;
+		break;
+	case REQ_OP_WRITE_ZEROES:
+		ublk_op = UBLK_IO_OP_WRITE_ZEROES;
+		break;
+	default:
+		return BLK_STS_IOERR;
+	}
+
+	/* need to translate since kernel may change */
+	iod->op_flags = ublk_op | ublk_req_build_flags(req);
+	iod->nr_sectors = blk_rq_sectors(req);
+	iod->start_sector = blk_rq_pos(req);
+	iod->addr = io->addr;
+
+	return BLK_STS_OK;
+}
+
+/* Runs from blk_mq_complete_request(), once the daemon committed a result */
+static void ublk_complete_rq(struct request *req)
+{
+	struct ublk_queue *ubq = req->mq_hctx->driver_data;
+	struct ublk_io *io = &ubq->ios[req->tag];
+
+	if (io->res < 0) {
+		blk_mq_end_request(req, errno_to_blk_status(io->res));
+		return;
+	}
+
+	if (!ublk_rq_has_data(req)) {
+		blk_mq_end_request(req, BLK_STS_OK);
+		return;
+	}
+
+	/* A data request which made no progress would be retried forever */
+	if (unlikely(!io->res)) {
+		blk_mq_end_request(req, BLK_STS_IOERR);
+		return;
+	}
+
+	/* Short completion: dispatch the remainder to the daemon again */
+	if (blk_update_request(req, BLK_STS_OK, io->res))
+		blk_mq_requeue_request(req, true);
+	else
+		__blk_mq_end_request(req, BLK_STS_OK);
+}
+
+/*
+ * Runs in the context of the queue daemon, from the task work queued by
+ * ublk_queue_rq(): copy the data of a WRITE to the daemon buffer and
+ * complete the fetch command, handing the request to the daemon.
+ */
+static void ublk_rq_task_work_cb(struct io_uring_cmd *cmd)
+{
+	struct ublk_uring_cmd_pdu *pdu = ublk_get_uring_cmd_pdu(cmd);
+	struct request *req = pdu->req;
+	struct ublk_queue *ubq = req->mq_hctx->driver_data;
+	struct ublk_io *io = &ubq->ios[req->tag];
+
+	/*
+	 * The daemon is exiting and task work is run from do_exit(): fail
+	 * the request and let the monitor work tear the device down. The
+	 * fetch command is aborted from there as well.
+	 */
+	if (unlikely(current != ubq->ubq_daemon ||
+		     current->flags & PF_EXITING)) {
+		blk_mq_end_request(req, BLK_STS_IOERR);
+		mod_delayed_work(system_wq, &ubq->dev->monitor_work, 0);
+		return;
+	}
+
+	if (ublk_rq_has_data(req) && req_op(req) == REQ_OP_WRITE) {
+		unsigned int bytes = blk_rq_bytes(req);
+		unsigned int copied;
+
+		copied = ublk_copy_user_rq(req, u64_to_user_ptr(io->addr),
+					   bytes, true);
+		/*
+		 * Only the copied part is handed over, the rest is sent
+		 * again after the short completion.
+		 */
+		if (unlikely(copied < bytes)) {
+			if (copied < (1 << SECTOR_SHIFT)) {
+				blk_mq_end_request(req, BLK_STS_IOERR);
+				return;
+			}
+			ublk_get_iod(ubq, req->tag)->nr_sectors =
+				copied >> SECTOR_SHIFT;
+		}
+	}
+
+	io->flags &= ~UBLK_IO_FLAG_ACTIVE;
+	io->flags |= UBLK_IO_FLAG_OWNED_BY_SRV;
+	io_uring_cmd_done(cmd, UBLK_IO_RES_OK, 0);
+}
+
+static blk_status_t ublk_queue_rq(struct blk_mq_hw_ctx *hctx,
+		const struct blk_mq_queue_data *bd)
+{
+	struct ublk_queue *ubq = hctx->driver_data;
+	struct request *rq = bd->rq;
+	struct ublk_io *io = &ubq->ios[rq->tag];
+	struct ublk_uring_cmd_pdu *pdu;
+	blk_status_t res;
+
+	/* fill iod to slot in io cmd buffer */
+	res = ublk_setup_iod(ubq, rq);
+	if (unlikely(res != BLK_STS_OK))
+		return BLK_STS_IOERR;
+
+	if (unlikely(ubq_daemon_is_dying(ubq))) {
+		mod_delayed_work(system_wq, &ubq->dev->monitor_work, 0);
+		return BLK_STS_IOERR;
+	}
+
+	if (WARN_ON_ONCE(!(io->flags & UBLK_IO_FLAG_ACTIVE)))
+		return BLK_STS_IOERR;
+
+	blk_mq_start_request(rq);
+
+	pdu = ublk_get_uring_cmd_pdu(io->cmd);
+	pdu->req = rq;
+	io_uring_cmd_complete_in_task(io->cmd, ublk_rq_task_work_cb);
+
+	return BLK_STS_OK;
+}
+
+static int ublk_init_hctx(struct blk_mq_hw_ctx *hctx, void *driver_data,
+		unsigned int hctx_idx)
+{
+	struct ublk_device *ub = driver_data;
+	struct ublk_queue *ubq = ublk_get_queue(ub, hctx->queue_num);
+
+	hctx->driver_data = ubq;
+	return 0;
+}
+
+static const struct blk_mq_ops ublk_mq_ops = {
+	.queue_rq       = ublk_queue_rq,
+	.complete	= ublk_complete_rq,
+	.init_hctx	= ublk_init_hctx,
+};
+
+static int ublk_ch_open(struct inode *inode, struct file *filp)
+{
+	struct ublk_device *ub = container_of(inode->i_cdev,
+			struct ublk_device, cdev);
+
+	if (atomic_cmpxchg(&ub->ch_open_cnt, 0, 1) == 0) {
+		filp->private_data = ub;
+		return 0;
+	}
+	return -EBUSY;
+}
+
+static int ublk_ch_release(struct inode *inode, struct file *filp)
+{
+	struct ublk_device *ub = filp->private_data;
+
+	filp->private_data = NULL;
+	atomic_set(&ub->ch_open_cnt, 0);
+	return 0;
+}
+
+/* map pre-allocated per-queue cmd buffer to ublksrv daemon */
+static int ublk_ch_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+	struct ublk_device *ub = filp->private_data;
+	size_t sz = vma->vm_end - vma->vm_start;
+	unsigned max_sz = ublk_max_cmd_buf_size();
+	unsigned long pfn, end, phys_off = vma->vm_pgoff << PAGE_SHIFT;
+	int q_id;
+
+	end = UBLKSRV_CMD_BUF_OFFSET + ub->dev_info.nr_hw_queues * max_sz;
+	if (phys_off < UBLKSRV_CMD_BUF_OFFSET || phys_off >= end)
+		return -EINVAL;
+
+	q_id = (phys_off - UBLKSRV_CMD_BUF_OFFSET) / max_sz;
+	if (phys_off != UBLKSRV_CMD_BUF_OFFSET + q_id * max_sz)
+		return -EINVAL;
+
+	if (sz != ublk_queue_cmd_buf_size(ub, q_id))
+		return -EINVAL;
+
+	/* the descriptors are only written by the driver */
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+	vma->vm_flags &= ~VM_MAYWRITE;
+
+	pfn = virt_to_phys(ublk_get_queue(ub, q_id)->io_cmd_buf);
+	pfn >>= PAGE_SHIFT;
+	return remap_pfn_range(vma, vma->vm_start, pfn, sz, vma->vm_page_prot);
+}
+
+static void ublk_mark_io_ready(struct ublk_device *ub, struct ublk_queue *ubq)
+{
+	mutex_lock(&ub->mutex);
+	ubq->nr_io_ready++;
+	if (ublk_queue_ready(ubq)) {
+		ubq->ubq_daemon = current;
+		get_task_struct(ubq->ubq_daemon);
+		ub->nr_queues_ready++;
+	}
+	if (ub->nr_queues_ready == ub->dev_info.nr_hw_queues)
+		complete_all(&ub->completion);
+	mutex_unlock(&ub->mutex);
+}
+
+/*
+ * Hand the result of the request of this tag back to the block layer. For a
+ * READ, the data is copied from the daemon buffer first, which needs to be
+ * done from the daemon's context.
+ */
+static int ublk_commit_and_fetch(struct ublk_device *ub,
+				 struct ublk_queue *ubq, struct ublk_io *io,
+				 struct io_uring_cmd *cmd,
+				 const struct ublksrv_io_cmd *ub_cmd)
+{
+	struct request *req;
+
+	if (!(io->flags & UBLK_IO_FLAG_OWNED_BY_SRV))
+		return -EINVAL;
+
+	req = blk_mq_tag_to_rq(ub->tag_set.tags[ubq->q_id], ub_cmd->tag);
+	if (WARN_ON_ONCE(!req))
+		return -EINVAL;
+
+	io->res = ub_cmd->result;
+	if (io->res > 0 && ublk_rq_has_data(req) &&
+	    req_op(req) == REQ_OP_READ)
+		io->res = ublk_copy_user_rq(req, u64_to_user_ptr(io->addr),
+				min_t(unsigned int, io->res,
+				      blk_rq_bytes(req)), false);
+
+	/* Arm the tag again before the request can be freed and reused */
+	io->cmd = cmd;
+	io->addr = ub_cmd->addr;
+	io->flags = UBLK_IO_FLAG_ACTIVE;
+
+	blk_mq_complete_request(req);
+	return 0;
+}
+
+static int ublk_ch_uring_cmd(struct io_uring_cmd *cmd, unsigned int issue_flags)
+{
+	struct ublksrv_io_cmd *ub_cmd = (struct ublksrv_io_cmd *)cmd->cmd;
+	struct ublk_device *ub = cmd->file->private_data;
+	struct ublk_queue *ubq;
+	struct ublk_io *io;
+	u32 cmd_op = cmd->cmd_op;
+	unsigned tag = ub_cmd->tag;
+	int ret;
+
+	pr_devel("%s: received: cmd op %d queue %d tag %d result %d\n",
+			__func__, cmd->cmd_op, ub_cmd->q_id, tag,
+			ub_cmd->result);
+
+	if (ub_cmd->q_id >= ub->dev_info.nr_hw_queues)
+		return -EINVAL;
+
+	ubq = ublk_get_queue(ub, ub_cmd->q_id);
+	if (!ubq || ub_cmd->q_id != ubq->q_id)
+		return -EINVAL;
+
+	/* Each queue is served by a single task and its ring */
+	if (ubq->ubq_daemon && ubq->ubq_daemon != current)
+		return -EINVAL;
+
+	if (tag >= ubq->q_depth)
+		return -EINVAL;
+
+	io = &ubq->ios[tag];
+
+	/* there is pending io cmd, something must be wrong */
+	if (io->flags & UBLK_IO_FLAG_ACTIVE)
+		return -EBUSY;
+
+	switch (cmd_op) {
+	case UBLK_IO_FETCH_REQ:
+		/* UBLK_IO_FETCH_REQ is only allowed before queue is setup */
+		if (ublk_queue_ready(ubq))
+			return -EBUSY;
+		/*
+		 * The io is being handled by server, so COMMIT_RQ is expected
+		 * instead of FETCH_REQ
+		 */
+		if (io->flags & UBLK_IO_FLAG_OWNED_BY_SRV)
+			return -EINVAL;
+		/* FETCH_RQ has to provide IO buffer */
+		if (!ub_cmd->addr)
+			return -EINVAL;
+		io->cmd = cmd;
+		io->flags |= UBLK_IO_FLAG_ACTIVE;
+		io->addr = ub_cmd->addr;
+
+		ublk_mark_io_ready(ub, ubq);
+		break;
+	case UBLK_IO_COMMIT_AND_FETCH_REQ:
+		if (!ub_cmd->addr)
+			return -EINVAL;
+		ret = ublk_commit_and_fetch(ub, ubq, io, cmd, ub_cmd);
+		if (ret)
+			return ret;
+		break;
+	default:
+		return -EINVAL;
+	}
+	return -EIOCBQUEUED;
+}
+
+static const struct file_operations ublk_ch_fops = {
+	.owner = THIS_MODULE,
+	.open = ublk_ch_open,
+	.release = ublk_ch_release,
+	.llseek = no_llseek,
+	.uring_cmd = ublk_ch_uring_cmd,
+	.mmap = ublk_ch_mmap,
+};
+
+/* Fail the requests the dead daemon will never complete */
+static void ublk_abort_queue(struct ublk_device *ub, struct ublk_queue *ubq)
+{
+	int i;
+
+	for (i = 0; i < ubq->q_depth; i++) {
+		struct ublk_io *io = &ubq->ios[i];
+		struct request *rq;
+
+		if (!(io->flags & UBLK_IO_FLAG_OWNED_BY_SRV))
+			continue;
+
+		io->flags &= ~UBLK_IO_FLAG_OWNED_BY_SRV;
+		rq = blk_mq_tag_to_rq(ub->tag_set.tags[ubq->q_id], i);
+		if (rq)
+			blk_mq_end_request(rq, BLK_STS_IOERR);
+	}
+}
+
+static void ublk_daemon_monitor_work(struct work_struct *work)
+{
+	struct ublk_device *ub =
+		container_of(work, struct ublk_device, monitor_work.work);
+	int i;
+
+	for (i = 0; i < ub->dev_info.nr_hw_queues; i++) {
+		struct ublk_queue *ubq = ublk_get_queue(ub, i);
+
+		if (ubq->ubq_daemon && ubq_daemon_is_dying(ubq)) {
+			schedule_work(&ub->stop_work);
+
+			/* abort queue is for making forward progress */
+			ublk_abort_queue(ub, ubq);
+		}
+	}
+
+	/*
+	 * No need for ub->mutex: the monitor work is canceled after the
+	 * state is marked DEAD, so the state is observed reliably here.
+	 */
+	if (ub->dev_info.state != UBLK_S_DEV_DEAD)
+		schedule_delayed_work(&ub->monitor_work,
+				UBLK_DAEMON_MONITOR_PERIOD);
+}
+
+/* Complete the fetch commands still held by the driver and reset the queue */
+static void ublk_cancel_queue(struct ublk_queue *ubq)
+{
+	int i;
+
+	for (i = 0; i < ubq->q_depth; i++) {
+		struct ublk_io *io = &ubq->ios[i];
+
+		if (io->flags & UBLK_IO_FLAG_ACTIVE)
+			io_uring_cmd_done(io->cmd, UBLK_IO_RES_ABORT, 0);
+		io->flags = 0;
+		io->cmd = NULL;
+	}
+
+	ubq->nr_io_ready = 0;
+	if (ubq->ubq_daemon) {
+		put_task_struct(ubq->ubq_daemon);
+		ubq->ubq_daemon = NULL;
+	}
+}
+
+/* Called with ub->mutex held */
+static void ublk_cancel_dev(struct ublk_device *ub)
+{
+	int i;
+
+	for (i = 0; i < ub->dev_info.nr_hw_queues; i++)
+		ublk_cancel_queue(ublk_get_queue(ub, i));
+
+	ub->nr_queues_ready = 0;
+	reinit_completion(&ub->completion);
+}
+
+static void ublk_stop_dev(struct ublk_device *ub)
+{
+	mutex_lock(&ub->mutex);
+	if (ub->dev_info.state == UBLK_S_DEV_LIVE) {
+		del_gendisk(ub->ub_disk);
+		ub->dev_info.state = UBLK_S_DEV_DEAD;
+		ub->dev_info.ublksrv_pid = -1;
+		blk_cleanup_disk(ub->ub_disk);
+		ub->ub_disk = NULL;
+	}
+	mutex_unlock(&ub->mutex);
+
+	/* The monitor looks at the daemons, which are released below */
+	cancel_delayed_work_sync(&ub->monitor_work);
+
+	mutex_lock(&ub->mutex);
+	ublk_cancel_dev(ub);
+	mutex_unlock(&ub->mutex);
+}
+
+static void ublk_stop_work_fn(struct work_struct *work)
+{
+	struct ublk_device *ub =
+		container_of(work, struct ublk_device, stop_work);
+
+	ublk_stop_dev(ub);
+}
+
+/* device can only be started after all IOs are ready */
+static void ublk_wait_for_io_ready(struct ublk_device *ub)
+{
+	wait_for_completion_interruptible(&ub->completion);
+}
+
+static void ublk_deinit_queue(struct ublk_device *ub, int q_id)
+{
+	int size = ublk_queue_cmd_buf_size(ub, q_id);
+	struct ublk_queue *ubq = ublk_get_queue(ub, q_id);
+
+	if (ubq->ubq_daemon)
+		put_task_struct(ubq->ubq_daemon);
+	if (ubq->io_cmd_buf)
+		free_pages((unsigned long)ubq->io_cmd_buf, get_order(size));
+}
+
+static int ublk_init_queue(struct ublk_device *ub, int q_id)
+{
+	struct ublk_queue *ubq = ublk_get_queue(ub, q_id);
+	gfp_t gfp_flags = GFP_KERNEL | __GFP_ZERO;
+	void *ptr;
+	int size;
+
+	ubq->q_id = q_id;
+	ubq->q_depth = ub->dev_info.queue_depth;
+	size = ublk_queue_cmd_buf_size(ub, q_id);
+
+	ptr = (void *) __get_free_pages(gfp_flags, get_order(size));
+	if (!ptr)
+		return -ENOMEM;
+
+	ubq->io_cmd_buf = ptr;
+	ubq->dev = ub;
+	return 0;
+}
+
+static void ublk_deinit_queues(struct ublk_device *ub)
+{
+	int nr_queues = ub->dev_info.nr_hw_queues;
+	int i;
+
+	if (!ub->__queues)
+		return;
+
+	for (i = 0; i < nr_queues; i++)
+		ublk_deinit_queue(ub, i);
+	kfree(ub->__queues);
+}
+
+static int ublk_init_queues(struct ublk_device *ub)
+{
+	int nr_queues = ub->dev_info.nr_hw_queues;
+	int depth = ub->dev_info.queue_depth;
+	int ubq_size = sizeof(struct ublk_queue) + depth * sizeof(struct ublk_io);
+	int i, ret = -ENOMEM;
+
+	ub->queue_size = ubq_size;
+	ub->__queues = kcalloc(nr_queues, ubq_size, GFP_KERNEL);
+	if (!ub->__queues)
+		return ret;
+
+	for (i = 0; i < nr_queues; i++) {
+		if (ublk_init_queue(ub, i))
+			goto fail;
+	}
+
+	init_completion(&ub->completion);
+	return 0;
+
+ fail:
+	ublk_deinit_queues(ub);
+	return ret;
+}
+
+/*
+ * The id is only reserved here, lookups do not find the device until
+ * ublk_ctrl_add_dev() has fully set it up.
+ */
+static int ublk_alloc_dev_number(struct ublk_device *ub, int idx)
+{
+	int i = idx;
+	int err;
+
+	idr_preload(GFP_KERNEL);
+	spin_lock(&ublk_idr_lock);
+	/* allocate id, if @id >= 0, we're requesting that specific id */
+	if (i >= 0) {
+		err = idr_alloc(&ublk_index_idr, NULL, i, i + 1, GFP_NOWAIT);
+		if (err == -ENOSPC)
+			err = -EEXIST;
+	} else {
+		err = idr_alloc(&ublk_index_idr, NULL, 0, UBLK_MINORS,
+				GFP_NOWAIT);
+	}
+	spin_unlock(&ublk_idr_lock);
+	idr_preload_end();
+
+	if (err >= 0)
+		ub->ub_number = err;
+
+	return err;
+}
+
+static void ublk_free_dev_number(int idx)
+{
+	spin_lock(&ublk_idr_lock);
+	idr_remove(&ublk_index_idr, idx);
+	spin_unlock(&ublk_idr_lock);
+}
+
+static void ublk_cdev_rel(struct device *dev)
+{
+	struct ublk_device *ub = container_of(dev, struct ublk_device, cdev_dev);
+
+	blk_mq_free_tag_set(&ub->tag_set);
+	ublk_deinit_queues(ub);
+	mutex_destroy(&ub->mutex);
+	kfree(ub);
+}
+
+static int ublk_add_chdev(struct ublk_device *ub)
+{
+	struct device *dev = &ub->cdev_dev;
+	int minor = ub->ub_number;
+	int ret;
+
+	dev->parent = ublk_misc.this_device;
+	dev->devt = MKDEV(MAJOR(ublk_chr_devt), minor);
+	dev->class = ublk_chr_class;
+	dev->release = ublk_cdev_rel;
+	device_initialize(dev);
+
+	ret = dev_set_name(dev, "ublkc%d", minor);
+	if (ret)
+		goto fail;
+
+	cdev_init(&ub->cdev, &ublk_ch_fops);
+	ret = cdev_device_add(&ub->cdev, dev);
+	if (ret)
+		goto fail;
+	return 0;
+ fail:
+	put_device(dev);
+	return ret;
+}
+
+static void ublk_align_max_io_size(struct ublk_device *ub)
+{
+	unsigned int max_rq_bytes = ub->dev_info.rq_max_blocks << ub->bs_shift;
+
+	ub->dev_info.rq_max_blocks =
+		round_down(max_rq_bytes, PAGE_SIZE) >> ub->bs_shift;
+}
+
+static int ublk_add_tag_set(struct ublk_device *ub)
+{
+	ub->tag_set.ops = &ublk_mq_ops;
+	ub->tag_set.nr_hw_queues = ub->dev_info.nr_hw_queues;
+	ub->tag_set.queue_depth = ub->dev_info.queue_depth;
+	ub->tag_set.numa_node = NUMA_NO_NODE;
+	ub->tag_set.cmd_size = 0;
+	ub->tag_set.flags = BLK_MQ_F_SHOULD_MERGE;
+	ub->tag_set.driver_data = ub;
+	return blk_mq_alloc_tag_set(&ub->tag_set);
+}
+
+static void ublk_remove(struct ublk_device *ub)
+{
+	mutex_lock(&ub->mutex);
+	ub->removed = true;
+	mutex_unlock(&ub->mutex);
+
+	ublk_free_dev_number(ub->ub_number);
+	ublk_stop_dev(ub);
+	cancel_work_sync(&ub->stop_work);
+	cdev_device_del(&ub->cdev, &ub->cdev_dev);
+	put_device(&ub->cdev_dev);
+}
+
+static int ublk_ctrl_start_dev(struct io_uring_cmd *cmd)
+{
+	const struct ublksrv_ctrl_cmd *header = cmd->cmd;
+	int ublksrv_pid = (int)header->data[0];
+	struct ublk_device *ub;
+	struct gendisk *disk;
+	int ret = -EINVAL;
+
+	if (ublksrv_pid <= 0)
+		return -EINVAL;
+
+	ub = ublk_get_device_from_id(header->dev_id);
+	if (!ub)
+		return -EINVAL;
+
+	ublk_wait_for_io_ready(ub);
+
+	mutex_lock(&ub->mutex);
+	if (ub->removed || ub->nr_queues_ready != ub->dev_info.nr_hw_queues) {
+		ret = -EINTR;
+		goto out_unlock;
+	}
+	if (ub->dev_info.state == UBLK_S_DEV_LIVE) {
+		ret = -EEXIST;
+		goto out_unlock;
+	}
+
+	disk = blk_mq_alloc_disk(&ub->tag_set, ub);
+	if (IS_ERR(disk)) {
+		ret = PTR_ERR(disk);
+		goto out_unlock;
+	}
+	sprintf(disk->disk_name, "ublkb%d", ub->ub_number);
+	disk->fops = &ub_fops;
+	disk->private_data = ub;
+
+	blk_queue_logical_block_size(disk->queue, ub->dev_info.block_size);
+	blk_queue_physical_block_size(disk->queue, ub->dev_info.block_size);
+	blk_queue_io_min(disk->queue, ub->dev_info.block_size);
+	blk_queue_max_hw_sectors(disk->queue,
+		ub->dev_info.rq_max_blocks << (ub->bs_shift - SECTOR_SHIFT));
+	/* FLUSH and FUA are passed to the daemon */
+	blk_queue_write_cache(disk->queue, true, true);
+	set_capacity(disk, ub->dev_info.dev_blocks <<
+			(ub->bs_shift - SECTOR_SHIFT));
+
+	ub->dev_info.ublksrv_pid = ublksrv_pid;
+	ret = add_disk(disk);
+	if (ret) {
+		ub->dev_info.ublksrv_pid = -1;
+		blk_cleanup_disk(disk);
+		goto out_unlock;
+	}
+	ub->ub_disk = disk;
+	ub->dev_info.state = UBLK_S_DEV_LIVE;
+	schedule_delayed_work(&ub->monitor_work, UBLK_DAEMON_MONITOR_PERIOD);
+out_unlock:
+	mutex_unlock(&ub->mutex);
+	ublk_put_device(ub);
+	return ret;
+}
+
+static int ublk_ctrl_get_queue_affinity(struct io_uring_cmd *cmd)
+{
+	const struct ublksrv_ctrl_cmd *header = cmd->cmd;
+	void __user *argp = u64_to_user_ptr(header->addr);
+	struct ublk_device *ub;
+	cpumask_var_t cpumask;
+	unsigned long queue;
+	unsigned int retlen;
+	unsigned int i;
+	int ret = -EINVAL;
+
+	if (header->len * BITS_PER_BYTE < nr_cpu_ids)
+		return -EINVAL;
+	if (header->len & (sizeof(unsigned long)-1))
+		return -EINVAL;
+	if (!header->addr)
+		return -EINVAL;
+
+	ub = ublk_get_device_from_id(header->dev_id);
+	if (!ub)
+		return -EINVAL;
+
+	queue = header->data[0];
+	if (queue >= ub->dev_info.nr_hw_queues)
+		goto out_put_device;
+
+	ret = -ENOMEM;
+	if (!zalloc_cpumask_var(&cpumask, GFP_KERNEL))
+		goto out_put_device;
+
+	for_each_possible_cpu(i) {
+		if (ub->tag_set.map[HCTX_TYPE_DEFAULT].mq_map[i] == queue)
+			cpumask_set_cpu(i, cpumask);
+	}
+
+	ret = -EFAULT;
+	retlen = min_t(unsigned short, header->len, cpumask_size());
+	if (copy_to_user(argp, cpumask, retlen))
+		goto out_free_cpumask;
+	if (retlen != header->len &&
+	    clear_user(argp + retlen, header->len - retlen))
+		goto out_free_cpumask;
+
+	ret = 0;
+out_free_cpumask:
+	free_cpumask_var(cpumask);
+out_put_device:
+	ublk_put_device(ub);
+	return ret;
+}
+
+static inline void ublk_dump_dev_info(struct ublksrv_ctrl_dev_info *info)
+{
+	pr_devel("%s: dev id %d flags %llx\n", __func__,
+			info->dev_id, info->flags);
+	pr_devel("\t nr_hw_queues %d queue_depth %d block size %d dev_capacity %llu\n",
+			info->nr_hw_queues, info->queue_depth,
+			info->block_size, info->dev_blocks);
+}
+
+static int ublk_ctrl_add_dev(struct io_uring_cmd *cmd)
+{
+	const struct ublksrv_ctrl_cmd *header = cmd->cmd;
+	void __user *argp = u64_to_user_ptr(header->addr);
+	struct ublksrv_ctrl_dev_info info;
+	struct ublk_device *ub;
+	int ret = -EINVAL;
+	int id;
+
+	if (header->len < sizeof(info) || !header->addr)
+		return -EINVAL;
+	if (header->queue_id != (u16)-1) {
+		pr_warn("%s: queue_id is wrong %x\n",
+			__func__, header->queue_id);
+		return -EINVAL;
+	}
+	if (copy_from_user(&info, argp, sizeof(info)))
+		return -EFAULT;
+	ublk_dump_dev_info(&info);
+	if (header->dev_id != info.dev_id) {
+		pr_warn("%s: dev id not match %u %u\n",
+			__func__, header->dev_id, info.dev_id);
+		return -EINVAL;
+	}
+
+	/* No optional features are supported yet */
+	if (info.flags)
+		return -EINVAL;
+	if (!info.nr_hw_queues || info.nr_hw_queues > nr_cpu_ids)
+		return -EINVAL;
+	if (!info.queue_depth || info.queue_depth > UBLK_MAX_QUEUE_DEPTH)
+		return -EINVAL;
+	if (info.block_size < SECTOR_SIZE || info.block_size > PAGE_SIZE ||
+	    !is_power_of_2(info.block_size))
+		return -EINVAL;
+	if (!info.rq_max_blocks)
+		return -EINVAL;
+
+	ret = mutex_lock_killable(&ublk_ctl_mutex);
+	if (ret)
+		return ret;
+
+	ret = -ENOMEM;
+	ub = kzalloc(sizeof(*ub), GFP_KERNEL);
+	if (!ub)
+		goto out_unlock;
+	mutex_init(&ub->mutex);
+	INIT_WORK(&ub->stop_work, ublk_stop_work_fn);
+	INIT_DELAYED_WORK(&ub->monitor_work, ublk_daemon_monitor_work);
+
+	ret = ublk_alloc_dev_number(ub, header->dev_id);
+	if (ret < 0)
+		goto out_free_ub;
+
+	memcpy(&ub->dev_info, &info, sizeof(info));
+
+	/* update device id */
+	ub->dev_info.dev_id = ub->ub_number;
+	ub->dev_info.state = UBLK_S_DEV_DEAD;
+	ub->dev_info.ublksrv_pid = -1;
+
+	ub->bs_shift = ilog2(ub->dev_info.block_size);
+	ublk_align_max_io_size(ub);
+	if (!ub->dev_info.rq_max_blocks) {
+		ret = -EINVAL;
+		goto out_free_dev_number;
+	}
+
+	ret = ublk_init_queues(ub);
+	if (ret)
+		goto out_free_dev_number;
+
+	ret = ublk_add_tag_set(ub);
+	if (ret)
+		goto out_deinit_queues;
+
+	/* From here on, ub is freed by the release of its char device */
+	id = ub->ub_number;
+	ret = ublk_add_chdev(ub);
+	if (ret) {
+		ublk_free_dev_number(id);
+		goto out_unlock;
+	}
+
+	if (copy_to_user(argp, &ub->dev_info, sizeof(info))) {
+		ublk_remove(ub);
+		ret = -EFAULT;
+		goto out_unlock;
+	}
+
+	/* Make the device visible to the other control commands */
+	spin_lock(&ublk_idr_lock);
+	idr_replace(&ublk_index_idr, ub, id);
+	spin_unlock(&ublk_idr_lock);
+
+	mutex_unlock(&ublk_ctl_mutex);
+	return 0;
+
+out_deinit_queues:
+	ublk_deinit_queues(ub);
+out_free_dev_number:
+	ublk_free_dev_number(ub->ub_number);
+out_free_ub:
+	mutex_destroy(&ub->mutex);
+	kfree(ub);
+out_unlock:
+	mutex_unlock(&ublk_ctl_mutex);
+	return ret;
+}
+
+static int ublk_ctrl_del_dev(struct io_uring_cmd *cmd)
+{
+	const struct ublksrv_ctrl_cmd *header = cmd->cmd;
+	struct ublk_device *ub;
+	int ret;
+
+	ret = mutex_lock_killable(&ublk_ctl_mutex);
+	if (ret)
+		return ret;
+
+	ub = ublk_get_device_from_id(header->dev_id);
+	if (ub) {
+		ublk_remove(ub);
+		ublk_put_device(ub);
+	} else {
+		ret = -ENODEV;
+	}
+	mutex_unlock(&ublk_ctl_mutex);
+
+	return ret;
+}
+
+static int ublk_ctrl_stop_dev(struct io_uring_cmd *cmd)
+{
+	const struct ublksrv_ctrl_cmd *header = cmd->cmd;
+	struct ublk_device *ub;
+
+	ub = ublk_get_device_from_id(header->dev_id);
+	if (!ub)
+		return -EINVAL;
+
+	ublk_stop_dev(ub);
+	cancel_work_sync(&ub->stop_work);
+
+	ublk_put_device(ub);
+	return 0;
+}
+
+static int ublk_ctrl_get_dev_info(struct io_uring_cmd *cmd)
+{
+	const struct ublksrv_ctrl_cmd *header = cmd->cmd;
+	void __user *argp = u64_to_user_ptr(header->addr);
+	struct ublk_device *ub;
+	int ret = 0;
+
+	if (header->len < sizeof(struct ublksrv_ctrl_dev_info) || !header->addr)
+		return -EINVAL;
+
+	ub = ublk_get_device_from_id(header->dev_id);
+	if (!ub)
+		return -EINVAL;
+
+	if (copy_to_user(argp, &ub->dev_info, sizeof(ub->dev_info)))
+		ret = -EFAULT;
+	ublk_put_device(ub);
+
+	return ret;
+}
+
+static int ublk_ctrl_uring_cmd(struct io_uring_cmd *cmd,
+		unsigned int issue_flags)
+{
+	const struct ublksrv_ctrl_cmd *header = cmd->cmd;
+	int ret = -EINVAL;
+
+	if (!(issue_flags & IO_URING_F_SQE128))
+		goto out;
+
+	ret = -EPERM;
+	if (!capable(CAP_SYS_ADMIN))
+		goto out;
+
+	/*
+	 * Control commands sleep, waiting for the queues to be set up or
+	 * for the disk to go away: have io_uring issue them from io-wq.
+	 */
+	if (issue_flags & IO_URING_F_NONBLOCK)
+		return -EAGAIN;
+
+	pr_devel("%s: cmd op %d, dev id %d qid %d\n",
+			__func__, cmd->cmd_op, header->dev_id,
+			header->queue_id);
+
+	ret = -ENODEV;
+	switch (cmd->cmd_op) {
+	case UBLK_CMD_START_DEV:
+		ret = ublk_ctrl_start_dev(cmd);
+		break;
+	case UBLK_CMD_STOP_DEV:
+		ret = ublk_ctrl_stop_dev(cmd);
+		break;
+	case UBLK_CMD_GET_DEV_INFO:
+		ret = ublk_ctrl_get_dev_info(cmd);
+		break;
+	case UBLK_CMD_ADD_DEV:
+		ret = ublk_ctrl_add_dev(cmd);
+		break;
+	case UBLK_CMD_DEL_DEV:
+		ret = ublk_ctrl_del_dev(cmd);
+		break;
+	case UBLK_CMD_GET_QUEUE_AFFINITY:
+		ret = ublk_ctrl_get_queue_affinity(cmd);
+		break;
+	default:
+		break;
+	}
+ out:
+	pr_devel("%s: cmd done ret %d cmd_op %x, dev id %d qid %d\n",
+			__func__, ret, cmd->cmd_op, header->dev_id,
+			header->queue_id);
+	return ret;
+}
+
+static const struct file_operations ublk_ctl_fops = {
+	.open		= nonseekable_open,
+	.uring_cmd      = ublk_ctrl_uring_cmd,
+	.owner		= THIS_MODULE,
+	.llseek		= noop_llseek,
+};
+
+static struct miscdevice ublk_misc = {
+	.minor		= MISC_DYNAMIC_MINOR,
+	.name		= "ublk-control",
+	.fops		= &ublk_ctl_fops,
+};
+
+static int __init ublk_init(void)
+{
+	int ret;
+
+	ret = misc_register(&ublk_misc);
+	if (ret)
+		return ret;
+
+	ret = alloc_chrdev_region(&ublk_chr_devt, 0, UBLK_MINORS, "ublk-char");
+	if (ret)
+		goto unregister_mis;
+
+	ublk_chr_class = class_create(THIS_MODULE, "ublk-char");
+	if (IS_ERR(ublk_chr_class)) {
+		ret = PTR_ERR(ublk_chr_class);
+		goto free_chrdev_region;
+	}
+	return 0;
+
+free_chrdev_region:
+	unregister_chrdev_region(ublk_chr_devt, UBLK_MINORS);
+unregister_mis:
+	misc_deregister(&ublk_misc);
+	return ret;
+}
+
+static void __exit ublk_exit(void)
+{
+	struct ublk_device *ub;
+	int id;
+
+	mutex_lock(&ublk_ctl_mutex);
+	idr_for_each_entry(&ublk_index_idr, ub, id)
+		ublk_remove(ub);
+	mutex_unlock(&ublk_ctl_mutex);
+
+	class_destroy(ublk_chr_class);
+	misc_deregister(&ublk_misc);
+
+	idr_destroy(&ublk_index_idr);
+	unregister_chrdev_region(ublk_chr_devt, UBLK_MINORS);
+}
+
+module_init(ublk_init);
+module_exit(ublk_exit);
+
+MODULE_DESCRIPTION("Userspace block device");
+MODULE_LICENSE("GPL");
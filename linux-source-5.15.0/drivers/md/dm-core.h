@@ -236,6 +236,9 @@ struct dm_io {
 	unsigned long start_time;
 	spinlock_t endio_lock;
 	struct dm_stats_aux stats_aux;
+	/* used by polled bios, see dm_queue_poll_io() */
+	struct dm_io *next;
+	void *data;
 	/* last member of dm_target_io is 'struct bio' */
 	struct dm_target_io tio;
 };
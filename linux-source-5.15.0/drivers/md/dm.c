@@ -75,6 +75,12 @@ struct clone_info {
 	unsigned sector_count;
 };
 
+/*
+ * Polled bios carry their list of outstanding dm_io in ->bi_private while
+ * this flag is set, see dm_queue_poll_io().
+ */
+#define REQ_DM_POLL_LIST	REQ_DRV
+
 #define DM_TARGET_IO_BIO_OFFSET (offsetof(struct dm_target_io, clone))
 #define DM_IO_BIO_OFFSET \
 	(offsetof(struct dm_target_io, clone) + offsetof(struct dm_io, tio))
@@ -827,6 +833,7 @@ void dm_io_dec_pending(struct dm_io *io, blk_status_t error)
 			if (__noflush_suspending(md) &&
 			    !WARN_ON_ONCE(dm_is_zone_write(md, bio))) {
 				/* NOTE early return due to BLK_STS_DM_REQUEUE below */
+				bio_clear_hipri(bio);
 				bio_list_add_head(&md->deferred, bio);
 			} else {
 				/*
@@ -1291,6 +1298,8 @@ static int clone_bio(struct dm_target_io *tio, struct bio *bio,
 	int r;
 
 	__bio_clone_fast(clone, bio);
+	/* the poll list belongs to the original bio only */
+	clone->bi_opf &= ~REQ_DM_POLL_LIST;
 
 	r = bio_crypt_clone(clone, bio, GFP_NOIO);
 	if (r < 0)
@@ -1367,6 +1376,7 @@ static blk_qc_t __clone_and_map_simple_bio(struct clone_info *ci,
 	tio->len_ptr = len;
 
 	__bio_clone_fast(clone, ci->bio);
+	clone->bi_opf &= ~REQ_DM_POLL_LIST;
 	if (len)
 		bio_setup_sector(clone, ci->sector, *len);
 
@@ -1537,6 +1547,36 @@ static void init_clone_info(struct clone_info *ci, struct mapped_device *md,
 	ci->sector = bio->bi_iter.bi_sector;
 }
 
+static inline struct dm_io **dm_poll_list_head(struct bio *bio)
+{
+	return (struct dm_io **)&bio->bi_private;
+}
+
+/*
+ * Keep the extra reference of a polled dm_io and hang the dm_io off the
+ * original bio, so that dm_poll_bio() can find the clone to poll. The
+ * remainder of a split bio comes back here with the list already in place.
+ */
+static void dm_queue_poll_io(struct bio *bio, struct dm_io *io)
+{
+	struct dm_io **head = dm_poll_list_head(bio);
+
+	if (!(bio->bi_opf & REQ_DM_POLL_LIST)) {
+		bio->bi_opf |= REQ_DM_POLL_LIST;
+		/* ->bi_private is restored by dm_poll_bio() */
+		io->data = bio->bi_private;
+		io->next = NULL;
+
+		/* tell bio_poll() there is something to poll */
+		WRITE_ONCE(bio->bi_cookie, ~BLK_QC_T_NONE);
+	} else {
+		io->data = (*head)->data;
+		io->next = *head;
+	}
+
+	*head = io;
+}
+
 /*
  * Entry point to split a bio into clones and submit them to the targets.
  */
@@ -1547,6 +1587,15 @@ static blk_qc_t __split_and_process_bio(struct mapped_device *md,
 	blk_qc_t ret = BLK_QC_T_NONE;
 	int error = 0;
 
+	/*
+	 * Only normal data bios are polled, each dm_io of those maps to the
+	 * single clone embedded in it.
+	 */
+	if ((bio->bi_opf & REQ_HIPRI) &&
+	    ((bio->bi_opf & REQ_PREFLUSH) || op_is_zone_mgmt(bio_op(bio)) ||
+	     is_abnormal_io(bio)))
+		bio_clear_hipri(bio);
+
 	init_clone_info(&ci, md, map, bio);
 
 	if (bio->bi_opf & REQ_PREFLUSH) {
@@ -1580,8 +1629,15 @@ static blk_qc_t __split_and_process_bio(struct mapped_device *md,
 	}
 	start_io_acct(ci.io);
 
-	/* drop the extra reference count */
-	dm_io_dec_pending(ci.io, errno_to_blk_status(error));
+	/*
+	 * The extra reference of a polled dm_io is dropped by dm_poll_bio()
+	 * once the clone has completed.
+	 */
+	if ((bio->bi_opf & REQ_HIPRI) && !error)
+		dm_queue_poll_io(bio, ci.io);
+	else
+		/* drop the extra reference count */
+		dm_io_dec_pending(ci.io, errno_to_blk_status(error));
 	return ret;
 }
 
@@ -1606,8 +1662,11 @@ static blk_qc_t dm_submit_bio(struct bio *bio)
 			bio_wouldblock_error(bio);
 		else if (bio->bi_opf & REQ_RAHEAD)
 			bio_io_error(bio);
-		else
+		else {
+			/* nobody polls a bio resubmitted by dm_wq_work() */
+			bio_clear_hipri(bio);
 			queue_io(md, bio);
+		}
 		goto out;
 	}
 
@@ -1624,6 +1683,65 @@ out:
 	return ret;
 }
 
+static bool dm_poll_dm_io(struct dm_io *io, struct io_comp_batch *iob,
+			  unsigned int flags)
+{
+	WARN_ON_ONCE(!io->tio.inside_dm_io);
+
+	/* don't poll if the mapped io is done */
+	if (atomic_read(&io->io_count) > 1)
+		bio_poll(&io->tio.clone, iob, flags);
+
+	/* only the reference held by the poll list is left */
+	return atomic_read(&io->io_count) == 1;
+}
+
+static int dm_poll_bio(struct bio *bio, struct io_comp_batch *iob,
+		       unsigned int flags)
+{
+	struct dm_io **head = dm_poll_list_head(bio);
+	struct dm_io *list = *head;
+	struct dm_io *pending = NULL;
+	struct dm_io *curr, *next;
+	void *private;
+
+	if (!(bio->bi_opf & REQ_DM_POLL_LIST))
+		return 0;
+
+	if (WARN_ON_ONCE(!list))
+		return 0;
+
+	/*
+	 * Restore ->bi_private before completing any dm_io, the last one
+	 * ends the original bio. bio_poll() is only called once the bio
+	 * and any split remainder have been submitted, so nothing adds to
+	 * the list behind our back.
+	 */
+	private = list->data;
+	bio->bi_opf &= ~REQ_DM_POLL_LIST;
+	bio->bi_private = private;
+
+	for (curr = list; curr; curr = next) {
+		next = curr->next;
+		if (dm_poll_dm_io(curr, iob, flags)) {
+			/* clone_endio() has already recorded any error */
+			dm_io_dec_pending(curr, BLK_STS_OK);
+		} else {
+			curr->next = pending;
+			pending = curr;
+		}
+	}
+
+	/* still in flight, hang the remaining dm_io off the bio again */
+	if (pending) {
+		pending->data = private;
+		bio->bi_opf |= REQ_DM_POLL_LIST;
+		*head = pending;
+		return 0;
+	}
+	return 1;
+}
+
 /*-----------------------------------------------------------------
  * An IDR is used to keep track of allocated minor numbers.
  *---------------------------------------------------------------*/
@@ -3079,6 +3197,7 @@ static const struct pr_ops dm_pr_ops = {
 
 static const struct block_device_operations dm_blk_dops = {
 	.submit_bio = dm_submit_bio,
+	.poll_bio = dm_poll_bio,
 	.open = dm_blk_open,
 	.release = dm_blk_close,
 	.ioctl = dm_blk_ioctl,
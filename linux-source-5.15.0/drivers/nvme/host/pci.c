@@ -42,6 +42,12 @@
 #define NVME_MAX_KB_SZ	4096
 #define NVME_MAX_SEGS	127
 
+/* PRP and SGL lists kept around by each queue for reuse */
+#define NVME_MAX_CACHED_LISTS	64
+
+/* PRP list entries that fit into an allocation from the small pool */
+#define NVME_SMALL_PRPS		(256 / sizeof(__le64))
+
 static int use_threaded_interrupts;
 module_param(use_threaded_interrupts, int, 0);
 
@@ -182,6 +188,26 @@ static inline struct nvme_dev *to_nvme_dev(struct nvme_ctrl *ctrl)
 	return container_of(ctrl, struct nvme_dev, ctrl);
 }
 
+/*
+ * A PRP or SGL list sitting in a queue's list cache.  The free list is
+ * linked through the list memory itself.
+ */
+struct nvme_cached_list {
+	struct nvme_cached_list *next;
+	dma_addr_t dma_addr;
+};
+
+/*
+ * Lists freed on completion are kept per queue and handed to the next
+ * request needing one, instead of going back to the device wide dma_pool.
+ */
+struct nvme_list_cache {
+	spinlock_t lock;
+	unsigned int nr;
+	struct nvme_cached_list *head;
+	struct dma_pool *pool;
+};
+
 /*
  * An NVM Express queue.  Each device has at least two (one for admin
  * commands and one for I/O commands).
@@ -214,6 +240,8 @@ struct nvme_queue {
 	__le32 *dbbuf_sq_ei;
 	__le32 *dbbuf_cq_ei;
 	struct completion delete_done;
+	struct nvme_list_cache small_lists;
+	struct nvme_list_cache page_lists;
 };
 
 /*
@@ -231,6 +259,10 @@ struct nvme_iod {
 	int nents;		/* Used in scatterlist */
 	dma_addr_t first_dma;
 	unsigned int dma_len;	/* length of single DMA segment mapping */
+	dma_addr_t second_dma;	/* second segment, see nvme_setup_prp_two() */
+	unsigned int second_len;
+	__le64 *prp_list;	/* PRP list of a two segment mapping */
+	dma_addr_t prp_dma;
 	dma_addr_t meta_dma;
 	struct scatterlist *sg;
 };
@@ -522,9 +554,70 @@ static inline bool nvme_pci_use_sgls(struct nvme_dev *dev, struct request *req)
 	return true;
 }
 
+static void nvme_init_list_cache(struct nvme_list_cache *cache,
+		struct dma_pool *pool)
+{
+	spin_lock_init(&cache->lock);
+	cache->nr = 0;
+	cache->head = NULL;
+	cache->pool = pool;
+}
+
+static void nvme_drain_list_cache(struct nvme_list_cache *cache)
+{
+	struct nvme_cached_list *list;
+
+	while ((list = cache->head)) {
+		cache->head = list->next;
+		dma_pool_free(cache->pool, list, list->dma_addr);
+	}
+	cache->nr = 0;
+}
+
+static void *nvme_alloc_list(struct nvme_list_cache *cache,
+		dma_addr_t *dma_addr)
+{
+	struct nvme_cached_list *list;
+	unsigned long flags;
+
+	spin_lock_irqsave(&cache->lock, flags);
+	list = cache->head;
+	if (list) {
+		cache->head = list->next;
+		cache->nr--;
+	}
+	spin_unlock_irqrestore(&cache->lock, flags);
+
+	if (!list)
+		return dma_pool_alloc(cache->pool, GFP_ATOMIC, dma_addr);
+	*dma_addr = list->dma_addr;
+	return list;
+}
+
+static void nvme_free_list(struct nvme_list_cache *cache, void *addr,
+		dma_addr_t dma_addr)
+{
+	struct nvme_cached_list *list = addr;
+	unsigned long flags;
+
+	spin_lock_irqsave(&cache->lock, flags);
+	if (cache->nr < NVME_MAX_CACHED_LISTS) {
+		list->next = cache->head;
+		list->dma_addr = dma_addr;
+		cache->head = list;
+		cache->nr++;
+		list = NULL;
+	}
+	spin_unlock_irqrestore(&cache->lock, flags);
+
+	if (list)
+		dma_pool_free(cache->pool, list, dma_addr);
+}
+
 static void nvme_free_prps(struct nvme_dev *dev, struct request *req)
 {
 	const int last_prp = NVME_CTRL_PAGE_SIZE / sizeof(__le64) - 1;
+	struct nvme_queue *nvmeq = req->mq_hctx->driver_data;
 	struct nvme_iod *iod = blk_mq_rq_to_pdu(req);
 	dma_addr_t dma_addr = iod->first_dma;
 	int i;
@@ -533,7 +626,7 @@ static void nvme_free_prps(struct nvme_dev *dev, struct request *req)
 		__le64 *prp_list = nvme_pci_iod_list(req)[i];
 		dma_addr_t next_dma_addr = le64_to_cpu(prp_list[last_prp]);
 
-		dma_pool_free(dev->prp_page_pool, prp_list, dma_addr);
+		nvme_free_list(&nvmeq->page_lists, prp_list, dma_addr);
 		dma_addr = next_dma_addr;
 	}
 }
@@ -541,6 +634,7 @@ static void nvme_free_prps(struct nvme_dev *dev, struct request *req)
 static void nvme_free_sgls(struct nvme_dev *dev, struct request *req)
 {
 	const int last_sg = SGES_PER_PAGE - 1;
+	struct nvme_queue *nvmeq = req->mq_hctx->driver_data;
 	struct nvme_iod *iod = blk_mq_rq_to_pdu(req);
 	dma_addr_t dma_addr = iod->first_dma;
 	int i;
@@ -549,7 +643,7 @@ static void nvme_free_sgls(struct nvme_dev *dev, struct request *req)
 		struct nvme_sgl_desc *sg_list = nvme_pci_iod_list(req)[i];
 		dma_addr_t next_dma_addr = le64_to_cpu((sg_list[last_sg]).addr);
 
-		dma_pool_free(dev->prp_page_pool, sg_list, dma_addr);
+		nvme_free_list(&nvmeq->page_lists, sg_list, dma_addr);
 		dma_addr = next_dma_addr;
 	}
 }
@@ -567,11 +661,19 @@ static void nvme_unmap_sg(struct nvme_dev *dev, struct request *req)
 
 static void nvme_unmap_data(struct nvme_dev *dev, struct request *req)
 {
+	struct nvme_queue *nvmeq = req->mq_hctx->driver_data;
 	struct nvme_iod *iod = blk_mq_rq_to_pdu(req);
 
 	if (iod->dma_len) {
 		dma_unmap_page(dev->dev, iod->first_dma, iod->dma_len,
 			       rq_dma_dir(req));
+		if (!iod->second_len)
+			return;
+		dma_unmap_page(dev->dev, iod->second_dma, iod->second_len,
+			       rq_dma_dir(req));
+		if (iod->prp_list)
+			nvme_free_list(&nvmeq->small_lists, iod->prp_list,
+				       iod->prp_dma);
 		return;
 	}
 
@@ -579,8 +681,8 @@ static void nvme_unmap_data(struct nvme_dev *dev, struct request *req)
 
 	nvme_unmap_sg(dev, req);
 	if (iod->npages == 0)
-		dma_pool_free(dev->prp_small_pool, nvme_pci_iod_list(req)[0],
-			      iod->first_dma);
+		nvme_free_list(&nvmeq->small_lists, nvme_pci_iod_list(req)[0],
+			       iod->first_dma);
 	else if (iod->use_sgl)
 		nvme_free_sgls(dev, req);
 	else
@@ -605,8 +707,9 @@ static void nvme_print_sgl(struct scatterlist *sgl, int nents)
 static blk_status_t nvme_pci_setup_prps(struct nvme_dev *dev,
 		struct request *req, struct nvme_rw_command *cmnd)
 {
+	struct nvme_queue *nvmeq = req->mq_hctx->driver_data;
 	struct nvme_iod *iod = blk_mq_rq_to_pdu(req);
-	struct dma_pool *pool;
+	struct nvme_list_cache *cache;
 	int length = blk_rq_payload_bytes(req);
 	struct scatterlist *sg = iod->sg;
 	int dma_len = sg_dma_len(sg);
@@ -638,15 +741,15 @@ static blk_status_t nvme_pci_setup_prps(struct nvme_dev *dev,
 	}
 
 	nprps = DIV_ROUND_UP(length, NVME_CTRL_PAGE_SIZE);
-	if (nprps <= (256 / 8)) {
-		pool = dev->prp_small_pool;
+	if (nprps <= NVME_SMALL_PRPS) {
+		cache = &nvmeq->small_lists;
 		iod->npages = 0;
 	} else {
-		pool = dev->prp_page_pool;
+		cache = &nvmeq->page_lists;
 		iod->npages = 1;
 	}
 
-	prp_list = dma_pool_alloc(pool, GFP_ATOMIC, &prp_dma);
+	prp_list = nvme_alloc_list(cache, &prp_dma);
 	if (!prp_list) {
 		iod->first_dma = dma_addr;
 		iod->npages = -1;
@@ -658,7 +761,7 @@ static blk_status_t nvme_pci_setup_prps(struct nvme_dev *dev,
 	for (;;) {
 		if (i == NVME_CTRL_PAGE_SIZE >> 3) {
 			__le64 *old_prp_list = prp_list;
-			prp_list = dma_pool_alloc(pool, GFP_ATOMIC, &prp_dma);
+			prp_list = nvme_alloc_list(cache, &prp_dma);
 			if (!prp_list)
 				goto free_prps;
 			list[iod->npages++] = prp_list;
@@ -718,8 +821,9 @@ static void nvme_pci_sgl_set_seg(struct nvme_sgl_desc *sge,
 static blk_status_t nvme_pci_setup_sgls(struct nvme_dev *dev,
 		struct request *req, struct nvme_rw_command *cmd, int entries)
 {
+	struct nvme_queue *nvmeq = req->mq_hctx->driver_data;
 	struct nvme_iod *iod = blk_mq_rq_to_pdu(req);
-	struct dma_pool *pool;
+	struct nvme_list_cache *cache;
 	struct nvme_sgl_desc *sg_list;
 	struct scatterlist *sg = iod->sg;
 	dma_addr_t sgl_dma;
@@ -734,14 +838,14 @@ static blk_status_t nvme_pci_setup_sgls(struct nvme_dev *dev,
 	}
 
 	if (entries <= (256 / sizeof(struct nvme_sgl_desc))) {
-		pool = dev->prp_small_pool;
+		cache = &nvmeq->small_lists;
 		iod->npages = 0;
 	} else {
-		pool = dev->prp_page_pool;
+		cache = &nvmeq->page_lists;
 		iod->npages = 1;
 	}
 
-	sg_list = dma_pool_alloc(pool, GFP_ATOMIC, &sgl_dma);
+	sg_list = nvme_alloc_list(cache, &sgl_dma);
 	if (!sg_list) {
 		iod->npages = -1;
 		return BLK_STS_RESOURCE;
@@ -757,7 +861,7 @@ static blk_status_t nvme_pci_setup_sgls(struct nvme_dev *dev,
 			struct nvme_sgl_desc *old_sg_desc = sg_list;
 			struct nvme_sgl_desc *link = &old_sg_desc[i - 1];
 
-			sg_list = dma_pool_alloc(pool, GFP_ATOMIC, &sgl_dma);
+			sg_list = nvme_alloc_list(cache, &sgl_dma);
 			if (!sg_list)
 				goto free_sgls;
 
@@ -816,6 +920,94 @@ static blk_status_t nvme_setup_sgl_simple(struct nvme_dev *dev,
 	return BLK_STS_OK;
 }
 
+/*
+ * Two segment requests whose PRPs fit into prp1 and prp2 or a small PRP list
+ * map their bvecs directly, without going through a scatterlist.  The
+ * virt_boundary limit makes the first segment end and the second one start
+ * on a controller page boundary, check it anyway.
+ */
+static bool nvme_pci_prp_two_ok(struct request *req, struct bio_vec *bv)
+{
+	struct req_iterator iter;
+	struct bio_vec bvec;
+	unsigned int offset, nprps;
+	int nr = 0;
+
+	rq_for_each_bvec(bvec, req, iter) {
+		if (nr == 2 || is_pci_p2pdma_page(bvec.bv_page))
+			return false;
+		bv[nr++] = bvec;
+	}
+	if (nr != 2)
+		return false;
+
+	offset = bv[0].bv_offset & (NVME_CTRL_PAGE_SIZE - 1);
+	if ((offset + bv[0].bv_len) & (NVME_CTRL_PAGE_SIZE - 1) ||
+	    bv[1].bv_offset & (NVME_CTRL_PAGE_SIZE - 1))
+		return false;
+
+	/* entries past prp1 */
+	nprps = (offset + bv[0].bv_len) / NVME_CTRL_PAGE_SIZE - 1 +
+		DIV_ROUND_UP(bv[1].bv_len, NVME_CTRL_PAGE_SIZE);
+	return nprps <= NVME_SMALL_PRPS;
+}
+
+static blk_status_t nvme_setup_prp_two(struct nvme_dev *dev,
+		struct request *req, struct nvme_rw_command *cmnd,
+		struct bio_vec *bv)
+{
+	struct nvme_queue *nvmeq = req->mq_hctx->driver_data;
+	struct nvme_iod *iod = blk_mq_rq_to_pdu(req);
+	unsigned int offset = bv[0].bv_offset & (NVME_CTRL_PAGE_SIZE - 1);
+	dma_addr_t dma_addr, end;
+	__le64 *prp_list;
+	int i = 0;
+
+	iod->first_dma = dma_map_bvec(dev->dev, &bv[0], rq_dma_dir(req), 0);
+	if (dma_mapping_error(dev->dev, iod->first_dma))
+		return BLK_STS_RESOURCE;
+	iod->second_dma = dma_map_bvec(dev->dev, &bv[1], rq_dma_dir(req), 0);
+	if (dma_mapping_error(dev->dev, iod->second_dma))
+		goto out_unmap_first;
+	iod->dma_len = bv[0].bv_len;
+	iod->second_len = bv[1].bv_len;
+	iod->prp_list = NULL;
+
+	cmnd->dptr.prp1 = cpu_to_le64(iod->first_dma);
+	if (offset + bv[0].bv_len == NVME_CTRL_PAGE_SIZE &&
+	    bv[1].bv_len <= NVME_CTRL_PAGE_SIZE) {
+		cmnd->dptr.prp2 = cpu_to_le64(iod->second_dma);
+		return BLK_STS_OK;
+	}
+
+	prp_list = nvme_alloc_list(&nvmeq->small_lists, &iod->prp_dma);
+	if (!prp_list)
+		goto out_unmap_second;
+	iod->prp_list = prp_list;
+
+	end = iod->first_dma + iod->dma_len;
+	for (dma_addr = iod->first_dma - offset + NVME_CTRL_PAGE_SIZE;
+	     dma_addr < end; dma_addr += NVME_CTRL_PAGE_SIZE)
+		prp_list[i++] = cpu_to_le64(dma_addr);
+	end = iod->second_dma + iod->second_len;
+	for (dma_addr = iod->second_dma; dma_addr < end;
+	     dma_addr += NVME_CTRL_PAGE_SIZE)
+		prp_list[i++] = cpu_to_le64(dma_addr);
+
+	cmnd->dptr.prp2 = cpu_to_le64(iod->prp_dma);
+	return BLK_STS_OK;
+
+out_unmap_second:
+	dma_unmap_page(dev->dev, iod->second_dma, bv[1].bv_len,
+		       rq_dma_dir(req));
+out_unmap_first:
+	dma_unmap_page(dev->dev, iod->first_dma, bv[0].bv_len,
+		       rq_dma_dir(req));
+	iod->dma_len = 0;
+	iod->second_len = 0;
+	return BLK_STS_RESOURCE;
+}
+
 static blk_status_t nvme_map_data(struct nvme_dev *dev, struct request *req,
 		struct nvme_command *cmnd)
 {
@@ -838,9 +1030,14 @@ static blk_status_t nvme_map_data(struct nvme_dev *dev, struct request *req,
 				return nvme_setup_sgl_simple(dev, req,
 							     &cmnd->rw, &bv);
 		}
+	} else if (blk_rq_nr_phys_segments(req) == 2 &&
+		   !nvme_pci_use_sgls(dev, req)) {
+		struct bio_vec bv[2];
+
+		if (nvme_pci_prp_two_ok(req, bv))
+			return nvme_setup_prp_two(dev, req, &cmnd->rw, bv);
 	}
 
-	iod->dma_len = 0;
 	iod->sg = mempool_alloc(dev->iod_mempool, GFP_ATOMIC);
 	if (!iod->sg)
 		return BLK_STS_RESOURCE;
@@ -895,6 +1092,8 @@ static blk_status_t nvme_prep_rq(struct nvme_dev *dev, struct request *req)
 	iod->aborted = 0;
 	iod->npages = -1;
 	iod->nents = 0;
+	iod->dma_len = 0;
+	iod->second_len = 0;
 
 	ret = nvme_setup_cmd(req->q->queuedata, req);
 	if (ret)
@@ -954,7 +1153,7 @@ static blk_status_t nvme_queue_rq(struct blk_mq_hw_ctx *hctx,
 	return BLK_STS_OK;
 }
 
-static void nvme_pci_complete_rq(struct request *req)
+static __always_inline void nvme_pci_unmap_rq(struct request *req)
 {
 	struct nvme_queue *nvmeq = req->mq_hctx->driver_data;
 	struct nvme_dev *dev = nvmeq->dev;
@@ -968,9 +1167,19 @@ static void nvme_pci_complete_rq(struct request *req)
 
 	if (blk_rq_nr_phys_segments(req))
 		nvme_unmap_data(dev, req);
+}
+
+static void nvme_pci_complete_rq(struct request *req)
+{
+	nvme_pci_unmap_rq(req);
 	nvme_complete_rq(req);
 }
 
+static void nvme_pci_complete_batch(struct io_comp_batch *iob)
+{
+	nvme_complete_batch(iob, nvme_pci_unmap_rq);
+}
+
 /* We read the CQE phase first to check if the rest of the entry is valid */
 static inline bool nvme_cqe_pending(struct nvme_queue *nvmeq)
 {
@@ -995,7 +1204,8 @@ static inline struct blk_mq_tags *nvme_queue_tagset(struct nvme_queue *nvmeq)
 	return nvmeq->dev->tagset.tags[nvmeq->qid - 1];
 }
 
-static inline void nvme_handle_cqe(struct nvme_queue *nvmeq, u16 idx)
+static inline void nvme_handle_cqe(struct nvme_queue *nvmeq,
+				   struct io_comp_batch *iob, u16 idx)
 {
 	struct nvme_completion *cqe = &nvmeq->cqes[idx];
 	__u16 command_id = READ_ONCE(cqe->command_id);
@@ -1022,7 +1232,9 @@ static inline void nvme_handle_cqe(struct nvme_queue *nvmeq, u16 idx)
 	}
 
 	trace_nvme_sq(req, cqe->sq_head, nvmeq->sq_tail);
-	if (!nvme_try_complete_req(req, cqe->status, cqe->result))
+	if (!nvme_try_complete_req(req, cqe->status, cqe->result) &&
+	    !blk_mq_add_to_batch(req, iob, nvme_req(req)->status,
+				 nvme_pci_complete_batch))
 		nvme_pci_complete_rq(req);
 }
 
@@ -1038,7 +1250,8 @@ static inline void nvme_update_cq_head(struct nvme_queue *nvmeq)
 	}
 }
 
-static inline int nvme_process_cq(struct nvme_queue *nvmeq)
+static inline int nvme_process_cq(struct nvme_queue *nvmeq,
+				  struct io_comp_batch *iob)
 {
 	int found = 0;
 
@@ -1049,7 +1262,7 @@ static inline int nvme_process_cq(struct nvme_queue *nvmeq)
 		 * the cqe requires a full read memory barrier
 		 */
 		dma_rmb();
-		nvme_handle_cqe(nvmeq, nvmeq->cq_head);
+		nvme_handle_cqe(nvmeq, iob, nvmeq->cq_head);
 		nvme_update_cq_head(nvmeq);
 	}
 
@@ -1061,9 +1274,13 @@ static inline int nvme_process_cq(struct nvme_queue *nvmeq)
 static irqreturn_t nvme_irq(int irq, void *data)
 {
 	struct nvme_queue *nvmeq = data;
+	DEFINE_IO_COMP_BATCH(iob);
 
-	if (nvme_process_cq(nvmeq))
+	if (nvme_process_cq(nvmeq, &iob)) {
+		if (!rq_list_empty(iob.req_list))
+			nvme_pci_complete_batch(&iob);
 		return IRQ_HANDLED;
+	}
 	return IRQ_NONE;
 }
 
@@ -1087,11 +1304,11 @@ static void nvme_poll_irqdisable(struct nvme_queue *nvmeq)
 	WARN_ON_ONCE(test_bit(NVMEQ_POLLED, &nvmeq->flags));
 
 	disable_irq(pci_irq_vector(pdev, nvmeq->cq_vector));
-	nvme_process_cq(nvmeq);
+	nvme_process_cq(nvmeq, NULL);
 	enable_irq(pci_irq_vector(pdev, nvmeq->cq_vector));
 }
 
-static int nvme_poll(struct blk_mq_hw_ctx *hctx)
+static int nvme_poll(struct blk_mq_hw_ctx *hctx, struct io_comp_batch *iob)
 {
 	struct nvme_queue *nvmeq = hctx->driver_data;
 	bool found;
@@ -1100,7 +1317,7 @@ static int nvme_poll(struct blk_mq_hw_ctx *hctx)
 		return 0;
 
 	spin_lock(&nvmeq->cq_poll_lock);
-	found = nvme_process_cq(nvmeq);
+	found = nvme_process_cq(nvmeq, iob);
 	spin_unlock(&nvmeq->cq_poll_lock);
 
 	return found;
@@ -1276,7 +1493,7 @@ static enum blk_eh_timer_return nvme_timeout(struct request *req, bool reserved)
 	 * Did we miss an interrupt?
 	 */
 	if (test_bit(NVMEQ_POLLED, &nvmeq->flags))
-		nvme_poll(req->mq_hctx);
+		nvme_poll(req->mq_hctx, NULL);
 	else
 		nvme_poll_irqdisable(nvmeq);
 
@@ -1360,6 +1577,8 @@ static enum blk_eh_timer_return nvme_timeout(struct request *req, bool reserved)
 
 static void nvme_free_queue(struct nvme_queue *nvmeq)
 {
+	nvme_drain_list_cache(&nvmeq->small_lists);
+	nvme_drain_list_cache(&nvmeq->page_lists);
 	dma_free_coherent(nvmeq->dev->dev, CQ_SIZE(nvmeq),
 				(void *)nvmeq->cqes, nvmeq->cq_dma_addr);
 	if (!nvmeq->sq_cmds)
@@ -1436,7 +1655,7 @@ static void nvme_reap_pending_cqes(struct nvme_dev *dev)
 
 	for (i = dev->ctrl.queue_count - 1; i > 0; i--) {
 		spin_lock(&dev->queues[i].cq_poll_lock);
-		nvme_process_cq(&dev->queues[i]);
+		nvme_process_cq(&dev->queues[i], NULL);
 		spin_unlock(&dev->queues[i].cq_poll_lock);
 	}
 }
@@ -1512,6 +1731,8 @@ static int nvme_alloc_queue(struct nvme_dev *dev, int qid, int depth)
 	nvmeq->dev = dev;
 	spin_lock_init(&nvmeq->sq_lock);
 	spin_lock_init(&nvmeq->cq_poll_lock);
+	nvme_init_list_cache(&nvmeq->small_lists, dev->prp_small_pool);
+	nvme_init_list_cache(&nvmeq->page_lists, dev->prp_page_pool);
 	nvmeq->cq_head = 0;
 	nvmeq->cq_phase = 1;
 	nvmeq->q_db = &dev->dbs[qid * 2 * dev->db_stride];
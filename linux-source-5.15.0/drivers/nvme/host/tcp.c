@@ -30,6 +30,17 @@ static int so_priority;
 module_param(so_priority, int, 0644);
 MODULE_PARM_DESC(so_priority, "nvme tcp socket optimize priority");
 
+/*
+ * Busy poll the NIC queue of a socket for up to this many microseconds
+ * before letting io_work go idle, so that the next completion does not
+ * wait for an interrupt and a workqueue wakeup.  Needs
+ * CONFIG_NET_RX_BUSY_POLL, 0 disables it.
+ */
+static unsigned int busy_poll_usecs;
+module_param(busy_poll_usecs, uint, 0444);
+MODULE_PARM_DESC(busy_poll_usecs,
+		 "nvme tcp io_work socket busy poll time in usecs (default: 0)");
+
 #ifdef CONFIG_DEBUG_LOCK_ALLOC
 /* lockdep can detect a circular dependency of the form
  *   sk_lock -> mmap_lock (page fault) -> fs locks -> sk_lock
@@ -1181,6 +1192,17 @@ static int nvme_tcp_try_recv(struct nvme_tcp_queue *queue)
 	return consumed;
 }
 
+static bool nvme_tcp_busy_poll(struct nvme_tcp_queue *queue)
+{
+	struct sock *sk = queue->sock->sk;
+
+	if (!busy_poll_usecs || !sk_can_busy_loop(sk))
+		return false;
+
+	sk_busy_loop(sk, false);
+	return !skb_queue_empty_lockless(&sk->sk_receive_queue);
+}
+
 static void nvme_tcp_io_work(struct work_struct *w)
 {
 	struct nvme_tcp_queue *queue =
@@ -1206,7 +1228,9 @@ static void nvme_tcp_io_work(struct work_struct *w)
 		else if (unlikely(result < 0))
 			return;
 
-		if (!pending || !queue->rd_enabled)
+		if (!queue->rd_enabled)
+			return;
+		if (!pending && !nvme_tcp_busy_poll(queue))
 			return;
 
 	} while (!time_after(jiffies, deadline)); /* quota is exhausted */
@@ -1428,16 +1452,35 @@ static bool nvme_tcp_poll_queue(struct nvme_tcp_queue *queue)
 static void nvme_tcp_set_queue_io_cpu(struct nvme_tcp_queue *queue)
 {
 	struct nvme_tcp_ctrl *ctrl = queue->ctrl;
+	struct blk_mq_queue_map *map = NULL;
 	int qid = nvme_tcp_queue_id(queue);
-	int n = 0;
+	int n = 0, cpu;
 
-	if (nvme_tcp_default_queue(queue))
+	if (nvme_tcp_default_queue(queue)) {
+		map = &ctrl->tag_set.map[HCTX_TYPE_DEFAULT];
 		n = qid - 1;
-	else if (nvme_tcp_read_queue(queue))
+	} else if (nvme_tcp_read_queue(queue)) {
+		map = &ctrl->tag_set.map[HCTX_TYPE_READ];
 		n = qid - ctrl->io_queues[HCTX_TYPE_DEFAULT] - 1;
-	else if (nvme_tcp_poll_queue(queue))
+	} else if (nvme_tcp_poll_queue(queue)) {
+		map = &ctrl->tag_set.map[HCTX_TYPE_POLL];
 		n = qid - ctrl->io_queues[HCTX_TYPE_DEFAULT] -
 				ctrl->io_queues[HCTX_TYPE_READ] - 1;
+	}
+
+	/*
+	 * Run io_work on a CPU that blk-mq maps to this queue.  Requests are
+	 * then sent from the CPU that submitted them and completed without
+	 * bouncing through an IPI.
+	 */
+	if (map && map->mq_map) {
+		for_each_online_cpu(cpu) {
+			if (map->mq_map[cpu] == qid - 1) {
+				queue->io_cpu = cpu;
+				return;
+			}
+		}
+	}
 	queue->io_cpu = cpumask_next_wrap(n - 1, cpu_online_mask, -1, false);
 }
 
@@ -1496,7 +1539,6 @@ static int nvme_tcp_alloc_queue(struct nvme_ctrl *nctrl,
 	queue->sock->sk->sk_rcvtimeo = 10 * HZ;
 
 	queue->sock->sk->sk_allocation = GFP_ATOMIC;
-	nvme_tcp_set_queue_io_cpu(queue);
 	queue->request = NULL;
 	queue->data_remaining = 0;
 	queue->ddgst_remaining = 0;
@@ -1624,7 +1666,7 @@ static void nvme_tcp_setup_sock_ops(struct nvme_tcp_queue *queue)
 	queue->sock->sk->sk_state_change = nvme_tcp_state_change;
 	queue->sock->sk->sk_write_space = nvme_tcp_write_space;
 #ifdef CONFIG_NET_RX_BUSY_POLL
-	queue->sock->sk->sk_ll_usec = 1;
+	queue->sock->sk->sk_ll_usec = busy_poll_usecs ?: 1;
 #endif
 	write_unlock_bh(&queue->sock->sk->sk_callback_lock);
 }
@@ -1635,6 +1677,8 @@ static int nvme_tcp_start_queue(struct nvme_ctrl *nctrl, int idx)
 	struct nvme_tcp_queue *queue = &ctrl->queues[idx];
 	int ret;
 
+	/* the tagset, and with it the blk-mq CPU mapping, exists by now */
+	nvme_tcp_set_queue_io_cpu(queue);
 	queue->rd_enabled = true;
 	nvme_tcp_init_recv_ctx(queue);
 	nvme_tcp_setup_sock_ops(queue);
@@ -1864,7 +1908,7 @@ static void nvme_tcp_destroy_io_queues(struct nvme_ctrl *ctrl, bool remove)
 
 static int nvme_tcp_configure_io_queues(struct nvme_ctrl *ctrl, bool new)
 {
-	int ret, nr_queues;
+	int i, ret, nr_queues;
 
 	ret = nvme_tcp_alloc_io_queues(ctrl);
 	if (ret)
@@ -1909,6 +1953,12 @@ static int nvme_tcp_configure_io_queues(struct nvme_ctrl *ctrl, bool new)
 		}
 		blk_mq_update_nr_hw_queues(ctrl->tagset,
 			ctrl->queue_count - 1);
+		/*
+		 * The queues above were started with the old blk-mq CPU
+		 * mapping, move their io_work to a CPU of the new one.
+		 */
+		for (i = 1; i < nr_queues; i++)
+			nvme_tcp_set_queue_io_cpu(&to_tcp_ctrl(ctrl)->queues[i]);
 		nvme_unfreeze(ctrl);
 	}
 
@@ -2503,7 +2553,8 @@ static int nvme_tcp_map_queues(struct blk_mq_tag_set *set)
 	return 0;
 }
 
-static int nvme_tcp_poll(struct blk_mq_hw_ctx *hctx)
+static int nvme_tcp_poll(struct blk_mq_hw_ctx *hctx,
+		struct io_comp_batch *iob)
 {
 	struct nvme_tcp_queue *queue = hctx->driver_data;
 	struct sock *sk = queue->sock->sk;
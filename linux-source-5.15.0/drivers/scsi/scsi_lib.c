@@ -1793,7 +1793,8 @@ static void scsi_mq_exit_request(struct blk_mq_tag_set *set, struct request *rq,
 }
 
 
-static int scsi_mq_poll(struct blk_mq_hw_ctx *hctx)
+static int scsi_mq_poll(struct blk_mq_hw_ctx *hctx,
+		struct io_comp_batch *iob)
 {
 	struct Scsi_Host *shost = hctx->driver_data;
 
@@ -37,6 +37,8 @@
 #include <linux/seq_file.h>
 #include <linux/compat.h>
 #include <linux/rculist.h>
+#include <linux/vmalloc.h>
+#include <linux/log2.h>
 #include <net/busy_poll.h>
 
 /*
@@ -104,6 +106,9 @@
 
 #define EP_ITEM_COST (sizeof(struct epitem) + sizeof(struct eppoll_entry))
 
+/* Maximum number of entries of the shared event ring */
+#define EP_RING_MAX_ENTRIES 32768
+
 struct epoll_filefd {
 	struct file *file;
 	int fd;
@@ -169,6 +174,19 @@ struct epitem {
 	struct epoll_event event;
 };
 
+/*
+ * Shared event ring mapped into userspace. The kernel produces at ->tail,
+ * userspace consumes at ->head. The indices live on separate cachelines so
+ * producer and consumer do not bounce each other's line.
+ */
+struct ep_ring {
+	u32 head ____cacheline_aligned_in_smp;
+	u32 tail ____cacheline_aligned_in_smp;
+	u32 ring_mask;
+	u32 ring_entries;
+	struct epoll_ring_event events[] ____cacheline_aligned_in_smp;
+};
+
 /*
  * This structure is stored inside the "private_data" member of the file
  * structure and represents the main data structure for the eventpoll
@@ -213,6 +231,17 @@ struct eventpoll {
 
 	struct file *file;
 
+	/*
+	 * Optional shared event ring. Installed once under ->lock and never
+	 * replaced, so the poll callback can use it under the read lock.
+	 * ->ring_lock serializes producers, ->ring_tail is the kernel copy
+	 * of the tail index that userspace cannot tamper with.
+	 */
+	struct ep_ring *ring;
+	spinlock_t ring_lock;
+	u32 ring_tail;
+	u32 ring_mask;
+
 	/* used to optimize loop detection check */
 	u64 gen;
 	struct hlist_head refs;
@@ -361,6 +390,13 @@ static inline struct epitem *ep_item_from_wait(wait_queue_entry_t *p)
 	return container_of(p, struct eppoll_entry, wait)->base;
 }
 
+static inline bool ep_ring_pending(struct eventpoll *ep)
+{
+	struct ep_ring *ring = READ_ONCE(ep->ring);
+
+	return ring && READ_ONCE(ring->head) != READ_ONCE(ep->ring_tail);
+}
+
 /**
  * ep_events_available - Checks if ready events might be available.
  *
@@ -372,7 +408,8 @@ static inline struct epitem *ep_item_from_wait(wait_queue_entry_t *p)
 static inline int ep_events_available(struct eventpoll *ep)
 {
 	return !list_empty_careful(&ep->rdllist) ||
-		READ_ONCE(ep->ovflist) != EP_UNACTIVE_PTR;
+		READ_ONCE(ep->ovflist) != EP_UNACTIVE_PTR ||
+		ep_ring_pending(ep);
 }
 
 #ifdef CONFIG_NET_RX_BUSY_POLL
@@ -780,6 +817,7 @@ static void ep_free(struct eventpoll *ep)
 	mutex_destroy(&ep->mtx);
 	free_uid(ep->user);
 	wakeup_source_unregister(ep->ws);
+	vfree(ep->ring);
 	kfree(ep);
 }
 
@@ -808,6 +846,9 @@ static __poll_t __ep_eventpoll_poll(struct file *file, poll_table *wait, int dep
 	/* Insert inside our poll wait queue */
 	poll_wait(file, &ep->poll_wait, wait);
 
+	if (ep_ring_pending(ep))
+		return EPOLLIN | EPOLLRDNORM;
+
 	/*
 	 * Proceed to find out if wanted events are really available inside
 	 * the ready list.
@@ -893,6 +934,82 @@ static __poll_t ep_eventpoll_poll(struct file *file, poll_table *wait)
 	return __ep_eventpoll_poll(file, wait, 0);
 }
 
+static int ep_setup_ring(struct eventpoll *ep,
+			 struct epoll_ring_params __user *argp)
+{
+	struct epoll_ring_params p;
+	struct ep_ring *ring;
+	unsigned int entries;
+	size_t size;
+	int error;
+
+	if (copy_from_user(&p, argp, sizeof(p)))
+		return -EFAULT;
+	if (p.flags || !p.entries || p.entries > EP_RING_MAX_ENTRIES)
+		return -EINVAL;
+
+	entries = roundup_pow_of_two(p.entries);
+	size = struct_size(ring, events, entries);
+	ring = vmalloc_user(size);
+	if (!ring)
+		return -ENOMEM;
+	ring->ring_mask = entries - 1;
+	ring->ring_entries = entries;
+
+	memset(&p, 0, sizeof(p));
+	p.entries = entries;
+	p.head = offsetof(struct ep_ring, head);
+	p.tail = offsetof(struct ep_ring, tail);
+	p.ring_mask = offsetof(struct ep_ring, ring_mask);
+	p.ring_entries = offsetof(struct ep_ring, ring_entries);
+	p.events = offsetof(struct ep_ring, events);
+	p.size = size;
+
+	mutex_lock(&ep->mtx);
+	error = -EBUSY;
+	if (ep->ring)
+		goto out_unlock;
+	error = -EFAULT;
+	if (copy_to_user(argp, &p, sizeof(p)))
+		goto out_unlock;
+
+	write_lock_irq(&ep->lock);
+	ep->ring_tail = 0;
+	ep->ring_mask = entries - 1;
+	smp_store_release(&ep->ring, ring);
+	write_unlock_irq(&ep->lock);
+	mutex_unlock(&ep->mtx);
+	return 0;
+
+out_unlock:
+	mutex_unlock(&ep->mtx);
+	vfree(ring);
+	return error;
+}
+
+static long ep_eventpoll_ioctl(struct file *file, unsigned int cmd,
+			       unsigned long arg)
+{
+	struct eventpoll *ep = file->private_data;
+
+	switch (cmd) {
+	case EPIOCSRING:
+		return ep_setup_ring(ep, (void __user *)arg);
+	default:
+		return -ENOIOCTLCMD;
+	}
+}
+
+static int ep_eventpoll_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct eventpoll *ep = file->private_data;
+	struct ep_ring *ring = smp_load_acquire(&ep->ring);
+
+	if (!ring)
+		return -ENXIO;
+	return remap_vmalloc_range(vma, ring, vma->vm_pgoff);
+}
+
 #ifdef CONFIG_PROC_FS
 static void ep_show_fdinfo(struct seq_file *m, struct file *f)
 {
@@ -924,6 +1041,9 @@ static const struct file_operations eventpoll_fops = {
 #endif
 	.release	= ep_eventpoll_release,
 	.poll		= ep_eventpoll_poll,
+	.unlocked_ioctl	= ep_eventpoll_ioctl,
+	.compat_ioctl	= compat_ptr_ioctl,
+	.mmap		= ep_eventpoll_mmap,
 	.llseek		= noop_llseek,
 };
 
@@ -979,6 +1099,7 @@ static int ep_alloc(struct eventpoll **pep)
 
 	mutex_init(&ep->mtx);
 	rwlock_init(&ep->lock);
+	spin_lock_init(&ep->ring_lock);
 	init_waitqueue_head(&ep->wq);
 	init_waitqueue_head(&ep->poll_wait);
 	INIT_LIST_HEAD(&ep->rdllist);
@@ -1145,6 +1266,50 @@ static inline bool chain_epi_lockless(struct epitem *epi)
 	return true;
 }
 
+/*
+ * Only edge triggered items can be delivered through the shared ring: level
+ * triggered items need to be re-polled on every harvest, oneshot items need
+ * to be disarmed under ep->mtx and wakeup sources are relaxed by
+ * ep_send_events().
+ */
+static inline bool ep_item_uses_ring(struct eventpoll *ep, struct epitem *epi)
+{
+	return ep->ring && (epi->event.events &
+		(EPOLLET | EPOLLONESHOT | EPOLLWAKEUP)) == EPOLLET;
+}
+
+/*
+ * Append an event for @epi to the shared ring. Called from the poll callback
+ * with ep->lock held for reading. Returns false if the ring is full, in which
+ * case the caller falls back to the ready list.
+ */
+static bool ep_ring_add(struct eventpoll *ep, struct epitem *epi,
+			__poll_t pollflags)
+{
+	struct ep_ring *ring = ep->ring;
+	struct epoll_ring_event *ev;
+	bool queued = false;
+	u32 tail;
+
+	spin_lock(&ep->ring_lock);
+	tail = ep->ring_tail;
+	if (tail - smp_load_acquire(&ring->head) <= ep->ring_mask) {
+		ev = &ring->events[tail & ep->ring_mask];
+		ev->data = epi->event.data;
+		if (pollflags)
+			ev->events = pollflags & epi->event.events;
+		else
+			ev->events = epi->event.events & ~EP_PRIVATE_BITS;
+		ev->resv = 0;
+		WRITE_ONCE(ep->ring_tail, tail + 1);
+		/* order the entry store before the tail update */
+		smp_store_release(&ring->tail, tail + 1);
+		queued = true;
+	}
+	spin_unlock(&ep->ring_lock);
+	return queued;
+}
+
 /*
  * This is the callback that is passed to the wait queue wakeup
  * mechanism. It is called by the stored file descriptors when they
@@ -1199,8 +1364,13 @@ static int ep_poll_callback(wait_queue_entry_t *wait, unsigned mode, int sync, v
 	 * (because we're accessing user memory, and because of linux f_op->poll()
 	 * semantics). All the events that happen during that period of time are
 	 * chained in ep->ovflist and requeued later on.
+	 *
+	 * Edge triggered items bypass both lists when a shared ring is set
+	 * up and there is room in it.
 	 */
-	if (READ_ONCE(ep->ovflist) != EP_UNACTIVE_PTR) {
+	if (ep_item_uses_ring(ep, epi) && ep_ring_add(ep, epi, pollflags)) {
+		/* Userspace harvests the event straight from the ring. */
+	} else if (READ_ONCE(ep->ovflist) != EP_UNACTIVE_PTR) {
 		if (chain_epi_lockless(epi))
 			ep_pm_stay_awake_rcu(epi);
 	} else if (!ep_is_linked(epi)) {
@@ -1861,6 +2031,12 @@ static int ep_poll(struct eventpoll *ep, struct epoll_event __user *events,
 			res = ep_send_events(ep, events, maxevents);
 			if (res)
 				return res;
+			/*
+			 * Events sitting in the shared ring are consumed by
+			 * userspace directly, all we had to do was wait.
+			 */
+			if (ep_ring_pending(ep))
+				return 0;
 		}
 
 		if (timed_out)
@@ -54,7 +54,11 @@ iomap_page_create(struct inode *inode, struct page *page)
 	struct iomap_page *iop = to_iomap_page(page);
 	unsigned int nr_blocks = i_blocks_per_page(inode, page);
 
-	if (iop || nr_blocks <= 1)
+	/*
+	 * Bio completions walk a large page one PAGE_SIZE segment at a time,
+	 * so it needs the byte counts even if it is a single block.
+	 */
+	if (iop || (nr_blocks <= 1 && !PageHead(page)))
 		return iop;
 
 	iop = kzalloc(struct_size(iop, uptodate, BITS_TO_LONGS(nr_blocks)),
@@ -85,15 +89,16 @@ iomap_page_release(struct page *page)
  * Calculate the range inside the page that we actually need to read.
  */
 static void
-iomap_adjust_read_range(struct inode *inode, struct iomap_page *iop,
-		loff_t *pos, loff_t length, unsigned *offp, unsigned *lenp)
+iomap_adjust_read_range(struct inode *inode, struct page *page,
+		struct iomap_page *iop, loff_t *pos, loff_t length,
+		unsigned *offp, unsigned *lenp)
 {
 	loff_t orig_pos = *pos;
 	loff_t isize = i_size_read(inode);
 	unsigned block_bits = inode->i_blkbits;
 	unsigned block_size = (1 << block_bits);
-	unsigned poff = offset_in_page(*pos);
-	unsigned plen = min_t(loff_t, PAGE_SIZE - poff, length);
+	unsigned poff = offset_in_thp(page, *pos);
+	unsigned plen = min_t(loff_t, thp_size(page) - poff, length);
 	unsigned first = poff >> block_bits;
 	unsigned last = (poff + plen - 1) >> block_bits;
 
@@ -131,7 +136,7 @@ iomap_adjust_read_range(struct inode *inode, struct iomap_page *iop,
 	 * page cache for blocks that are entirely outside of i_size.
 	 */
 	if (orig_pos <= isize && orig_pos + length > isize) {
-		unsigned end = offset_in_page(isize - 1) >> block_bits;
+		unsigned end = offset_in_thp(page, isize - 1) >> block_bits;
 
 		if (first <= end && last > end)
 			plen -= (last - end) * block_size;
@@ -169,17 +174,31 @@ iomap_set_range_uptodate(struct page *page, unsigned off, unsigned len)
 		SetPageUptodate(page);
 }
 
+/*
+ * bio_for_each_segment_all() hands out single pages; return the head page
+ * and the offset into it for a segment of a large page.
+ */
+static struct page *
+iomap_bvec_head(struct bio_vec *bvec, unsigned *poff)
+{
+	struct page *page = thp_head(bvec->bv_page);
+
+	*poff = (bvec->bv_page - page) * PAGE_SIZE + bvec->bv_offset;
+	return page;
+}
+
 static void
 iomap_read_page_end_io(struct bio_vec *bvec, int error)
 {
-	struct page *page = bvec->bv_page;
+	unsigned poff;
+	struct page *page = iomap_bvec_head(bvec, &poff);
 	struct iomap_page *iop = to_iomap_page(page);
 
 	if (unlikely(error)) {
 		ClearPageUptodate(page);
 		SetPageError(page);
 	} else {
-		iomap_set_range_uptodate(page, bvec->bv_offset, bvec->bv_len);
+		iomap_set_range_uptodate(page, poff, bvec->bv_len);
 	}
 
 	if (!iop || atomic_sub_and_test(bvec->bv_len, &iop->read_bytes_pending))
@@ -213,6 +232,9 @@ static loff_t iomap_read_inline_data(const struct iomap_iter *iter,
 	size_t poff = offset_in_page(iomap->offset);
 	void *addr;
 
+	/* Inline data lives in small files which never get large pages */
+	if (WARN_ON_ONCE(PageHead(page)))
+		return -EIO;
 	if (PageUptodate(page))
 		return PAGE_SIZE - poff;
 
@@ -266,7 +288,8 @@ static loff_t iomap_readpage_iter(const struct iomap_iter *iter,
 
 	/* zero post-eof blocks as the page may be mapped */
 	iop = iomap_page_create(iter->inode, page);
-	iomap_adjust_read_range(iter->inode, iop, &pos, length, &poff, &plen);
+	iomap_adjust_read_range(iter->inode, page, iop, &pos, length, &poff,
+			&plen);
 	if (plen == 0)
 		goto done;
 
@@ -322,17 +345,20 @@ done:
 int
 iomap_readpage(struct page *page, const struct iomap_ops *ops)
 {
+	struct page *head = thp_head(page);
 	struct iomap_iter iter = {
-		.inode		= page->mapping->host,
-		.pos		= page_offset(page),
-		.len		= PAGE_SIZE,
+		.inode		= head->mapping->host,
+		.pos		= page_offset(head),
+		.len		= thp_size(head),
 	};
 	struct iomap_readpage_ctx ctx = {
-		.cur_page	= page,
+		.cur_page	= head,
 	};
 	int ret;
 
-	trace_iomap_readpage(page->mapping->host, 1);
+	/* The whole of a large page is read, not just the subpage asked for */
+	page = head;
+	trace_iomap_readpage(page->mapping->host, thp_nr_pages(page));
 
 	while ((ret = iomap_iter(&iter, ops)) > 0)
 		iter.processed = iomap_readpage_iter(&iter, &ctx, 0);
@@ -364,7 +390,8 @@ static loff_t iomap_readahead_iter(const struct iomap_iter *iter,
 	loff_t done, ret;
 
 	for (done = 0; done < length; done += ret) {
-		if (ctx->cur_page && offset_in_page(iter->pos + done) == 0) {
+		if (ctx->cur_page &&
+		    offset_in_thp(ctx->cur_page, iter->pos + done) == 0) {
 			if (!ctx->cur_page_in_bio)
 				unlock_page(ctx->cur_page);
 			put_page(ctx->cur_page);
@@ -440,7 +467,7 @@ iomap_is_partially_uptodate(struct page *page, unsigned long from,
 	unsigned i;
 
 	/* Limit range to one page */
-	len = min_t(unsigned, PAGE_SIZE - from, count);
+	len = min_t(unsigned, thp_size(page) - from, count);
 
 	/* First and last blocks in range within page */
 	first = from >> inode->i_blkbits;
@@ -461,7 +488,7 @@ int
 iomap_releasepage(struct page *page, gfp_t gfp_mask)
 {
 	trace_iomap_releasepage(page->mapping->host, page_offset(page),
-			PAGE_SIZE);
+			thp_size(page));
 
 	/*
 	 * mm accommodates an old ext3 case where clean pages might not have had
@@ -484,7 +511,7 @@ iomap_invalidatepage(struct page *page, unsigned int offset, unsigned int len)
 	 * If we're invalidating the entire page, clear the dirty state from it
 	 * and release it to avoid unnecessary buildup of the LRU.
 	 */
-	if (offset == 0 && len == PAGE_SIZE) {
+	if (offset == 0 && len == thp_size(page)) {
 		WARN_ON_ONCE(PageWriteback(page));
 		cancel_dirty_page(page);
 		iomap_page_release(page);
@@ -552,14 +579,14 @@ static int __iomap_write_begin(const struct iomap_iter *iter, loff_t pos,
 	loff_t block_size = i_blocksize(iter->inode);
 	loff_t block_start = round_down(pos, block_size);
 	loff_t block_end = round_up(pos + len, block_size);
-	unsigned from = offset_in_page(pos), to = from + len, poff, plen;
+	unsigned from = offset_in_thp(page, pos), to = from + len, poff, plen;
 
 	if (PageUptodate(page))
 		return 0;
 	ClearPageError(page);
 
 	do {
-		iomap_adjust_read_range(iter->inode, iop, &block_start,
+		iomap_adjust_read_range(iter->inode, page, iop, &block_start,
 				block_end - block_start, &poff, &plen);
 		if (plen == 0)
 			break;
@@ -599,11 +626,43 @@ static int iomap_write_begin_inline(const struct iomap_iter *iter,
 	return 0;
 }
 
+/*
+ * Trim @len so that a write at @pos stays within the page cache page that
+ * currently covers it, or within a single page if none is cached: writes do
+ * not allocate large pages.  The page is not locked, so iomap_write_begin()
+ * may still find a different one; it then trims the length further, but
+ * never extends it, so ->page_prepare() is not asked for less than is
+ * written.
+ */
+static unsigned int iomap_write_len(const struct iomap_iter *iter,
+		loff_t pos, u64 len)
+{
+	struct address_space *mapping = iter->inode->i_mapping;
+	u64 max = PAGE_SIZE - offset_in_page(pos);
+	struct page *page;
+
+	if (mapping_thp_support(mapping)) {
+		page = pagecache_get_page(mapping, pos >> PAGE_SHIFT,
+					  FGP_HEAD, 0);
+		if (page) {
+			max = page_offset(page) + thp_size(page) - pos;
+			put_page(page);
+		}
+	}
+	return min(len, max);
+}
+
+/*
+ * Returns the locked head page covering @pos in *@pagep.  @len should have
+ * been trimmed by iomap_write_len(); if the page found ends earlier, @len is
+ * trimmed to its end, and the caller must limit the write to the same range.
+ */
 static int iomap_write_begin(const struct iomap_iter *iter, loff_t pos,
 		unsigned len, struct page **pagep)
 {
 	const struct iomap_page_ops *page_ops = iter->iomap.page_ops;
 	const struct iomap *srcmap = iomap_iter_srcmap(iter);
+	int fgp = FGP_LOCK | FGP_WRITE | FGP_CREAT | FGP_NOFS | FGP_HEAD;
 	struct page *page;
 	int status = 0;
 
@@ -620,12 +679,15 @@ static int iomap_write_begin(const struct iomap_iter *iter, loff_t pos,
 			return status;
 	}
 
-	page = grab_cache_page_write_begin(iter->inode->i_mapping,
-				pos >> PAGE_SHIFT, AOP_FLAG_NOFS);
+	page = pagecache_get_page(iter->inode->i_mapping, pos >> PAGE_SHIFT,
+			fgp, mapping_gfp_mask(iter->inode->i_mapping));
 	if (!page) {
 		status = -ENOMEM;
 		goto out_no_page;
 	}
+	wait_for_stable_page(page);
+	if (pos + len > page_offset(page) + thp_size(page))
+		len = page_offset(page) + thp_size(page) - pos;
 
 	if (srcmap->type == IOMAP_INLINE)
 		status = iomap_write_begin_inline(iter, page);
@@ -654,7 +716,10 @@ out_no_page:
 static size_t __iomap_write_end(struct inode *inode, loff_t pos, size_t len,
 		size_t copied, struct page *page)
 {
-	flush_dcache_page(page);
+	int i;
+
+	for (i = 0; i < thp_nr_pages(page); i++)
+		flush_dcache_page(page + i);
 
 	/*
 	 * The blocks that were entirely written will now be uptodate, so we
@@ -669,7 +734,7 @@ static size_t __iomap_write_end(struct inode *inode, loff_t pos, size_t len,
 	 */
 	if (unlikely(copied < len && !PageUptodate(page)))
 		return 0;
-	iomap_set_range_uptodate(page, offset_in_page(pos), len);
+	iomap_set_range_uptodate(page, offset_in_thp(page, pos), len);
 	__set_page_dirty_nobuffers(page);
 	return copied;
 }
@@ -735,6 +800,7 @@ static size_t iomap_write_end(struct iomap_iter *iter, loff_t pos, size_t len,
 static loff_t iomap_write_iter(struct iomap_iter *iter, struct iov_iter *i)
 {
 	loff_t length = iomap_length(iter);
+	size_t chunk = mapping_max_page_size(iter->inode->i_mapping);
 	loff_t pos = iter->pos;
 	ssize_t written = 0;
 	long status = 0;
@@ -745,12 +811,17 @@ static loff_t iomap_write_iter(struct iomap_iter *iter, struct iov_iter *i)
 		unsigned long bytes;	/* Bytes to write to page */
 		size_t copied;		/* Bytes copied from user */
 
-		offset = offset_in_page(pos);
-		bytes = min_t(unsigned long, PAGE_SIZE - offset,
-						iov_iter_count(i));
+		/*
+		 * Ask for as much as the largest page this mapping can hold;
+		 * a smaller page from iomap_write_begin() trims it below.
+		 */
+		offset = pos & (chunk - 1);
+		bytes = min_t(unsigned long, chunk - offset,
+			      iov_iter_count(i));
 again:
 		if (bytes > length)
 			bytes = length;
+		bytes = iomap_write_len(iter, pos, bytes);
 
 		/*
 		 * Bring in the user page that we'll copy from _first_.
@@ -767,8 +838,16 @@ again:
 		if (unlikely(status))
 			break;
 
-		if (mapping_writably_mapped(iter->inode->i_mapping))
-			flush_dcache_page(page);
+		offset = offset_in_thp(page, pos);
+		if (bytes > thp_size(page) - offset)
+			bytes = thp_size(page) - offset;
+
+		if (mapping_writably_mapped(iter->inode->i_mapping)) {
+			int j;
+
+			for (j = 0; j < thp_nr_pages(page); j++)
+				flush_dcache_page(page + j);
+		}
 
 		copied = copy_page_from_iter_atomic(page, offset, bytes, i);
 
@@ -836,13 +915,16 @@ static loff_t iomap_unshare_iter(struct iomap_iter *iter)
 		return length;
 
 	do {
-		unsigned long offset = offset_in_page(pos);
-		unsigned long bytes = min_t(loff_t, PAGE_SIZE - offset, length);
+		unsigned long bytes = iomap_write_len(iter, pos, length);
+		unsigned long offset;
 		struct page *page;
 
 		status = iomap_write_begin(iter, pos, bytes, &page);
 		if (unlikely(status))
 			return status;
+		offset = offset_in_thp(page, pos);
+		if (bytes > thp_size(page) - offset)
+			bytes = thp_size(page) - offset;
 
 		status = iomap_write_end(iter, pos, bytes, bytes, page);
 		if (WARN_ON_ONCE(status == 0))
@@ -882,12 +964,15 @@ static s64 __iomap_zero_iter(struct iomap_iter *iter, loff_t pos, u64 length)
 {
 	struct page *page;
 	int status;
-	unsigned offset = offset_in_page(pos);
-	unsigned bytes = min_t(u64, PAGE_SIZE - offset, length);
+	unsigned offset;
+	unsigned bytes = iomap_write_len(iter, pos, length);
 
 	status = iomap_write_begin(iter, pos, bytes, &page);
 	if (status)
 		return status;
+	offset = offset_in_thp(page, pos);
+	if (bytes > thp_size(page) - offset)
+		bytes = thp_size(page) - offset;
 
 	zero_user(page, offset, bytes);
 	mark_page_accessed(page);
@@ -985,7 +1070,7 @@ vm_fault_t iomap_page_mkwrite(struct vm_fault *vmf, const struct iomap_ops *ops)
 		.inode		= file_inode(vmf->vma->vm_file),
 		.flags		= IOMAP_WRITE | IOMAP_FAULT,
 	};
-	struct page *page = vmf->page;
+	struct page *page = thp_head(vmf->page);
 	ssize_t ret;
 
 	lock_page(page);
@@ -1008,10 +1093,13 @@ out_unlock:
 EXPORT_SYMBOL_GPL(iomap_page_mkwrite);
 
 static void
-iomap_finish_page_writeback(struct inode *inode, struct page *page,
-		int error, unsigned int len)
+iomap_finish_page_writeback(struct inode *inode, struct bio_vec *bvec,
+		int error)
 {
+	unsigned poff;
+	struct page *page = iomap_bvec_head(bvec, &poff);
 	struct iomap_page *iop = to_iomap_page(page);
+	unsigned int len = bvec->bv_len;
 
 	if (error) {
 		SetPageError(page);
@@ -1055,8 +1143,7 @@ iomap_finish_ioend(struct iomap_ioend *ioend, int error)
 
 		/* walk each page on bio, ending page IO on them */
 		bio_for_each_segment_all(bv, bio, iter_all)
-			iomap_finish_page_writeback(inode, bv->bv_page, error,
-					bv->bv_len);
+			iomap_finish_page_writeback(inode, bv, error);
 		bio_put(bio);
 	}
 	/* The ioend has been freed by bio_put() */
@@ -1257,7 +1344,7 @@ iomap_add_to_ioend(struct inode *inode, loff_t offset, struct page *page,
 {
 	sector_t sector = iomap_sector(&wpc->iomap, offset);
 	unsigned len = i_blocksize(inode);
-	unsigned poff = offset & (PAGE_SIZE - 1);
+	unsigned poff = offset_in_thp(page, offset);
 
 	if (!wpc->ioend || !iomap_can_add_to_ioend(wpc, offset, sector)) {
 		if (wpc->ioend)
@@ -1312,7 +1399,7 @@ iomap_writepage_map(struct iomap_writepage_ctx *wpc,
 	 * one.
 	 */
 	for (i = 0, file_offset = page_offset(page);
-	     i < (PAGE_SIZE >> inode->i_blkbits) && file_offset < end_offset;
+	     i < i_blocks_per_page(inode, page) && file_offset < end_offset;
 	     i++, file_offset += len) {
 		if (iop && !test_bit(i, iop->uptodate))
 			continue;
@@ -1400,7 +1487,7 @@ iomap_do_writepage(struct page *page, struct writeback_control *wbc, void *data)
 	u64 end_offset;
 	loff_t offset;
 
-	trace_iomap_writepage(inode, page_offset(page), PAGE_SIZE);
+	trace_iomap_writepage(inode, page_offset(page), thp_size(page));
 
 	/*
 	 * Refuse to write the page out if we're called from reclaim context.
@@ -1431,8 +1518,8 @@ iomap_do_writepage(struct page *page, struct writeback_control *wbc, void *data)
 	 */
 	offset = i_size_read(inode);
 	end_index = offset >> PAGE_SHIFT;
-	if (page->index < end_index)
-		end_offset = (loff_t)(page->index + 1) << PAGE_SHIFT;
+	if (page->index + thp_nr_pages(page) - 1 < end_index)
+		end_offset = page_offset(page) + thp_size(page);
 	else {
 		/*
 		 * Check whether the page to write out is beyond or straddles
@@ -1445,7 +1532,7 @@ iomap_do_writepage(struct page *page, struct writeback_control *wbc, void *data)
 		 * |				    |      Straddles     |
 		 * ---------------------------------^-----------|--------|
 		 */
-		unsigned offset_into_page = offset & (PAGE_SIZE - 1);
+		unsigned offset_into_page = offset_in_thp(page, offset);
 
 		/*
 		 * Skip the page if it's fully outside i_size, e.g. due to a
@@ -1464,8 +1551,7 @@ iomap_do_writepage(struct page *page, struct writeback_control *wbc, void *data)
 		 * checking if the page is totally beyond i_size or if its
 		 * offset is just equal to the EOF.
 		 */
-		if (page->index > end_index ||
-		    (page->index == end_index && offset_into_page == 0))
+		if (page->index > end_index || offset_into_page == 0)
 			goto redirty;
 
 		/*
@@ -1476,7 +1562,7 @@ iomap_do_writepage(struct page *page, struct writeback_control *wbc, void *data)
 		 * memory is zeroed when mapped, and writes to that region are
 		 * not written out to the file."
 		 */
-		zero_user_segment(page, offset_into_page, PAGE_SIZE);
+		zero_user_segment(page, offset_into_page, thp_size(page));
 
 		/* Adjust the end_offset to the end of file */
 		end_offset = offset;
@@ -1316,10 +1316,12 @@ xfs_setup_iops(
 	case S_IFREG:
 		inode->i_op = &xfs_inode_operations;
 		inode->i_fop = &xfs_file_operations;
-		if (IS_DAX(inode))
+		if (IS_DAX(inode)) {
 			inode->i_mapping->a_ops = &xfs_dax_aops;
-		else
+		} else {
 			inode->i_mapping->a_ops = &xfs_address_space_operations;
+			mapping_set_thp_support(inode->i_mapping);
+		}
 		break;
 	case S_IFDIR:
 		if (xfs_has_asciici(XFS_M(inode->i_sb)))
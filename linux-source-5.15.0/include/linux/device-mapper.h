@@ -287,6 +287,13 @@ struct target_type {
 #define dm_target_supports_mixed_zoned_model(type) (false)
 #endif
 
+/*
+ * A target maps each bio to at most one clone and submits it from ->map,
+ * so polled bios can be polled through that clone.
+ */
+#define DM_TARGET_POLL			0x00000400
+#define dm_target_supports_poll(type) ((type)->features & DM_TARGET_POLL)
+
 struct dm_target {
 	struct dm_table *table;
 	struct target_type *type;
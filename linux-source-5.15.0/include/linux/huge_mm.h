@@ -222,6 +222,9 @@ void __split_huge_pud(struct vm_area_struct *vma, pud_t *pud,
 
 int hugepage_madvise(struct vm_area_struct *vma, unsigned long *vm_flags,
 		     int advice);
+int madvise_collapse(struct vm_area_struct *vma,
+		     struct vm_area_struct **prev,
+		     unsigned long start, unsigned long end);
 void vma_adjust_trans_huge(struct vm_area_struct *vma, unsigned long start,
 			   unsigned long end, long adjust_next);
 spinlock_t *__pmd_trans_huge_lock(pmd_t *pmd, struct vm_area_struct *vma);
@@ -262,12 +265,15 @@ static inline struct page *thp_head(struct page *page)
 /**
  * thp_order - Order of a transparent huge page.
  * @page: Head page of a transparent huge page.
+ *
+ * Page cache THPs are not necessarily PMD sized, so this reads the order
+ * from the compound page rather than assuming HPAGE_PMD_ORDER.
  */
 static inline unsigned int thp_order(struct page *page)
 {
 	VM_BUG_ON_PGFLAGS(PageTail(page), page);
 	if (PageHead(page))
-		return HPAGE_PMD_ORDER;
+		return page[1].compound_order;
 	return 0;
 }
 
@@ -279,10 +285,22 @@ static inline int thp_nr_pages(struct page *page)
 {
 	VM_BUG_ON_PGFLAGS(PageTail(page), page);
 	if (PageHead(page))
-		return HPAGE_PMD_NR;
+		return page[1].compound_nr;
 	return 1;
 }
 
+/**
+ * thp_pmd_mappable - Whether a huge page is large enough for a PMD mapping.
+ * @page: Head page of a transparent huge page.
+ *
+ * Only these are accounted as THPs in the page cache statistics; smaller
+ * large pages are still counted in NR_FILE_PAGES.
+ */
+static inline bool thp_pmd_mappable(struct page *page)
+{
+	return thp_order(page) >= HPAGE_PMD_ORDER;
+}
+
 struct page *follow_devmap_pmd(struct vm_area_struct *vma, unsigned long addr,
 		pmd_t *pmd, int flags, struct dev_pagemap **pgmap);
 struct page *follow_devmap_pud(struct vm_area_struct *vma, unsigned long addr,
@@ -354,6 +372,11 @@ static inline int thp_nr_pages(struct page *page)
 	return 1;
 }
 
+static inline bool thp_pmd_mappable(struct page *page)
+{
+	return false;
+}
+
 static inline bool __transparent_hugepage_enabled(struct vm_area_struct *vma)
 {
 	return false;
@@ -420,6 +443,13 @@ static inline int hugepage_madvise(struct vm_area_struct *vma,
 	BUG();
 	return 0;
 }
+
+static inline int madvise_collapse(struct vm_area_struct *vma,
+				   struct vm_area_struct **prev,
+				   unsigned long start, unsigned long end)
+{
+	return -EINVAL;
+}
 static inline void vma_adjust_trans_huge(struct vm_area_struct *vma,
 					 unsigned long start,
 					 unsigned long end,
@@ -255,6 +255,9 @@ struct mem_cgroup {
 	/* Range enforcement for interrupt charges */
 	struct work_struct high_work;
 
+	/* Pages charged at once to refill the per-cpu stocks */
+	unsigned int charge_batch;
+
 	unsigned long soft_limit;
 
 	/* vmpressure notifications */
@@ -361,6 +364,8 @@ struct mem_cgroup {
  * TODO: maybe necessary to use big numbers in big irons.
  */
 #define MEMCG_CHARGE_BATCH 32U
+/* Upper bound for a memcg's charge batch, which adapts to its usage */
+#define MEMCG_CHARGE_BATCH_MAX (8 * MEMCG_CHARGE_BATCH)
 
 extern struct mem_cgroup *root_mem_cgroup;
 
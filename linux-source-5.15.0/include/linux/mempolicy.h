@@ -185,6 +185,7 @@ extern int mpol_misplaced(struct page *, struct vm_area_struct *, unsigned long)
 extern void mpol_put_task_policy(struct task_struct *);
 
 extern bool numa_demotion_enabled;
+extern bool numa_promotion_enabled;
 
 static inline bool mpol_is_preferred_many(struct mempolicy *pol)
 {
@@ -302,6 +303,7 @@ static inline nodemask_t *policy_nodemask_current(gfp_t gfp)
 }
 
 #define numa_demotion_enabled	false
+#define numa_promotion_enabled	false
 
 static inline bool mpol_is_preferred_many(struct mempolicy *pol)
 {
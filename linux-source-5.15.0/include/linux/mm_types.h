@@ -387,6 +387,19 @@ struct vm_area_struct {
 	struct mempolicy *vm_policy;	/* NUMA policy for the VMA */
 #endif
 	struct vm_userfaultfd_ctx vm_userfaultfd_ctx;
+#ifdef CONFIG_PER_VMA_LOCK
+	/*
+	 * Page faults may take vm_lock for read instead of mmap_lock, see
+	 * lock_vma_under_rcu(). Writers hold mmap_lock for write and mark
+	 * the VMA with the current mm_lock_seq, which stays in place until
+	 * mmap_write_unlock().
+	 */
+	int vm_lock_seq;
+	struct rw_semaphore vm_lock;
+	/* Set once the VMA is no longer linked into mm->mm_rb */
+	bool detached;
+	struct rcu_head vm_rcu;
+#endif
 } __randomize_layout;
 
 struct core_thread {
@@ -473,6 +486,13 @@ struct mm_struct {
 		 * cacheline.
 		 */
 		struct rw_semaphore mmap_lock;
+#ifdef CONFIG_PER_VMA_LOCK
+		/*
+		 * Bumped on every mmap_write_unlock(), which releases all
+		 * VMAs write-locked while mmap_lock was held.
+		 */
+		int mm_lock_seq;
+#endif
 
 		struct list_head mmlist; /* List of maybe swapped mm's.	These
 					  * are globally strung together off
@@ -581,6 +601,10 @@ struct mm_struct {
 
 #ifdef CONFIG_IOMMU_SUPPORT
 		u32 pasid;
+#endif
+#ifdef CONFIG_LRU_GEN
+		/* Entry on the list of mm_structs walked by the multi-gen LRU */
+		struct list_head lru_gen_list;
 #endif
 	} __randomize_layout;
 
@@ -593,6 +617,28 @@ struct mm_struct {
 
 extern struct mm_struct init_mm;
 
+#ifdef CONFIG_LRU_GEN
+void lru_gen_add_mm(struct mm_struct *mm);
+void lru_gen_del_mm(struct mm_struct *mm);
+
+static inline void lru_gen_init_mm(struct mm_struct *mm)
+{
+	INIT_LIST_HEAD(&mm->lru_gen_list);
+}
+#else
+static inline void lru_gen_add_mm(struct mm_struct *mm)
+{
+}
+
+static inline void lru_gen_del_mm(struct mm_struct *mm)
+{
+}
+
+static inline void lru_gen_init_mm(struct mm_struct *mm)
+{
+}
+#endif
+
 /* Pointer magic because the dynamic array size confuses some compilers. */
 static inline void mm_init_cpumask(struct mm_struct *mm)
 {
@@ -60,9 +60,31 @@ static inline void __mmap_lock_trace_released(struct mm_struct *mm, bool write)
 
 #endif /* CONFIG_TRACING */
 
+#ifdef CONFIG_PER_VMA_LOCK
+static inline void mm_lock_seqcount_init(struct mm_struct *mm)
+{
+	mm->mm_lock_seq = 0;
+}
+
+/*
+ * Drop all per-VMA write locks taken while mmap_lock was held for write.
+ * Must be called right before mmap_lock is released or downgraded.
+ */
+static inline void vma_end_write_all(struct mm_struct *mm)
+{
+	lockdep_assert_held_write(&mm->mmap_lock);
+	/* No races during update due to exclusive mmap_lock being held */
+	WRITE_ONCE(mm->mm_lock_seq, mm->mm_lock_seq + 1);
+}
+#else
+static inline void mm_lock_seqcount_init(struct mm_struct *mm) {}
+static inline void vma_end_write_all(struct mm_struct *mm) {}
+#endif
+
 static inline void mmap_init_lock(struct mm_struct *mm)
 {
 	init_rwsem(&mm->mmap_lock);
+	mm_lock_seqcount_init(mm);
 }
 
 static inline void mmap_write_lock(struct mm_struct *mm)
@@ -102,12 +124,14 @@ static inline bool mmap_write_trylock(struct mm_struct *mm)
 static inline void mmap_write_unlock(struct mm_struct *mm)
 {
 	__mmap_lock_trace_released(mm, true);
+	vma_end_write_all(mm);
 	up_write(&mm->mmap_lock);
 }
 
 static inline void mmap_write_downgrade(struct mm_struct *mm)
 {
 	__mmap_lock_trace_acquire_returned(mm, false, true);
+	vma_end_write_all(mm);
 	downgrade_write(&mm->mmap_lock);
 }
 
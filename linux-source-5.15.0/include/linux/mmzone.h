@@ -209,6 +209,10 @@ enum node_stat_item {
 	NR_PAGETABLE,		/* used for pagetables */
 #ifdef CONFIG_SWAP
 	NR_SWAPCACHE,
+#endif
+#ifdef CONFIG_NUMA_BALANCING
+	PGPROMOTE_SUCCESS,	/* promoted to a faster node */
+	PGPROMOTE_CANDIDATE,	/* hot pages considered for promotion */
 #endif
 	NR_VM_NODE_STAT_ITEMS
 };
@@ -292,8 +296,64 @@ enum lruvec_flags {
 	LRUVEC_CONGESTED,		/* lruvec has many dirty pages
 					 * backed by a congested BDI
 					 */
+	LRUVEC_AGING,			/* the multi-gen LRU of this lruvec
+					 * is being aged
+					 */
 };
 
+#ifdef CONFIG_LRU_GEN
+
+/*
+ * The multi-gen LRU sorts the evictable pages of an lruvec into generations.
+ * The youngest generation number is stored in max_seq for both anon and file
+ * types, as they are aged on an equal footing. The oldest generation numbers
+ * are stored in min_seq[] separately for anon and file, since their eviction
+ * may be unbalanced, e.g. without swap. A page stores the index of its
+ * generation, lru_gen_from_seq(seq) + 1, in page->flags while it is on one of
+ * the lists below, and zero otherwise.
+ *
+ * At least MIN_NR_GENS generations are kept, and the two youngest of them
+ * are reported as active to the rest of mm; PG_active is cleared while a
+ * page is on a generation list and restored when it is isolated. At most
+ * MAX_NR_GENS generations exist at a time.
+ */
+#define MIN_NR_GENS		2U
+#define MAX_NR_GENS		4U
+
+enum {
+	LRU_GEN_ANON,
+	LRU_GEN_FILE,
+};
+
+struct lru_gen_struct {
+	/* the aging increments the youngest generation number */
+	unsigned long max_seq;
+	/* the eviction increments the oldest generation numbers */
+	unsigned long min_seq[ANON_AND_FILE];
+	/* the birth time of each generation in jiffies */
+	unsigned long timestamps[MAX_NR_GENS];
+	/* the multi-gen LRU lists */
+	struct list_head lists[MAX_NR_GENS][ANON_AND_FILE][MAX_NR_ZONES];
+	/* the sizes of the above lists, transiently off while being aged */
+	long nr_pages[MAX_NR_GENS][ANON_AND_FILE][MAX_NR_ZONES];
+	/* pages evicted from each generation, reported through debugfs */
+	unsigned long evicted[MAX_NR_GENS][ANON_AND_FILE];
+	/* pages found accessed and moved out of each generation */
+	unsigned long promoted[MAX_NR_GENS][ANON_AND_FILE];
+	/* whether the multi-gen LRU lists above hold the evictable pages */
+	bool enabled;
+};
+
+void lru_gen_init_lruvec(struct lruvec *lruvec);
+
+#else /* !CONFIG_LRU_GEN */
+
+static inline void lru_gen_init_lruvec(struct lruvec *lruvec)
+{
+}
+
+#endif /* CONFIG_LRU_GEN */
+
 struct lruvec {
 	struct list_head		lists[NR_LRU_LISTS];
 	/* per lruvec lru_lock for memcg */
@@ -311,6 +371,10 @@ struct lruvec {
 	unsigned long			refaults[ANON_AND_FILE];
 	/* Various lruvec state flags (enum lruvec_flags) */
 	unsigned long			flags;
+#ifdef CONFIG_LRU_GEN
+	/* evictable pages divided into generations */
+	struct lru_gen_struct		lrugen;
+#endif
 #ifdef CONFIG_MEMCG
 	struct pglist_data *pgdat;
 #endif
@@ -362,6 +426,7 @@ struct per_cpu_pages {
 	int high;		/* high watermark, emptying needed */
 	int batch;		/* chunk size for buddy add/remove */
 	short free_factor;	/* batch scaling factor during free */
+	short alloc_factor;	/* batch scaling factor during allocate */
 #ifdef CONFIG_NUMA
 	short expire;		/* When 0, remote pagesets are drained */
 #endif
@@ -869,6 +934,13 @@ typedef struct pglist_data {
 	unsigned long		min_slab_pages;
 #endif /* CONFIG_NUMA */
 
+#ifdef CONFIG_NUMA_BALANCING
+	/* Start of the current promotion rate limit period, in ms */
+	unsigned int		nbp_rl_start;
+	/* PGPROMOTE_CANDIDATE at the start of the period */
+	unsigned long		nbp_rl_nr_cand;
+#endif
+
 	/* Write-intensive fields used by page reclaim */
 	ZONE_PADDING(_pad1_)
 
@@ -17,6 +17,7 @@
 
 #include <linux/device.h>
 #include <linux/cpumask.h>
+#include <linux/nodemask.h>
 #include <linux/list.h>
 #include <linux/workqueue.h>
 
@@ -181,4 +182,13 @@ static inline void register_hugetlbfs_with_node(node_registration_func_t reg,
 
 #define to_node(device) container_of(device, struct node, dev)
 
+/*
+ * Nodes with CPUs are the fast memory tier: they are where demotion starts
+ * and where hot pages on the slower, memory-only nodes are promoted to.
+ */
+static inline bool node_is_toptier(int node)
+{
+	return node_state(node, N_CPU);
+}
+
 #endif /* _LINUX_NODE_H_ */
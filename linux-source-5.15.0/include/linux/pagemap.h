@@ -126,6 +126,22 @@ static inline void mapping_set_gfp_mask(struct address_space *m, gfp_t mask)
 	m->gfp_mask = mask;
 }
 
+/**
+ * mapping_set_thp_support() - Indicate the file supports large pages.
+ * @mapping: The file.
+ *
+ * The filesystem should call this function in its inode constructor to
+ * indicate that its ->readahead, ->readpage, ->writepage and related
+ * operations handle compound pages larger than PAGE_SIZE.  Readahead will
+ * then allocate large pages for this file.
+ *
+ * This should not be called while the inode is active as it is non-atomic.
+ */
+static inline void mapping_set_thp_support(struct address_space *mapping)
+{
+	__set_bit(AS_THP_SUPPORT, &mapping->flags);
+}
+
 static inline bool mapping_thp_support(struct address_space *mapping)
 {
 	return test_bit(AS_THP_SUPPORT, &mapping->flags);
@@ -146,7 +162,7 @@ static inline void filemap_nr_thps_inc(struct address_space *mapping)
 	if (!mapping_thp_support(mapping))
 		atomic_inc(&mapping->nr_thps);
 #else
-	WARN_ON_ONCE(1);
+	WARN_ON_ONCE(!mapping_thp_support(mapping));
 #endif
 }
 
@@ -156,7 +172,7 @@ static inline void filemap_nr_thps_dec(struct address_space *mapping)
 	if (!mapping_thp_support(mapping))
 		atomic_dec(&mapping->nr_thps);
 #else
-	WARN_ON_ONCE(1);
+	WARN_ON_ONCE(!mapping_thp_support(mapping));
 #endif
 }
 
@@ -296,15 +312,52 @@ static inline void *detach_page_private(struct page *page)
 	return data;
 }
 
+/*
+ * Large page cache pages are allocated by readahead and are set up like
+ * THPs, so they are only available with CONFIG_TRANSPARENT_HUGEPAGE.
+ */
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+#define MAX_PAGECACHE_ORDER	HPAGE_PMD_ORDER
+#else
+#define MAX_PAGECACHE_ORDER	0
+#endif
+
+/**
+ * mapping_max_page_size() - Largest page cache page this mapping may hold.
+ * @mapping: The address space.
+ *
+ * Return: The size in bytes of the largest page the page cache may hold
+ * for @mapping.
+ */
+static inline size_t mapping_max_page_size(struct address_space *mapping)
+{
+	if (!mapping_thp_support(mapping))
+		return PAGE_SIZE;
+	return PAGE_SIZE << MAX_PAGECACHE_ORDER;
+}
+
 #ifdef CONFIG_NUMA
-extern struct page *__page_cache_alloc(gfp_t gfp);
+extern struct page *__page_cache_alloc_order(gfp_t gfp, unsigned int order);
 #else
-static inline struct page *__page_cache_alloc(gfp_t gfp)
+static inline struct page *__page_cache_alloc_order(gfp_t gfp,
+		unsigned int order)
 {
-	return alloc_pages(gfp, 0);
+	struct page *page;
+
+	if (!order)
+		return alloc_pages(gfp, 0);
+	page = alloc_pages(gfp | __GFP_COMP, order);
+	if (page)
+		prep_transhuge_page(page);
+	return page;
 }
 #endif
 
+static inline struct page *__page_cache_alloc(gfp_t gfp)
+{
+	return __page_cache_alloc_order(gfp, 0);
+}
+
 static inline struct page *page_cache_alloc(struct address_space *x)
 {
 	return __page_cache_alloc(mapping_gfp_mask(x));
@@ -602,8 +655,7 @@ static inline bool wake_page_match(struct wait_page_queue *wait_page,
 extern void __lock_page(struct page *page);
 extern int __lock_page_killable(struct page *page);
 extern int __lock_page_async(struct page *page, struct wait_page_queue *wait);
-extern int __lock_page_or_retry(struct page *page, struct mm_struct *mm,
-				unsigned int flags);
+extern int __lock_page_or_retry(struct page *page, struct vm_fault *vmf);
 extern void unlock_page(struct page *page);
 
 /*
@@ -661,11 +713,10 @@ static inline int lock_page_async(struct page *page,
  * Return value and mmap_lock implications depend on flags; see
  * __lock_page_or_retry().
  */
-static inline int lock_page_or_retry(struct page *page, struct mm_struct *mm,
-				     unsigned int flags)
+static inline int lock_page_or_retry(struct page *page, struct vm_fault *vmf)
 {
 	might_sleep();
-	return trylock_page(page) || __lock_page_or_retry(page, mm, flags);
+	return trylock_page(page) || __lock_page_or_retry(page, vmf);
 }
 
 /*
@@ -991,7 +1042,7 @@ static inline unsigned long dir_pages(struct inode *inode)
 
 /**
  * page_mkwrite_check_truncate - check if page was truncated
- * @page: the page to check
+ * @page: the page to check, the head page if it is a large page
  * @inode: the inode to check the page against
  *
  * Returns the number of bytes in the page up to EOF,
@@ -1002,14 +1053,16 @@ static inline int page_mkwrite_check_truncate(struct page *page,
 {
 	loff_t size = i_size_read(inode);
 	pgoff_t index = size >> PAGE_SHIFT;
-	int offset = offset_in_page(size);
+	int offset;
 
 	if (page->mapping != inode->i_mapping)
 		return -EFAULT;
 
+	offset = offset_in_thp(page, size);
+
 	/* page is wholly inside EOF */
-	if (page->index < index)
-		return PAGE_SIZE;
+	if (page->index + thp_nr_pages(page) - 1 < index)
+		return thp_size(page);
 	/* page is wholly past EOF */
 	if (page->index > index || !offset)
 		return -EFAULT;
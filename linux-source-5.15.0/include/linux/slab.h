@@ -93,6 +93,13 @@
 /* Avoid kmemleak tracing */
 #define SLAB_NOLEAKTRACE	((slab_flags_t __force)0x00800000U)
 
+/* Keep a per-cpu array of free objects in front of the slabs (SLUB only) */
+#ifdef CONFIG_SLUB
+# define SLAB_SHEAVES		((slab_flags_t __force)0x01000000U)
+#else
+# define SLAB_SHEAVES		0
+#endif
+
 /* Fault injection mark */
 #ifdef CONFIG_FAILSLAB
 # define SLAB_FAILSLAB		((slab_flags_t __force)0x02000000U)
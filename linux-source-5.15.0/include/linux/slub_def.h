@@ -39,6 +39,11 @@ enum stat_item {
 	CPU_PARTIAL_FREE,	/* Refill cpu partial on free */
 	CPU_PARTIAL_NODE,	/* Refill cpu partial from node partial */
 	CPU_PARTIAL_DRAIN,	/* Drain cpu partial to node partial */
+	SHEAF_ALLOC_HIT,	/* Allocation from cpu sheaf */
+	SHEAF_ALLOC_MISS,	/* Cpu sheaf empty on allocation, refilled */
+	SHEAF_FREE_HIT,		/* Free to cpu sheaf */
+	SHEAF_FREE_MISS,	/* Cpu sheaf full on free, half flushed */
+	SHEAF_FLUSH,		/* Cpu sheaf flushed to the slabs */
 	NR_SLUB_STAT_ITEMS };
 
 /*
@@ -58,6 +63,17 @@ struct kmem_cache_cpu {
 #endif
 };
 
+/*
+ * Per cpu array of objects kept in front of the slabs of a SLAB_SHEAVES
+ * cache. The objects are free for the users of the cache but still
+ * allocated as far as their slabs are concerned.
+ */
+struct slub_percpu_sheaf {
+	local_lock_t lock;	/* Protects the fields below */
+	unsigned int size;	/* Number of objects in the sheaf */
+	void *objects[];
+};
+
 #ifdef CONFIG_SLUB_CPU_PARTIAL
 #define slub_percpu_partial(c)		((c)->partial)
 
@@ -100,6 +116,8 @@ struct kmem_cache {
 	/* Number of per cpu partial objects to keep around */
 	unsigned int cpu_partial;
 #endif
+	struct slub_percpu_sheaf __percpu *cpu_sheaves;
+	unsigned int sheaf_capacity;	/* Objects per sheaf, 0 if none */
 	struct kmem_cache_order_objects oo;
 
 	/* Allocation and freeing of slabs */
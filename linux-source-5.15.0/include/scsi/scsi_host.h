@@ -280,7 +280,7 @@ struct scsi_host_template {
 	int (* map_queues)(struct Scsi_Host *shost);
 
 	/*
-	 * SCSI interface of blk_poll - poll for IO completions.
+	 * SCSI interface of blk_mq_poll - poll for IO completions.
 	 * Only applicable if SCSI LLD exposes multiple h/w queues.
 	 *
 	 * Return value: Number of completed entries found.
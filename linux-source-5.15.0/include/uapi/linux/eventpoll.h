@@ -18,6 +18,7 @@
 /* For O_CLOEXEC */
 #include <linux/fcntl.h>
 #include <linux/types.h>
+#include <linux/ioctl.h>
 
 /* Flags for epoll_create1.  */
 #define EPOLL_CLOEXEC O_CLOEXEC
@@ -85,6 +86,38 @@ struct epoll_event {
 	__u64 data;
 } EPOLL_PACKED;
 
+/*
+ * Shared event ring, set up with EPIOCSRING and mapped with mmap(2) on the
+ * epoll file descriptor. Edge triggered items (EPOLLET without EPOLLONESHOT
+ * or EPOLLWAKEUP) are appended to the ring by the kernel as they become
+ * ready, and userspace consumes them by advancing the head index without
+ * entering the kernel. If the ring is full, events are delivered through
+ * epoll_wait() as usual. epoll_wait() returns 0 when woken up by ring
+ * events only, so the ring must be checked whenever it returns.
+ *
+ * When the waking file does not report an event mask, the full set of
+ * requested events is reported.
+ */
+struct epoll_ring_event {
+	__u64 data;
+	__poll_t events;
+	__u32 resv;
+};
+
+struct epoll_ring_params {
+	__u32 entries;		/* in: number of ring entries */
+	__u32 flags;		/* in: must be zero */
+	__u32 head;		/* out: offsets into the mapping */
+	__u32 tail;
+	__u32 ring_mask;
+	__u32 ring_entries;
+	__u32 events;
+	__u32 size;		/* out: size of the mapping in bytes */
+};
+
+#define EPOLL_IOC_TYPE		0x8A
+#define EPIOCSRING		_IOWR(EPOLL_IOC_TYPE, 0x01, struct epoll_ring_params)
+
 #ifdef CONFIG_PM_SLEEP
 static inline void ep_take_care_of_epollwakeup(struct epoll_event *epev)
 {
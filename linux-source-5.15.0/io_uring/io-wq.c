@@ -14,6 +14,7 @@
 #include <linux/rculist_nulls.h>
 #include <linux/cpu.h>
 #include <linux/tracehook.h>
+#include <linux/seq_file.h>
 #include <uapi/linux/io_uring.h>
 
 #include "io-wq.h"
@@ -78,6 +79,11 @@ struct io_wqe_acct {
 	atomic_t nr_running;
 	struct io_wq_work_list work_list;
 	unsigned long flags;
+
+	/* stats, under wqe->lock */
+	unsigned nr_pending;
+	unsigned long nr_dequeued;
+	u64 wait_usec;
 };
 
 enum {
@@ -448,6 +454,24 @@ static inline unsigned int io_get_work_hash(struct io_wq_work *work)
 	return work->flags >> IO_WQ_HASH_SHIFT;
 }
 
+/*
+ * Coarse (~1us) timestamp of when work was queued. 32 bits are plenty for the
+ * delta, wrapping only after more than an hour sitting on the list.
+ */
+static inline u32 io_wq_clock(void)
+{
+	return (u32)(ktime_get_ns() >> 10);
+}
+
+static void io_acct_account_dequeue(struct io_wqe_acct *acct,
+				    struct io_wq_work *work)
+	__must_hold(wqe->lock)
+{
+	acct->nr_pending--;
+	acct->nr_dequeued++;
+	acct->wait_usec += (u32)(io_wq_clock() - work->enqueue_time);
+}
+
 static bool io_wait_on_hash(struct io_wqe *wqe, unsigned int hash)
 {
 	struct io_wq *wq = wqe->wq;
@@ -483,6 +507,7 @@ static struct io_wq_work *io_get_next_work(struct io_wqe_acct *acct,
 		/* not hashed, can run anytime */
 		if (!io_wq_is_hashed(work)) {
 			wq_list_del(&acct->work_list, node, prev);
+			io_acct_account_dequeue(acct, work);
 			return work;
 		}
 
@@ -492,8 +517,15 @@ static struct io_wq_work *io_get_next_work(struct io_wqe_acct *acct,
 
 		/* hashed, can run if not already running */
 		if (!test_and_set_bit(hash, &wqe->wq->hash->map)) {
+			struct io_wq_work *pos = work;
+
 			wqe->hash_tail[hash] = NULL;
 			wq_list_cut(&acct->work_list, &tail->list, prev);
+			/* the whole chain leaves the list for this worker */
+			while (pos) {
+				io_acct_account_dequeue(acct, pos);
+				pos = wq_next_work(pos);
+			}
 			return work;
 		}
 		if (stall_hash == -1U)
@@ -895,6 +927,9 @@ static void io_wqe_insert_work(struct io_wqe *wqe, struct io_wq_work *work)
 	unsigned int hash;
 	struct io_wq_work *tail;
 
+	acct->nr_pending++;
+	work->enqueue_time = io_wq_clock();
+
 	if (!io_wq_is_hashed(work)) {
 append:
 		wq_list_add_tail(&work->list, &acct->work_list);
@@ -1020,6 +1055,7 @@ static inline void io_wqe_remove_pending(struct io_wqe *wqe,
 			wqe->hash_tail[hash] = NULL;
 	}
 	wq_list_del(&acct->work_list, &work->list, prev);
+	acct->nr_pending--;
 }
 
 static bool io_acct_cancel_pending_work(struct io_wqe *wqe,
@@ -1404,6 +1440,40 @@ int io_wq_max_workers(struct io_wq *wq, int *new_count)
 	return 0;
 }
 
+/*
+ * Dump per-node worker pool state: workers alive vs the cap, how much work is
+ * queued, and the average time work spent queued before a worker picked it
+ * up. Meant for sizing IORING_REGISTER_IOWQ_MAX_WORKERS.
+ */
+void io_wq_show_fdinfo(struct io_wq *wq, struct seq_file *m)
+{
+	static const char * const acct_name[IO_WQ_ACCT_NR] = {
+		[IO_WQ_ACCT_BOUND]	= "bound",
+		[IO_WQ_ACCT_UNBOUND]	= "unbound",
+	};
+	int node, i;
+
+	for_each_node(node) {
+		struct io_wqe *wqe = wq->wqes[node];
+
+		raw_spin_lock(&wqe->lock);
+		for (i = 0; i < IO_WQ_ACCT_NR; i++) {
+			struct io_wqe_acct *acct = &wqe->acct[i];
+			u64 avg = 0;
+
+			if (acct->nr_dequeued)
+				avg = div64_ul(acct->wait_usec,
+					       acct->nr_dequeued);
+			seq_printf(m, "  node%d %s: workers=%u/%u running=%d pending=%u dequeued=%lu avg_wait_usec=%llu\n",
+				   node, acct_name[i], acct->nr_workers,
+				   acct->max_workers,
+				   atomic_read(&acct->nr_running),
+				   acct->nr_pending, acct->nr_dequeued, avg);
+		}
+		raw_spin_unlock(&wqe->lock);
+	}
+}
+
 static __init int io_wq_init(void)
 {
 	int ret;
@@ -58,9 +58,11 @@
 #include <linux/percpu.h>
 #include <linux/cpuset.h>
 #include <linux/slab.h>
+#include <linux/vmalloc.h>
 #include <linux/blkdev.h>
 #include <linux/bvec.h>
 #include <linux/net.h>
+#include <linux/in.h>
 #include <net/sock.h>
 #include <net/af_unix.h>
 #include <linux/anon_inodes.h>
@@ -107,7 +109,8 @@
 				IOSQE_IO_HARDLINK | IOSQE_ASYNC | \
 				IOSQE_BUFFER_SELECT)
 #define IO_REQ_CLEAN_FLAGS (REQ_F_BUFFER_SELECTED | REQ_F_NEED_CLEANUP | \
-				REQ_F_POLLED | REQ_F_INFLIGHT | REQ_F_CREDS)
+				REQ_F_POLLED | REQ_F_INFLIGHT | REQ_F_CREDS | \
+				REQ_F_BUFFER_RING)
 
 #define IO_TCTX_REFS_CACHE_NR	(1U << 10)
 
@@ -194,11 +197,6 @@ struct io_rings {
 	struct io_uring_cqe	cqes[] ____cacheline_aligned_in_smp;
 };
 
-enum io_uring_cmd_flags {
-	IO_URING_F_NONBLOCK		= 1,
-	IO_URING_F_COMPLETE_DEFER	= 2,
-};
-
 struct io_mapped_ubuf {
 	u64		ubuf;
 	u64		ubuf_end;
@@ -210,8 +208,9 @@ struct io_mapped_ubuf {
 struct io_ring_ctx;
 
 struct io_overflow_cqe {
-	struct io_uring_cqe cqe;
 	struct list_head list;
+	/* must be last, followed by the extra 16 bytes for CQE32 rings */
+	struct io_uring_cqe cqe;
 };
 
 struct io_fixed_file {
@@ -231,6 +230,9 @@ struct io_rsrc_put {
 
 struct io_file_table {
 	struct io_fixed_file *files;
+	/* occupied slots, for IORING_FILE_INDEX_ALLOC */
+	unsigned long *bitmap;
+	unsigned int alloc_hint;
 };
 
 struct io_rsrc_node {
@@ -262,6 +264,21 @@ struct io_buffer {
 	__u16 bid;
 };
 
+/*
+ * A provided buffer group backed by a ring shared with the application.
+ * The application fills in entries and bumps the tail, the kernel consumes
+ * from ->head. No locking is shared with userspace, ->head itself is
+ * protected by ->uring_lock.
+ */
+struct io_buffer_list {
+	struct io_uring_buf_ring	*buf_ring;
+	struct page			**buf_pages;
+	unsigned int			buf_nr_pages;
+	__u16				bgid;
+	__u16				head;
+	__u16				mask;
+};
+
 struct io_restriction {
 	DECLARE_BITMAP(register_op, IORING_REGISTER_LAST);
 	DECLARE_BITMAP(sqe_op, IORING_OP_LAST);
@@ -378,11 +395,20 @@ struct io_ring_ctx {
 		struct list_head	ltimeout_list;
 		struct list_head	cq_overflow_list;
 		struct xarray		io_buffers;
+		struct xarray		io_buf_rings;
 		struct xarray		personalities;
 		u32			pers_next;
 		unsigned		sq_thread_idle;
 	} ____cacheline_aligned_in_smp;
 
+	/*
+	 * IORING_SETUP_DEFER_TASKRUN task_work, only run by ->submitter_task
+	 * when it waits for completions.
+	 */
+	struct llist_head	work_llist;
+	/* the only task allowed to submit with IORING_SETUP_SINGLE_ISSUER */
+	struct task_struct	*submitter_task;
+
 	/* IRQ completion list, under ->completion_lock */
 	struct list_head	locked_free_list;
 	unsigned int		locked_free_nr;
@@ -502,6 +528,26 @@ struct io_close {
 	u32				file_slot;
 };
 
+struct io_socket {
+	struct file			*file;
+	int				domain;
+	int				type;
+	int				protocol;
+	int				flags;
+	u32				file_slot;
+	unsigned long			nofile;
+};
+
+struct io_msg {
+	struct file			*file;
+	u64				user_data;
+	u32				len;
+	u32				cmd;
+	u32				src_fd;
+	u32				dst_fd;
+	u32				flags;
+};
+
 struct io_timeout_data {
 	struct io_kiocb			*req;
 	struct hrtimer			timer;
@@ -577,8 +623,34 @@ struct io_sr_msg {
 	int				bgid;
 	size_t				len;
 	size_t				done_io;
-	struct io_buffer		*kbuf;
+	union {
+		struct io_buffer	*kbuf;
+		/* valid IFF REQ_F_BUFFER_RING is set */
+		void __user		*ring_buf;
+	};
 	void __user			*msg_control;
+	/* requested length, restored for every multishot iteration */
+	u32				mshot_len;
+};
+
+struct io_sendzc {
+	struct file			*file;
+	void __user			*buf;
+	size_t				len;
+	size_t				done_io;
+	unsigned			msg_flags;
+	unsigned			flags;
+	struct io_kiocb			*notif;
+};
+
+/*
+ * A zerocopy send notification. It's a separate request that lives until the
+ * network stack drops its last reference to the pages it was handed, at which
+ * point a CQE with IORING_CQE_F_NOTIF is posted.
+ */
+struct io_notif {
+	struct file			*file;
+	struct ubuf_info		uarg;
 };
 
 struct io_open {
@@ -693,6 +765,9 @@ struct io_hardlink {
 struct io_completion {
 	struct file			*file;
 	u32				cflags;
+	/* big CQE payload, valid IFF REQ_F_CQE32_INIT is set */
+	u64				extra1;
+	u64				extra2;
 };
 
 struct io_async_connect {
@@ -740,6 +815,9 @@ enum {
 	REQ_F_REFCOUNT_BIT,
 	REQ_F_ARM_LTIMEOUT_BIT,
 	REQ_F_PARTIAL_IO_BIT,
+	REQ_F_BUFFER_RING_BIT,
+	REQ_F_APOLL_MULTISHOT_BIT,
+	REQ_F_CQE32_INIT_BIT,
 	/* keep async read/write and isreg together and in order */
 	REQ_F_NOWAIT_READ_BIT,
 	REQ_F_NOWAIT_WRITE_BIT,
@@ -797,6 +875,12 @@ enum {
 	REQ_F_ARM_LTIMEOUT	= BIT(REQ_F_ARM_LTIMEOUT_BIT),
 	/* request has already done partial IO */
 	REQ_F_PARTIAL_IO	= BIT(REQ_F_PARTIAL_IO_BIT),
+	/* selected buffer came from a ring mapped buffer group */
+	REQ_F_BUFFER_RING	= BIT(REQ_F_BUFFER_RING_BIT),
+	/* keep issuing off the armed poll, one CQE per completion */
+	REQ_F_APOLL_MULTISHOT	= BIT(REQ_F_APOLL_MULTISHOT_BIT),
+	/* ->compl.extra{1,2} hold the big CQE payload */
+	REQ_F_CQE32_INIT	= BIT(REQ_F_CQE32_INIT_BIT),
 };
 
 struct async_poll {
@@ -840,6 +924,8 @@ struct io_kiocb {
 		struct io_sr_msg	sr_msg;
 		struct io_open		open;
 		struct io_close		close;
+		struct io_msg		msg;
+		struct io_socket	sock;
 		struct io_rsrc_update	rsrc_update;
 		struct io_fadvise	fadvise;
 		struct io_madvise	madvise;
@@ -853,6 +939,9 @@ struct io_kiocb {
 		struct io_mkdir		mkdir;
 		struct io_symlink	symlink;
 		struct io_hardlink	hardlink;
+		struct io_sendzc	sendzc;
+		struct io_notif		notif;
+		struct io_uring_cmd	uring_cmd;
 		/* use only after cleaning per-op data, see io_clean_op() */
 		struct io_completion	compl;
 	};
@@ -925,6 +1014,11 @@ struct io_op_def {
 	unsigned short		async_size;
 };
 
+/* bytes of command payload past sqe->cmd, doubled SQEs get 64 more */
+#define uring_cmd_pdu_size(is_sqe128)				\
+	((1 + !!(is_sqe128)) * sizeof(struct io_uring_sqe) -		\
+		offsetof(struct io_uring_sqe, cmd))
+
 static const struct io_op_def io_op_defs[] = {
 	[IORING_OP_NOP] = {},
 	[IORING_OP_READV] = {
@@ -1071,6 +1165,24 @@ static const struct io_op_def io_op_defs[] = {
 	[IORING_OP_MKDIRAT] = {},
 	[IORING_OP_SYMLINKAT] = {},
 	[IORING_OP_LINKAT] = {},
+	[IORING_OP_MSG_RING] = {
+		.needs_file		= 1,
+	},
+	[IORING_OP_MSG_RING + 1 ... IORING_OP_SOCKET - 1] = {
+		.not_supported		= 1,
+	},
+	[IORING_OP_SOCKET] = {},
+	[IORING_OP_URING_CMD] = {
+		.needs_file		= 1,
+		.plug			= 1,
+		.needs_async_setup	= 1,
+		.async_size		= uring_cmd_pdu_size(1),
+	},
+	[IORING_OP_SEND_ZC] = {
+		.needs_file		= 1,
+		.unbound_nonreg_file	= 1,
+		.pollout		= 1,
+	},
 };
 
 /* requests with any of those set should undergo io_disarm_next() */
@@ -1097,6 +1209,7 @@ static struct file *io_file_get(struct io_ring_ctx *ctx,
 				struct io_kiocb *req, int fd, bool fixed,
 				unsigned int issue_flags);
 static void __io_queue_sqe(struct io_kiocb *req);
+static int io_issue_sqe(struct io_kiocb *req, unsigned int issue_flags);
 static void io_rsrc_put_work(struct work_struct *work);
 
 static void io_req_task_queue(struct io_kiocb *req);
@@ -1104,7 +1217,9 @@ static void io_submit_flush_completions(struct io_ring_ctx *ctx);
 static int io_req_prep_async(struct io_kiocb *req);
 
 static int io_install_fixed_file(struct io_kiocb *req, struct file *file,
-				 unsigned int issue_flags, u32 slot_index);
+				 unsigned int issue_flags, u32 file_index);
+static int __io_install_fixed_file(struct io_ring_ctx *ctx, struct file *file,
+				   u32 file_index);
 static int io_close_fixed(struct io_kiocb *req, unsigned int issue_flags);
 
 static enum hrtimer_restart io_link_timeout_fn(struct hrtimer *timer);
@@ -1354,6 +1469,7 @@ static struct io_ring_ctx *io_ring_ctx_alloc(struct io_uring_params *p)
 	INIT_LIST_HEAD(&ctx->cq_overflow_list);
 	init_completion(&ctx->ref_comp);
 	xa_init_flags(&ctx->io_buffers, XA_FLAGS_ALLOC1);
+	xa_init(&ctx->io_buf_rings);
 	xa_init_flags(&ctx->personalities, XA_FLAGS_ALLOC1);
 	mutex_init(&ctx->uring_lock);
 	init_waitqueue_head(&ctx->cq_wait);
@@ -1371,6 +1487,7 @@ static struct io_ring_ctx *io_ring_ctx_alloc(struct io_uring_params *p)
 	INIT_LIST_HEAD(&ctx->submit_state.free_list);
 	INIT_LIST_HEAD(&ctx->locked_free_list);
 	INIT_DELAYED_WORK(&ctx->fallback_work, io_fallback_req_func);
+	init_llist_head(&ctx->work_llist);
 	return ctx;
 err:
 	kfree(ctx->dummy_ubuf);
@@ -1626,7 +1743,7 @@ static inline unsigned int __io_cqring_events(struct io_ring_ctx *ctx)
 static inline struct io_uring_cqe *io_get_cqe(struct io_ring_ctx *ctx)
 {
 	struct io_rings *rings = ctx->rings;
-	unsigned tail, mask = ctx->cq_entries - 1;
+	unsigned off, mask = ctx->cq_entries - 1;
 
 	/*
 	 * writes to the cq entry need to come after reading head; the
@@ -1636,8 +1753,11 @@ static inline struct io_uring_cqe *io_get_cqe(struct io_ring_ctx *ctx)
 	if (__io_cqring_events(ctx) == ctx->cq_entries)
 		return NULL;
 
-	tail = ctx->cached_cq_tail++;
-	return &rings->cqes[tail & mask];
+	off = ctx->cached_cq_tail++ & mask;
+	/* double index for 32-byte CQEs, each takes two slots */
+	if (ctx->flags & IORING_SETUP_CQE32)
+		off <<= 1;
+	return &rings->cqes[off];
 }
 
 static inline bool io_should_trigger_evfd(struct io_ring_ctx *ctx)
@@ -1696,10 +1816,14 @@ static void io_cqring_ev_posted_iopoll(struct io_ring_ctx *ctx)
 static bool __io_cqring_overflow_flush(struct io_ring_ctx *ctx, bool force)
 {
 	bool all_flushed, posted;
+	size_t cqe_size = sizeof(struct io_uring_cqe);
 
 	if (!force && __io_cqring_events(ctx) == ctx->cq_entries)
 		return false;
 
+	if (ctx->flags & IORING_SETUP_CQE32)
+		cqe_size <<= 1;
+
 	posted = false;
 	spin_lock(&ctx->completion_lock);
 	while (!list_empty(&ctx->cq_overflow_list)) {
@@ -1711,7 +1835,7 @@ static bool __io_cqring_overflow_flush(struct io_ring_ctx *ctx, bool force)
 		ocqe = list_first_entry(&ctx->cq_overflow_list,
 					struct io_overflow_cqe, list);
 		if (cqe)
-			memcpy(cqe, &ocqe->cqe, sizeof(*cqe));
+			memcpy(cqe, &ocqe->cqe, cqe_size);
 		else
 			io_account_cq_overflow(ctx);
 
@@ -1797,11 +1921,17 @@ static __cold void io_uring_drop_tctx_refs(struct task_struct *task)
 }
 
 static bool io_cqring_event_overflow(struct io_ring_ctx *ctx, u64 user_data,
-				     s32 res, u32 cflags)
+				     s32 res, u32 cflags, u64 extra1,
+				     u64 extra2)
 {
 	struct io_overflow_cqe *ocqe;
+	size_t ocq_size = sizeof(struct io_overflow_cqe);
+	bool is_cqe32 = (ctx->flags & IORING_SETUP_CQE32);
+
+	if (is_cqe32)
+		ocq_size += sizeof(struct io_uring_cqe);
 
-	ocqe = kmalloc(sizeof(*ocqe), GFP_ATOMIC | __GFP_ACCOUNT);
+	ocqe = kmalloc(ocq_size, GFP_ATOMIC | __GFP_ACCOUNT);
 	if (!ocqe) {
 		/*
 		 * If we're in ring overflow flush mode, or in task cancel mode,
@@ -1820,12 +1950,16 @@ static bool io_cqring_event_overflow(struct io_ring_ctx *ctx, u64 user_data,
 	ocqe->cqe.user_data = user_data;
 	ocqe->cqe.res = res;
 	ocqe->cqe.flags = cflags;
+	if (is_cqe32) {
+		ocqe->cqe.big_cqe[0] = extra1;
+		ocqe->cqe.big_cqe[1] = extra2;
+	}
 	list_add_tail(&ocqe->list, &ctx->cq_overflow_list);
 	return true;
 }
 
-static inline bool __io_fill_cqe(struct io_ring_ctx *ctx, u64 user_data,
-				 s32 res, u32 cflags)
+static inline bool __io_fill_cqe32(struct io_ring_ctx *ctx, u64 user_data,
+				   s32 res, u32 cflags, u64 extra1, u64 extra2)
 {
 	struct io_uring_cqe *cqe;
 
@@ -1841,14 +1975,34 @@ static inline bool __io_fill_cqe(struct io_ring_ctx *ctx, u64 user_data,
 		WRITE_ONCE(cqe->user_data, user_data);
 		WRITE_ONCE(cqe->res, res);
 		WRITE_ONCE(cqe->flags, cflags);
+		/* always set for big CQEs, the slot may hold stale data */
+		if (ctx->flags & IORING_SETUP_CQE32) {
+			WRITE_ONCE(cqe->big_cqe[0], extra1);
+			WRITE_ONCE(cqe->big_cqe[1], extra2);
+		}
 		return true;
 	}
-	return io_cqring_event_overflow(ctx, user_data, res, cflags);
+	return io_cqring_event_overflow(ctx, user_data, res, cflags, extra1,
+					extra2);
+}
+
+static inline bool __io_fill_cqe(struct io_ring_ctx *ctx, u64 user_data,
+				 s32 res, u32 cflags)
+{
+	return __io_fill_cqe32(ctx, user_data, res, cflags, 0, 0);
+}
+
+static inline bool __io_fill_cqe_req(struct io_kiocb *req, s32 res, u32 cflags)
+{
+	if (req->flags & REQ_F_CQE32_INIT)
+		return __io_fill_cqe32(req->ctx, req->user_data, res, cflags,
+				       req->compl.extra1, req->compl.extra2);
+	return __io_fill_cqe(req->ctx, req->user_data, res, cflags);
 }
 
 static noinline void io_fill_cqe_req(struct io_kiocb *req, s32 res, u32 cflags)
 {
-	__io_fill_cqe(req->ctx, req->user_data, res, cflags);
+	__io_fill_cqe_req(req, res, cflags);
 }
 
 static noinline bool io_fill_cqe_aux(struct io_ring_ctx *ctx, u64 user_data,
@@ -1858,13 +2012,27 @@ static noinline bool io_fill_cqe_aux(struct io_ring_ctx *ctx, u64 user_data,
 	return __io_fill_cqe(ctx, user_data, res, cflags);
 }
 
+static bool io_post_aux_cqe(struct io_ring_ctx *ctx, u64 user_data, s32 res,
+			    u32 cflags)
+{
+	bool filled;
+
+	spin_lock(&ctx->completion_lock);
+	filled = io_fill_cqe_aux(ctx, user_data, res, cflags);
+	io_commit_cqring(ctx);
+	spin_unlock(&ctx->completion_lock);
+	if (filled)
+		io_cqring_ev_posted(ctx);
+	return filled;
+}
+
 static void io_req_complete_post(struct io_kiocb *req, s32 res,
 				 u32 cflags)
 {
 	struct io_ring_ctx *ctx = req->ctx;
 
 	spin_lock(&ctx->completion_lock);
-	__io_fill_cqe(ctx, req->user_data, res, cflags);
+	__io_fill_cqe_req(req, res, cflags);
 	/*
 	 * If we're the last reference to this request, add to our locked
 	 * free_list cache.
@@ -1919,6 +2087,26 @@ static inline void __io_req_complete(struct io_kiocb *req, unsigned issue_flags,
 		io_req_complete_post(req, res, cflags);
 }
 
+/*
+ * Returned by a multishot request issued with IO_URING_F_MULTISHOT once it's
+ * done, the final result is left in ->result and ->compl.cflags for the poll
+ * task_work to post after disarming.
+ */
+#define IO_MULTISHOT_STOP	1
+
+static inline int io_req_complete_multishot(struct io_kiocb *req,
+					    unsigned issue_flags, s32 res,
+					    u32 cflags)
+{
+	if (issue_flags & IO_URING_F_MULTISHOT) {
+		req->result = res;
+		req->compl.cflags = cflags;
+		return IO_MULTISHOT_STOP;
+	}
+	__io_req_complete(req, issue_flags, res, cflags);
+	return 0;
+}
+
 static inline void io_req_complete(struct io_kiocb *req, s32 res)
 {
 	__io_req_complete(req, 0, res, 0);
@@ -2248,6 +2436,39 @@ static void tctx_task_work(struct callback_head *cb)
 		io_uring_drop_tctx_refs(current);
 }
 
+static void io_move_task_work_from_local(struct io_ring_ctx *ctx)
+{
+	struct llist_node *node = llist_del_all(&ctx->work_llist);
+	struct io_kiocb *req, *tmp;
+
+	llist_for_each_entry_safe(req, tmp, node, io_task_work.fallback_node) {
+		if (llist_add(&req->io_task_work.fallback_node,
+			      &ctx->fallback_llist))
+			schedule_delayed_work(&ctx->fallback_work, 1);
+	}
+}
+
+static void io_req_local_work_add(struct io_kiocb *req)
+{
+	struct io_ring_ctx *ctx = req->ctx;
+
+	/* only the first entry has to kick the submitter */
+	if (!llist_add(&req->io_task_work.fallback_node, &ctx->work_llist))
+		return;
+
+	/* nobody is going to wait for it anymore, let the fallback run it */
+	if (unlikely(req->task->flags & PF_EXITING)) {
+		io_move_task_work_from_local(ctx);
+		return;
+	}
+
+	/*
+	 * No notification here, io_cqring_wait() runs the list. Waking the
+	 * submitter is enough if it's sleeping there.
+	 */
+	wake_up_state(req->task, TASK_INTERRUPTIBLE);
+}
+
 static void io_req_task_work_add(struct io_kiocb *req)
 {
 	struct task_struct *tsk = req->task;
@@ -2259,6 +2480,11 @@ static void io_req_task_work_add(struct io_kiocb *req)
 
 	WARN_ON_ONCE(!tctx);
 
+	if (req->ctx->flags & IORING_SETUP_DEFER_TASKRUN) {
+		io_req_local_work_add(req);
+		return;
+	}
+
 	spin_lock_irqsave(&tctx->task_lock, flags);
 	wq_list_add_tail(&req->io_task_work.node, &tctx->task_list);
 	running = tctx->task_running;
@@ -2410,8 +2636,7 @@ static void io_submit_flush_completions(struct io_ring_ctx *ctx)
 	for (i = 0; i < nr; i++) {
 		struct io_kiocb *req = state->compl_reqs[i];
 
-		__io_fill_cqe(ctx, req->user_data, req->result,
-			      req->compl.cflags);
+		__io_fill_cqe_req(req, req->result, req->compl.cflags);
 	}
 	io_commit_cqring(ctx);
 	spin_unlock(&ctx->completion_lock);
@@ -2477,10 +2702,16 @@ static unsigned int io_put_kbuf(struct io_kiocb *req, struct io_buffer *kbuf)
 {
 	unsigned int cflags;
 
-	cflags = kbuf->bid << IORING_CQE_BUFFER_SHIFT;
+	/* ring provided buffers keep their id in ->buf_index, nothing to free */
+	if (req->flags & REQ_F_BUFFER_RING) {
+		cflags = req->buf_index << IORING_CQE_BUFFER_SHIFT;
+		req->flags &= ~(REQ_F_BUFFER_SELECTED | REQ_F_BUFFER_RING);
+	} else {
+		cflags = kbuf->bid << IORING_CQE_BUFFER_SHIFT;
+		req->flags &= ~REQ_F_BUFFER_SELECTED;
+		kfree(kbuf);
+	}
 	cflags |= IORING_CQE_F_BUFFER;
-	req->flags &= ~REQ_F_BUFFER_SELECTED;
-	kfree(kbuf);
 	return cflags;
 }
 
@@ -2541,10 +2772,14 @@ static void io_iopoll_complete(struct io_ring_ctx *ctx, unsigned int *nr_events,
 			WRITE_ONCE(cqe->user_data, req->user_data);
 			WRITE_ONCE(cqe->res, req->result);
 			WRITE_ONCE(cqe->flags, cflags);
+			if (ctx->flags & IORING_SETUP_CQE32) {
+				WRITE_ONCE(cqe->big_cqe[0], 0);
+				WRITE_ONCE(cqe->big_cqe[1], 0);
+			}
 		} else {
 			spin_lock(&ctx->completion_lock);
 			io_cqring_event_overflow(ctx, req->user_data,
-							req->result, cflags);
+						 req->result, cflags, 0, 0);
 			spin_unlock(&ctx->completion_lock);
 		}
 
@@ -2566,14 +2801,16 @@ static int io_do_iopoll(struct io_ring_ctx *ctx, unsigned int *nr_events,
 			long min)
 {
 	struct io_kiocb *req, *tmp;
+	unsigned int poll_flags = BLK_POLL_NOSLEEP;
+	DEFINE_IO_COMP_BATCH(iob);
 	LIST_HEAD(done);
-	bool spin;
 
 	/*
 	 * Only spin for completions if we don't have multiple devices hanging
 	 * off our complete list, and we're under the requested amount.
 	 */
-	spin = !ctx->poll_multi_queue && *nr_events < min;
+	if (ctx->poll_multi_queue || *nr_events >= min)
+		poll_flags |= BLK_POLL_ONESHOT;
 
 	list_for_each_entry_safe(req, tmp, &ctx->iopoll_list, inflight_entry) {
 		struct kiocb *kiocb = &req->rw.kiocb;
@@ -2591,11 +2828,14 @@ static int io_do_iopoll(struct io_ring_ctx *ctx, unsigned int *nr_events,
 		if (!list_empty(&done))
 			break;
 
-		ret = kiocb->ki_filp->f_op->iopoll(kiocb, spin);
+		ret = kiocb->ki_filp->f_op->iopoll(kiocb, &iob, poll_flags);
+		/* end what was reaped, which may include current req */
+		if (!rq_list_empty(iob.req_list))
+			iob.complete(&iob);
 		if (unlikely(ret < 0))
 			return ret;
 		else if (ret)
-			spin = false;
+			poll_flags |= BLK_POLL_ONESHOT;
 
 		/* iopoll may have completed current req */
 		if (READ_ONCE(req->iopoll_completed))
@@ -2880,19 +3120,12 @@ static void io_iopoll_req_issued(struct io_kiocb *req)
 		ctx->poll_multi_queue = false;
 	} else if (!ctx->poll_multi_queue) {
 		struct io_kiocb *list_req;
-		unsigned int queue_num0, queue_num1;
 
 		list_req = list_first_entry(&ctx->iopoll_list, struct io_kiocb,
 						inflight_entry);
 
-		if (list_req->file != req->file) {
+		if (list_req->file != req->file)
 			ctx->poll_multi_queue = true;
-		} else {
-			queue_num0 = blk_qc_t_to_queue_num(list_req->rw.kiocb.ki_cookie);
-			queue_num1 = blk_qc_t_to_queue_num(req->rw.kiocb.ki_cookie);
-			if (queue_num0 != queue_num1)
-				ctx->poll_multi_queue = true;
-		}
 	}
 
 	/*
@@ -3018,6 +3251,7 @@ static int io_prep_rw(struct io_kiocb *req, const struct io_uring_sqe *sqe,
 		kiocb->ki_flags |= IOCB_HIPRI | IOCB_ALLOC_CACHE;
 		kiocb->ki_complete = io_complete_rw_iopoll;
 		req->iopoll_completed = 0;
+		kiocb->private = NULL;
 	} else {
 		if (kiocb->ki_flags & IOCB_HIPRI)
 			return -EINVAL;
@@ -3126,11 +3360,11 @@ static void kiocb_done(struct kiocb *kiocb, ssize_t ret,
 	}
 }
 
-static int __io_import_fixed(struct io_kiocb *req, int rw, struct iov_iter *iter,
-			     struct io_mapped_ubuf *imu)
+static int __io_import_fixed(int rw, struct iov_iter *iter,
+			     struct io_mapped_ubuf *imu,
+			     u64 buf_addr, size_t len)
 {
-	size_t len = req->rw.len;
-	u64 buf_end, buf_addr = req->rw.addr;
+	u64 buf_end;
 	size_t offset;
 
 	if (unlikely(check_add_overflow(buf_addr, (u64)len, &buf_end)))
@@ -3188,7 +3422,8 @@ static int io_import_fixed(struct io_kiocb *req, int rw, struct iov_iter *iter)
 {
 	if (WARN_ON_ONCE(!req->imu))
 		return -EFAULT;
-	return __io_import_fixed(req, rw, iter, req->imu);
+	return __io_import_fixed(rw, iter, req->imu, req->rw.addr,
+				 req->rw.len);
 }
 
 static void io_ring_submit_unlock(struct io_ring_ctx *ctx, bool needs_lock)
@@ -3209,54 +3444,103 @@ static void io_ring_submit_lock(struct io_ring_ctx *ctx, bool needs_lock)
 		mutex_lock(&ctx->uring_lock);
 }
 
-static struct io_buffer *io_buffer_select(struct io_kiocb *req, size_t *len,
-					  int bgid, struct io_buffer *kbuf,
-					  bool needs_lock)
+static void __user *io_ring_buffer_select(struct io_kiocb *req, size_t *len,
+					  struct io_buffer_list *bl)
 {
+	struct io_uring_buf_ring *br = bl->buf_ring;
+	struct io_uring_buf *buf;
+	__u16 head = bl->head;
+	__u32 buf_len;
+
+	/* pairs with the tail store in userspace after filling in entries */
+	if (unlikely(smp_load_acquire(&br->tail) == head))
+		return ERR_PTR(-ENOBUFS);
+
+	buf = &br->bufs[head & bl->mask];
+	buf_len = min_t(__u32, READ_ONCE(buf->len), MAX_RW_COUNT);
+	if (*len == 0 || *len > buf_len)
+		*len = buf_len;
+	req->buf_index = READ_ONCE(buf->bid);
+	req->flags |= REQ_F_BUFFER_SELECTED | REQ_F_BUFFER_RING;
+	/*
+	 * The entry is ours from here on, hand the slot back to the
+	 * application right away so no cleanup is needed on failure.
+	 */
+	bl->head++;
+	return u64_to_user_ptr(READ_ONCE(buf->addr));
+}
+
+/*
+ * Pick a buffer from group @bgid. Legacy groups hand over one of their
+ * io_buffers through @kbuf, ring mapped groups don't allocate anything
+ * and mark the request with REQ_F_BUFFER_RING instead.
+ */
+static void __user *io_buffer_select(struct io_kiocb *req, size_t *len,
+				     int bgid, struct io_buffer **kbuf,
+				     bool needs_lock)
+{
+	struct io_ring_ctx *ctx = req->ctx;
+	struct io_buffer_list *bl;
 	struct io_buffer *head;
+	void __user *ret;
 
-	if (req->flags & REQ_F_BUFFER_SELECTED)
-		return kbuf;
+	io_ring_submit_lock(ctx, needs_lock);
 
-	io_ring_submit_lock(req->ctx, needs_lock);
+	lockdep_assert_held(&ctx->uring_lock);
 
-	lockdep_assert_held(&req->ctx->uring_lock);
+	bl = xa_load(&ctx->io_buf_rings, bgid);
+	if (bl) {
+		ret = io_ring_buffer_select(req, len, bl);
+		goto out;
+	}
 
-	head = xa_load(&req->ctx->io_buffers, bgid);
+	head = xa_load(&ctx->io_buffers, bgid);
 	if (head) {
 		if (!list_empty(&head->list)) {
-			kbuf = list_last_entry(&head->list, struct io_buffer,
+			*kbuf = list_last_entry(&head->list, struct io_buffer,
 							list);
-			list_del(&kbuf->list);
+			list_del(&(*kbuf)->list);
 		} else {
-			kbuf = head;
-			xa_erase(&req->ctx->io_buffers, bgid);
+			*kbuf = head;
+			xa_erase(&ctx->io_buffers, bgid);
 		}
-		if (*len > kbuf->len)
-			*len = kbuf->len;
+		if (*len == 0 || *len > (*kbuf)->len)
+			*len = (*kbuf)->len;
+		req->flags |= REQ_F_BUFFER_SELECTED;
+		ret = u64_to_user_ptr((*kbuf)->addr);
 	} else {
-		kbuf = ERR_PTR(-ENOBUFS);
+		ret = ERR_PTR(-ENOBUFS);
 	}
+out:
+	io_ring_submit_unlock(ctx, needs_lock);
 
-	io_ring_submit_unlock(req->ctx, needs_lock);
-
-	return kbuf;
+	return ret;
 }
 
 static void __user *io_rw_buffer_select(struct io_kiocb *req, size_t *len,
 					bool needs_lock)
 {
 	struct io_buffer *kbuf;
-	u16 bgid;
+	void __user *buf;
 
-	kbuf = (struct io_buffer *) (unsigned long) req->rw.addr;
-	bgid = req->buf_index;
-	kbuf = io_buffer_select(req, len, bgid, kbuf, needs_lock);
-	if (IS_ERR(kbuf))
-		return kbuf;
-	req->rw.addr = (u64) (unsigned long) kbuf;
-	req->flags |= REQ_F_BUFFER_SELECTED;
-	return u64_to_user_ptr(kbuf->addr);
+	if (req->flags & REQ_F_BUFFER_SELECTED) {
+		if (req->flags & REQ_F_BUFFER_RING)
+			return u64_to_user_ptr(req->rw.addr);
+		kbuf = (struct io_buffer *) (unsigned long) req->rw.addr;
+		return u64_to_user_ptr(kbuf->addr);
+	}
+
+	buf = io_buffer_select(req, len, req->buf_index, &kbuf, needs_lock);
+	if (IS_ERR(buf))
+		return buf;
+	if (req->flags & REQ_F_BUFFER_RING) {
+		/* no io_buffer to point at, stash the selection itself */
+		req->rw.addr = (u64) (unsigned long) buf;
+		req->rw.len = *len;
+	} else {
+		req->rw.addr = (u64) (unsigned long) kbuf;
+	}
+	return buf;
 }
 
 #ifdef CONFIG_COMPAT
@@ -3310,6 +3594,11 @@ static ssize_t __io_iov_buffer_select(struct io_kiocb *req, struct iovec *iov,
 static ssize_t io_iov_buffer_select(struct io_kiocb *req, struct iovec *iov,
 				    bool needs_lock)
 {
+	if (req->flags & REQ_F_BUFFER_RING) {
+		iov[0].iov_base = u64_to_user_ptr(req->rw.addr);
+		iov[0].iov_len = req->rw.len;
+		return 0;
+	}
 	if (req->flags & REQ_F_BUFFER_SELECTED) {
 		struct io_buffer *kbuf;
 
@@ -4106,6 +4395,256 @@ static int io_linkat(struct io_kiocb *req, int issue_flags)
 	return 0;
 }
 
+static void io_uring_cmd_work(struct io_kiocb *req, bool *locked)
+{
+	req->uring_cmd.task_work_cb(&req->uring_cmd);
+}
+
+void io_uring_cmd_complete_in_task(struct io_uring_cmd *ioucmd,
+			void (*task_work_cb)(struct io_uring_cmd *))
+{
+	struct io_kiocb *req = container_of(ioucmd, struct io_kiocb, uring_cmd);
+
+	req->uring_cmd.task_work_cb = task_work_cb;
+	req->io_task_work.func = io_uring_cmd_work;
+	io_req_task_work_add(req);
+}
+EXPORT_SYMBOL_GPL(io_uring_cmd_complete_in_task);
+
+/*
+ * Called by consumers of io_uring_cmd, if they originally returned
+ * -EIOCBQUEUED upon receiving the command.
+ */
+void io_uring_cmd_done(struct io_uring_cmd *ioucmd, ssize_t ret, ssize_t res2)
+{
+	struct io_kiocb *req = container_of(ioucmd, struct io_kiocb, uring_cmd);
+
+	if (ret < 0)
+		req_set_fail(req);
+	if (req->ctx->flags & IORING_SETUP_CQE32) {
+		req->compl.extra1 = res2;
+		req->compl.extra2 = 0;
+		req->flags |= REQ_F_CQE32_INIT;
+	}
+	io_req_complete(req, ret);
+}
+EXPORT_SYMBOL_GPL(io_uring_cmd_done);
+
+static int io_uring_cmd_prep_async(struct io_kiocb *req)
+{
+	size_t cmd_size;
+
+	cmd_size = uring_cmd_pdu_size(req->ctx->flags & IORING_SETUP_SQE128);
+
+	memcpy(req->async_data, req->uring_cmd.cmd, cmd_size);
+	return 0;
+}
+
+static int io_uring_cmd_prep(struct io_kiocb *req,
+			     const struct io_uring_sqe *sqe)
+{
+	struct io_uring_cmd *ioucmd = &req->uring_cmd;
+
+	if (unlikely(req->ctx->flags & IORING_SETUP_IOPOLL))
+		return -EOPNOTSUPP;
+	if (sqe->ioprio || sqe->rw_flags)
+		return -EINVAL;
+	ioucmd->cmd = sqe->cmd;
+	ioucmd->cmd_op = READ_ONCE(sqe->cmd_op);
+	return 0;
+}
+
+static int io_uring_cmd(struct io_kiocb *req, unsigned int issue_flags)
+{
+	struct io_uring_cmd *ioucmd = &req->uring_cmd;
+	struct io_ring_ctx *ctx = req->ctx;
+	struct file *file = req->file;
+	int ret;
+
+	if (!req->file->f_op->uring_cmd)
+		return -EOPNOTSUPP;
+
+	if (ctx->flags & IORING_SETUP_SQE128)
+		issue_flags |= IO_URING_F_SQE128;
+	if (ctx->flags & IORING_SETUP_CQE32)
+		issue_flags |= IO_URING_F_CQE32;
+
+	if (req->async_data)
+		ioucmd->cmd = req->async_data;
+
+	ret = file->f_op->uring_cmd(ioucmd, issue_flags);
+	if (ret == -EAGAIN) {
+		/* the SQE may be reused once we return, keep a copy */
+		if (!req->async_data) {
+			if (io_alloc_async_data(req))
+				return -ENOMEM;
+			io_uring_cmd_prep_async(req);
+		}
+		return -EAGAIN;
+	}
+
+	if (ret != -EIOCBQUEUED)
+		io_uring_cmd_done(ioucmd, ret, 0);
+	return 0;
+}
+
+static int io_msg_ring_prep(struct io_kiocb *req,
+			    const struct io_uring_sqe *sqe)
+{
+	struct io_msg *msg = &req->msg;
+
+	if (unlikely(req->ctx->flags & IORING_SETUP_IOPOLL))
+		return -EINVAL;
+	if (unlikely(sqe->ioprio || sqe->buf_index))
+		return -EINVAL;
+
+	msg->user_data = READ_ONCE(sqe->off);
+	msg->len = READ_ONCE(sqe->len);
+	msg->cmd = READ_ONCE(sqe->addr);
+	msg->src_fd = READ_ONCE(sqe->addr3);
+	msg->dst_fd = READ_ONCE(sqe->file_index);
+	msg->flags = READ_ONCE(sqe->msg_ring_flags);
+	if (msg->flags & ~IORING_MSG_RING_CQE_SKIP)
+		return -EINVAL;
+	return 0;
+}
+
+/*
+ * On inline submission the source ctx is already locked, so only trylock the
+ * target to not deadlock against a ring messaging us back, and punt to io-wq
+ * if that fails. From io-wq we hold nothing, take both in address order.
+ */
+static int io_double_lock_ctx(struct io_ring_ctx *ctx,
+			      struct io_ring_ctx *octx,
+			      unsigned int issue_flags)
+{
+	if (issue_flags & IO_URING_F_NONBLOCK) {
+		if (!mutex_trylock(&octx->uring_lock))
+			return -EAGAIN;
+		return 0;
+	}
+
+	if (ctx < octx) {
+		mutex_lock(&ctx->uring_lock);
+		mutex_lock_nested(&octx->uring_lock, SINGLE_DEPTH_NESTING);
+	} else {
+		mutex_lock(&octx->uring_lock);
+		mutex_lock_nested(&ctx->uring_lock, SINGLE_DEPTH_NESTING);
+	}
+	return 0;
+}
+
+static void io_double_unlock_ctx(struct io_ring_ctx *ctx,
+				 struct io_ring_ctx *octx,
+				 unsigned int issue_flags)
+{
+	mutex_unlock(&octx->uring_lock);
+	if (!(issue_flags & IO_URING_F_NONBLOCK))
+		mutex_unlock(&ctx->uring_lock);
+}
+
+static int io_msg_ring_data(struct io_kiocb *req, unsigned int issue_flags)
+{
+	struct io_ring_ctx *target_ctx = req->file->private_data;
+	struct io_msg *msg = &req->msg;
+	bool posted;
+	int ret;
+
+	if (msg->src_fd || msg->dst_fd || msg->flags)
+		return -EINVAL;
+
+	/* IOPOLL rings fill CQEs under ->uring_lock, not ->completion_lock */
+	if (target_ctx->flags & IORING_SETUP_IOPOLL) {
+		ret = io_double_lock_ctx(req->ctx, target_ctx, issue_flags);
+		if (unlikely(ret))
+			return ret;
+		posted = io_post_aux_cqe(target_ctx, msg->user_data, msg->len, 0);
+		io_double_unlock_ctx(req->ctx, target_ctx, issue_flags);
+	} else {
+		posted = io_post_aux_cqe(target_ctx, msg->user_data, msg->len, 0);
+	}
+	return posted ? 0 : -EOVERFLOW;
+}
+
+static int io_msg_send_fd(struct io_kiocb *req, unsigned int issue_flags)
+{
+	struct io_ring_ctx *target_ctx = req->file->private_data;
+	struct io_msg *msg = &req->msg;
+	struct io_ring_ctx *ctx = req->ctx;
+	struct file *src_file;
+	u32 src_fd;
+	int ret;
+
+	if (target_ctx == ctx || !msg->dst_fd)
+		return -EINVAL;
+
+	ret = io_double_lock_ctx(ctx, target_ctx, issue_flags);
+	if (unlikely(ret))
+		return ret;
+
+	ret = -EBADF;
+	if (unlikely(msg->src_fd >= ctx->nr_user_files))
+		goto out_unlock;
+	src_fd = array_index_nospec(msg->src_fd, ctx->nr_user_files);
+	src_file = io_file_from_index(ctx, src_fd);
+	if (!src_file)
+		goto out_unlock;
+	get_file(src_file);
+
+	ret = __io_install_fixed_file(target_ctx, src_file, msg->dst_fd);
+	if (ret < 0) {
+		fput(src_file);
+		goto out_unlock;
+	}
+
+	if (msg->flags & IORING_MSG_RING_CQE_SKIP)
+		goto out_unlock;
+	/*
+	 * If this fails, the target still received the file descriptor but
+	 * wasn't notified of the fact. The sender has to make sure a later
+	 * IORING_OP_MSG_RING delivers the message. An allocated slot is
+	 * reported in place of msg->len, the target has no other way to
+	 * learn where the file went.
+	 */
+	if (!io_post_aux_cqe(target_ctx, msg->user_data,
+			     msg->dst_fd == IORING_FILE_INDEX_ALLOC ?
+			     ret : msg->len, 0))
+		ret = -EOVERFLOW;
+out_unlock:
+	io_double_unlock_ctx(ctx, target_ctx, issue_flags);
+	return ret;
+}
+
+static int io_msg_ring(struct io_kiocb *req, unsigned int issue_flags)
+{
+	struct io_msg *msg = &req->msg;
+	int ret;
+
+	ret = -EBADFD;
+	if (req->file->f_op != &io_uring_fops)
+		goto done;
+
+	switch (msg->cmd) {
+	case IORING_MSG_DATA:
+		ret = io_msg_ring_data(req, issue_flags);
+		break;
+	case IORING_MSG_SEND_FD:
+		ret = io_msg_send_fd(req, issue_flags);
+		break;
+	default:
+		ret = -EINVAL;
+		break;
+	}
+
+	if (ret == -EAGAIN && (issue_flags & IO_URING_F_NONBLOCK))
+		return -EAGAIN;
+done:
+	if (ret < 0)
+		req_set_fail(req);
+	__io_req_complete(req, issue_flags, ret, 0);
+	return 0;
+}
+
 static int io_shutdown_prep(struct io_kiocb *req,
 			    const struct io_uring_sqe *sqe)
 {
@@ -4447,7 +4986,7 @@ static int io_openat2(struct io_kiocb *req, unsigned int issue_flags)
 		fd_install(ret, file);
 	else
 		ret = io_install_fixed_file(req, file, issue_flags,
-					    req->open.file_slot - 1);
+					    req->open.file_slot);
 err:
 	putname(req->open.filename);
 	req->flags &= ~REQ_F_NEED_CLEANUP;
@@ -4609,6 +5148,12 @@ static int io_provide_buffers(struct io_kiocb *req, unsigned int issue_flags)
 
 	lockdep_assert_held(&ctx->uring_lock);
 
+	/* ring mapped groups are replenished by the application directly */
+	if (xa_load(&ctx->io_buf_rings, p->bgid)) {
+		ret = -EINVAL;
+		goto out;
+	}
+
 	list = head = xa_load(&ctx->io_buffers, p->bgid);
 
 	ret = io_add_buffers(p, &head);
@@ -4618,6 +5163,7 @@ static int io_provide_buffers(struct io_kiocb *req, unsigned int issue_flags)
 		if (ret < 0)
 			__io_remove_buffers(ctx, head, p->bgid, -1U);
 	}
+out:
 	if (ret < 0)
 		req_set_fail(req);
 	/* complete before unlock, IOPOLL may need the lock */
@@ -4881,6 +5427,20 @@ static int io_sync_file_range(struct io_kiocb *req, unsigned int issue_flags)
 	return 0;
 }
 
+/*
+ * Drop the submission reference of a notification whose request never got to
+ * post a result. If the stack still holds pages from an earlier partial send
+ * the notification is posted as usual once they're released, otherwise it
+ * goes away without a CQE.
+ */
+static void io_notif_discard(struct io_kiocb *notif)
+{
+	if (refcount_dec_and_test(&notif->notif.uarg.refcnt)) {
+		notif->io_task_work.func = io_free_req_work;
+		io_req_task_work_add(notif);
+	}
+}
+
 #if defined(CONFIG_NET)
 static bool io_net_retry(struct socket *sock, int flags)
 {
@@ -5043,6 +5603,7 @@ static int io_send(struct io_kiocb *req, unsigned int issue_flags)
 	msg.msg_control = NULL;
 	msg.msg_controllen = 0;
 	msg.msg_namelen = 0;
+	msg.msg_ubuf = NULL;
 
 	flags = req->sr_msg.msg_flags;
 	if (issue_flags & IO_URING_F_NONBLOCK)
@@ -5067,10 +5628,170 @@ static int io_send(struct io_kiocb *req, unsigned int issue_flags)
 		req_set_fail(req);
 	}
 	if (ret >= 0)
-		ret += sr->done_io;
-	else if (sr->done_io)
-		ret = sr->done_io;
-	__io_req_complete(req, issue_flags, ret, 0);
+		ret += sr->done_io;
+	else if (sr->done_io)
+		ret = sr->done_io;
+	__io_req_complete(req, issue_flags, ret, 0);
+	return 0;
+}
+
+static void io_notif_complete_tw(struct io_kiocb *notif, bool *locked)
+{
+	io_post_aux_cqe(notif->ctx, notif->user_data, 0, IORING_CQE_F_NOTIF);
+	io_free_req(notif);
+}
+
+static void io_uring_tx_zerocopy_callback(struct sk_buff *skb,
+					  struct ubuf_info *uarg,
+					  bool success)
+{
+	struct io_notif *nd = container_of(uarg, struct io_notif, uarg);
+	struct io_kiocb *notif = container_of(nd, struct io_kiocb, notif);
+
+	/* may be called from softirq, punt CQE posting to the submitter */
+	if (refcount_dec_and_test(&uarg->refcnt)) {
+		notif->io_task_work.func = io_notif_complete_tw;
+		io_req_task_work_add(notif);
+	}
+}
+
+static struct io_kiocb *io_alloc_notif(struct io_kiocb *req)
+	__must_hold(&req->ctx->uring_lock)
+{
+	struct io_ring_ctx *ctx = req->ctx;
+	struct io_kiocb *notif;
+
+	notif = io_alloc_req(ctx);
+	if (unlikely(!notif))
+		return NULL;
+
+	/* outlives @req, so it needs its own ctx and task references */
+	percpu_ref_get(&ctx->refs);
+	io_get_task_refs(1);
+
+	notif->opcode = IORING_OP_NOP;
+	notif->flags = 0;
+	notif->file = NULL;
+	notif->task = current;
+	notif->user_data = req->user_data;
+	notif->fixed_rsrc_refs = NULL;
+	/* the request cache hands out recycled memory */
+	memset(&notif->notif.uarg, 0, sizeof(notif->notif.uarg));
+	notif->notif.uarg.callback = io_uring_tx_zerocopy_callback;
+	notif->notif.uarg.flags = SKBFL_ZEROCOPY_FRAG | SKBFL_DONT_ORPHAN;
+	refcount_set(&notif->notif.uarg.refcnt, 1);
+	return notif;
+}
+
+static int io_sendzc_prep(struct io_kiocb *req, const struct io_uring_sqe *sqe)
+{
+	struct io_sendzc *zc = &req->sendzc;
+	struct io_ring_ctx *ctx = req->ctx;
+
+	if (unlikely(ctx->flags & IORING_SETUP_IOPOLL))
+		return -EINVAL;
+	if (unlikely(sqe->addr2 || sqe->file_index))
+		return -EINVAL;
+
+	zc->flags = READ_ONCE(sqe->ioprio);
+	if (zc->flags & ~IORING_RECVSEND_FIXED_BUF)
+		return -EINVAL;
+	if (zc->flags & IORING_RECVSEND_FIXED_BUF) {
+		u16 index = READ_ONCE(sqe->buf_index);
+
+		if (unlikely(index >= ctx->nr_user_bufs))
+			return -EFAULT;
+		index = array_index_nospec(index, ctx->nr_user_bufs);
+		req->imu = ctx->user_bufs[index];
+		io_req_set_rsrc_node(req);
+	} else if (sqe->buf_index) {
+		return -EINVAL;
+	}
+
+	zc->buf = u64_to_user_ptr(READ_ONCE(sqe->addr));
+	zc->len = READ_ONCE(sqe->len);
+	zc->msg_flags = READ_ONCE(sqe->msg_flags) | MSG_NOSIGNAL;
+	if (zc->msg_flags & MSG_DONTWAIT)
+		req->flags |= REQ_F_NOWAIT;
+	zc->done_io = 0;
+
+	zc->notif = io_alloc_notif(req);
+	if (unlikely(!zc->notif))
+		return -ENOMEM;
+	/* the stack may reference registered pages after @req is gone */
+	if (zc->flags & IORING_RECVSEND_FIXED_BUF)
+		io_req_set_rsrc_node(zc->notif);
+	req->flags |= REQ_F_NEED_CLEANUP;
+	return 0;
+}
+
+static int io_sendzc(struct io_kiocb *req, unsigned int issue_flags)
+{
+	struct io_sendzc *zc = &req->sendzc;
+	struct msghdr msg;
+	struct iovec iov;
+	struct socket *sock;
+	unsigned flags;
+	int min_ret = 0;
+	int ret;
+
+	sock = sock_from_file(req->file);
+	if (unlikely(!sock))
+		return -ENOTSOCK;
+	/* only TCP knows how to use a caller provided ubuf_info */
+	if (unlikely(sock->type != SOCK_STREAM ||
+		     sock->sk->sk_protocol != IPPROTO_TCP))
+		return -EOPNOTSUPP;
+
+	if (zc->flags & IORING_RECVSEND_FIXED_BUF)
+		ret = __io_import_fixed(WRITE, &msg.msg_iter, req->imu,
+					(u64)(unsigned long)zc->buf, zc->len);
+	else
+		ret = import_single_range(WRITE, zc->buf, zc->len, &iov,
+					  &msg.msg_iter);
+	if (unlikely(ret))
+		return ret;
+
+	msg.msg_name = NULL;
+	msg.msg_control = NULL;
+	msg.msg_controllen = 0;
+	msg.msg_namelen = 0;
+	msg.msg_ubuf = &zc->notif->notif.uarg;
+
+	flags = zc->msg_flags | MSG_ZEROCOPY;
+	if (issue_flags & IO_URING_F_NONBLOCK)
+		flags |= MSG_DONTWAIT;
+	if (flags & MSG_WAITALL)
+		min_ret = iov_iter_count(&msg.msg_iter);
+
+	msg.msg_flags = flags;
+	ret = sock_sendmsg(sock, &msg);
+	if (ret < min_ret) {
+		if (ret == -EAGAIN && (issue_flags & IO_URING_F_NONBLOCK))
+			return -EAGAIN;
+		if (ret == -ERESTARTSYS)
+			ret = -EINTR;
+		if (ret > 0 && io_net_retry(sock, flags)) {
+			zc->len -= ret;
+			zc->buf += ret;
+			zc->done_io += ret;
+			req->flags |= REQ_F_PARTIAL_IO;
+			return -EAGAIN;
+		}
+		req_set_fail(req);
+	}
+	if (ret >= 0)
+		ret += zc->done_io;
+	else if (zc->done_io)
+		ret = zc->done_io;
+
+	/*
+	 * Drop the submission reference, the notification is posted once the
+	 * stack has released the pages as well.
+	 */
+	req->flags &= ~REQ_F_NEED_CLEANUP;
+	net_zcopy_put(&zc->notif->notif.uarg);
+	__io_req_complete(req, issue_flags, ret, IORING_CQE_F_MORE);
 	return 0;
 }
 
@@ -5161,19 +5882,22 @@ static int io_recvmsg_copy_hdr(struct io_kiocb *req,
 	return __io_recvmsg_copy_hdr(req, iomsg);
 }
 
-static struct io_buffer *io_recv_buffer_select(struct io_kiocb *req,
-					       bool needs_lock)
+static void __user *io_recv_buffer_select(struct io_kiocb *req,
+					  bool needs_lock)
 {
 	struct io_sr_msg *sr = &req->sr_msg;
-	struct io_buffer *kbuf;
+	void __user *buf;
 
-	kbuf = io_buffer_select(req, &sr->len, sr->bgid, sr->kbuf, needs_lock);
-	if (IS_ERR(kbuf))
-		return kbuf;
+	if (req->flags & REQ_F_BUFFER_SELECTED) {
+		if (req->flags & REQ_F_BUFFER_RING)
+			return sr->ring_buf;
+		return u64_to_user_ptr(sr->kbuf->addr);
+	}
 
-	sr->kbuf = kbuf;
-	req->flags |= REQ_F_BUFFER_SELECTED;
-	return kbuf;
+	buf = io_buffer_select(req, &sr->len, sr->bgid, &sr->kbuf, needs_lock);
+	if (!IS_ERR(buf) && (req->flags & REQ_F_BUFFER_RING))
+		sr->ring_buf = buf;
+	return buf;
 }
 
 static inline unsigned int io_put_recv_kbuf(struct io_kiocb *req)
@@ -5199,8 +5923,6 @@ static int io_recvmsg_prep(struct io_kiocb *req, const struct io_uring_sqe *sqe)
 		return -EINVAL;
 	if (unlikely(sqe->addr2 || sqe->file_index))
 		return -EINVAL;
-	if (unlikely(sqe->addr2 || sqe->file_index || sqe->ioprio))
-		return -EINVAL;
 
 	sr->umsg = u64_to_user_ptr(READ_ONCE(sqe->addr));
 	sr->len = READ_ONCE(sqe->len);
@@ -5209,6 +5931,18 @@ static int io_recvmsg_prep(struct io_kiocb *req, const struct io_uring_sqe *sqe)
 	if (sr->msg_flags & MSG_DONTWAIT)
 		req->flags |= REQ_F_NOWAIT;
 
+	if (sqe->ioprio) {
+		if (req->opcode != IORING_OP_RECV ||
+		    sqe->ioprio != IORING_RECV_MULTISHOT)
+			return -EINVAL;
+		/* every CQE hands out a buffer, and there's no partial retry */
+		if (!(req->flags & REQ_F_BUFFER_SELECT) ||
+		    (sr->msg_flags & MSG_WAITALL))
+			return -EINVAL;
+		sr->mshot_len = sr->len;
+		req->flags |= REQ_F_APOLL_MULTISHOT;
+	}
+
 #ifdef CONFIG_COMPAT
 	if (req->ctx->compat)
 		sr->msg_flags |= MSG_CMSG_COMPAT;
@@ -5222,7 +5956,7 @@ static int io_recvmsg(struct io_kiocb *req, unsigned int issue_flags)
 	struct io_async_msghdr iomsg, *kmsg;
 	struct io_sr_msg *sr = &req->sr_msg;
 	struct socket *sock;
-	struct io_buffer *kbuf;
+	void __user *buf;
 	unsigned flags;
 	int min_ret = 0;
 	int ret, cflags = 0;
@@ -5241,10 +5975,10 @@ static int io_recvmsg(struct io_kiocb *req, unsigned int issue_flags)
 	}
 
 	if (req->flags & REQ_F_BUFFER_SELECT) {
-		kbuf = io_recv_buffer_select(req, !force_nonblock);
-		if (IS_ERR(kbuf))
-			return PTR_ERR(kbuf);
-		kmsg->fast_iov[0].iov_base = u64_to_user_ptr(kbuf->addr);
+		buf = io_recv_buffer_select(req, !force_nonblock);
+		if (IS_ERR(buf))
+			return PTR_ERR(buf);
+		kmsg->fast_iov[0].iov_base = buf;
 		kmsg->fast_iov[0].iov_len = req->sr_msg.len;
 		iov_iter_init(&kmsg->msg.msg_iter, READ, kmsg->fast_iov,
 				1, req->sr_msg.len);
@@ -5289,7 +6023,6 @@ static int io_recvmsg(struct io_kiocb *req, unsigned int issue_flags)
 
 static int io_recv(struct io_kiocb *req, unsigned int issue_flags)
 {
-	struct io_buffer *kbuf;
 	struct io_sr_msg *sr = &req->sr_msg;
 	struct msghdr msg;
 	void __user *buf = sr->buf;
@@ -5299,16 +6032,18 @@ static int io_recv(struct io_kiocb *req, unsigned int issue_flags)
 	int min_ret = 0;
 	int ret, cflags = 0;
 	bool force_nonblock = issue_flags & IO_URING_F_NONBLOCK;
+	/* io-wq can't wait on the poll, it completes multishot as oneshot */
+	bool multishot = force_nonblock && (req->flags & REQ_F_APOLL_MULTISHOT);
 
 	sock = sock_from_file(req->file);
 	if (unlikely(!sock))
 		return -ENOTSOCK;
 
+retry_multishot:
 	if (req->flags & REQ_F_BUFFER_SELECT) {
-		kbuf = io_recv_buffer_select(req, !force_nonblock);
-		if (IS_ERR(kbuf))
-			return PTR_ERR(kbuf);
-		buf = u64_to_user_ptr(kbuf->addr);
+		buf = io_recv_buffer_select(req, !force_nonblock);
+		if (IS_ERR(buf))
+			return PTR_ERR(buf);
 	}
 
 	ret = import_single_range(READ, buf, sr->len, &iov, &msg.msg_iter);
@@ -5321,6 +6056,7 @@ static int io_recv(struct io_kiocb *req, unsigned int issue_flags)
 	msg.msg_namelen = 0;
 	msg.msg_iocb = NULL;
 	msg.msg_flags = 0;
+	msg.msg_ubuf = NULL;
 
 	flags = req->sr_msg.msg_flags;
 	if (force_nonblock)
@@ -5352,17 +6088,31 @@ out_free:
 		ret += sr->done_io;
 	else if (sr->done_io)
 		ret = sr->done_io;
-	__io_req_complete(req, issue_flags, ret, cflags);
-	return 0;
+	if (!multishot) {
+		__io_req_complete(req, issue_flags, ret, cflags);
+		return 0;
+	}
+	/* EOF or an error ends it, otherwise keep draining the socket */
+	if (ret > 0 && io_post_aux_cqe(req->ctx, req->user_data, ret,
+				       cflags | IORING_CQE_F_MORE)) {
+		sr->len = sr->mshot_len;
+		goto retry_multishot;
+	}
+	return io_req_complete_multishot(req, issue_flags, ret, cflags);
 }
 
 static int io_accept_prep(struct io_kiocb *req, const struct io_uring_sqe *sqe)
 {
 	struct io_accept *accept = &req->accept;
+	unsigned int flags;
 
 	if (unlikely(req->ctx->flags & IORING_SETUP_IOPOLL))
 		return -EINVAL;
-	if (sqe->ioprio || sqe->len || sqe->buf_index)
+	if (sqe->len || sqe->buf_index)
+		return -EINVAL;
+
+	flags = READ_ONCE(sqe->ioprio);
+	if (flags & ~IORING_ACCEPT_MULTISHOT)
 		return -EINVAL;
 
 	accept->addr = u64_to_user_ptr(READ_ONCE(sqe->addr));
@@ -5377,6 +6127,13 @@ static int io_accept_prep(struct io_kiocb *req, const struct io_uring_sqe *sqe)
 		return -EINVAL;
 	if (SOCK_NONBLOCK != O_NONBLOCK && (accept->flags & SOCK_NONBLOCK))
 		accept->flags = (accept->flags & ~SOCK_NONBLOCK) | O_NONBLOCK;
+	if (flags & IORING_ACCEPT_MULTISHOT) {
+		/* a single fixed slot can't take more than one file */
+		if (accept->file_slot &&
+		    accept->file_slot != IORING_FILE_INDEX_ALLOC)
+			return -EINVAL;
+		req->flags |= REQ_F_APOLL_MULTISHOT;
+	}
 	return 0;
 }
 
@@ -5385,10 +6142,13 @@ static int io_accept(struct io_kiocb *req, unsigned int issue_flags)
 	struct io_accept *accept = &req->accept;
 	bool force_nonblock = issue_flags & IO_URING_F_NONBLOCK;
 	unsigned int file_flags = force_nonblock ? O_NONBLOCK : 0;
+	/* io-wq can't wait on the poll, it completes multishot as oneshot */
+	bool multishot = force_nonblock && (req->flags & REQ_F_APOLL_MULTISHOT);
 	bool fixed = !!accept->file_slot;
 	struct file *file;
 	int ret, fd;
 
+retry:
 	if (!fixed) {
 		fd = __get_unused_fd_flags(accept->flags, accept->nofile);
 		if (unlikely(fd < 0))
@@ -5412,7 +6172,69 @@ static int io_accept(struct io_kiocb *req, unsigned int issue_flags)
 		ret = fd;
 	} else {
 		ret = io_install_fixed_file(req, file, issue_flags,
-					    accept->file_slot - 1);
+					    accept->file_slot);
+	}
+	if (!multishot) {
+		__io_req_complete(req, issue_flags, ret, 0);
+		return 0;
+	}
+	if (ret >= 0 &&
+	    io_post_aux_cqe(req->ctx, req->user_data, ret, IORING_CQE_F_MORE))
+		goto retry;
+	return io_req_complete_multishot(req, issue_flags, ret, 0);
+}
+
+static int io_socket_prep(struct io_kiocb *req, const struct io_uring_sqe *sqe)
+{
+	struct io_socket *sock = &req->sock;
+
+	if (unlikely(req->ctx->flags & IORING_SETUP_IOPOLL))
+		return -EINVAL;
+	if (sqe->ioprio || sqe->addr || sqe->rw_flags || sqe->buf_index)
+		return -EINVAL;
+
+	sock->domain = READ_ONCE(sqe->fd);
+	sock->type = READ_ONCE(sqe->off);
+	sock->protocol = READ_ONCE(sqe->len);
+	sock->file_slot = READ_ONCE(sqe->file_index);
+	sock->nofile = rlimit(RLIMIT_NOFILE);
+
+	sock->flags = sock->type & ~SOCK_TYPE_MASK;
+	if (sock->file_slot && (sock->flags & SOCK_CLOEXEC))
+		return -EINVAL;
+	if (sock->flags & ~(SOCK_CLOEXEC | SOCK_NONBLOCK))
+		return -EINVAL;
+	return 0;
+}
+
+static int io_socket(struct io_kiocb *req, unsigned int issue_flags)
+{
+	struct io_socket *sock = &req->sock;
+	bool fixed = !!sock->file_slot;
+	struct file *file;
+	int ret, fd;
+
+	if (!fixed) {
+		fd = __get_unused_fd_flags(sock->flags, sock->nofile);
+		if (unlikely(fd < 0))
+			return fd;
+	}
+	file = __sys_socket_file(sock->domain, sock->type, sock->protocol);
+	if (IS_ERR(file)) {
+		if (!fixed)
+			put_unused_fd(fd);
+		ret = PTR_ERR(file);
+		if (ret == -EAGAIN && (issue_flags & IO_URING_F_NONBLOCK))
+			return -EAGAIN;
+		if (ret == -ERESTARTSYS)
+			ret = -EINTR;
+		req_set_fail(req);
+	} else if (!fixed) {
+		fd_install(fd, file);
+		ret = fd;
+	} else {
+		ret = io_install_fixed_file(req, file, issue_flags,
+					    sock->file_slot);
 	}
 	__io_req_complete(req, issue_flags, ret, 0);
 	return 0;
@@ -5508,6 +6330,8 @@ IO_NETOP_PREP_ASYNC(connect);
 IO_NETOP_PREP(accept);
 IO_NETOP_FN(send);
 IO_NETOP_FN(recv);
+IO_NETOP_PREP(sendzc);
+IO_NETOP_PREP(socket);
 #endif /* CONFIG_NET */
 
 struct io_poll_table {
@@ -5634,19 +6458,27 @@ static void io_poll_remove_entries(struct io_kiocb *req)
 	rcu_read_unlock();
 }
 
+enum {
+	IO_POLL_DONE		= 0,
+	IO_POLL_NO_ACTION	= 1,
+	IO_POLL_REMOVE_POLL_USE_RES = 2,
+};
+
 /*
  * All poll tw should go through this. Checks for poll events, manages
  * references, does rewait, etc.
  *
- * Returns a negative error on failure. >0 when no action require, which is
- * either spurious wakeup or multishot CQE is served. 0 when it's done with
- * the request, then the mask is stored in req->result.
+ * Returns a negative error on failure. IO_POLL_NO_ACTION when no action
+ * require, which is either spurious wakeup or multishot CQE is served.
+ * IO_POLL_DONE when it's done with the request, then the mask is stored in
+ * req->result. IO_POLL_REMOVE_POLL_USE_RES when a multishot request has
+ * finished, the final result is already in req->result.
  */
-static int io_poll_check_events(struct io_kiocb *req)
+static int io_poll_check_events(struct io_kiocb *req, bool *locked)
 {
 	struct io_ring_ctx *ctx = req->ctx;
 	struct io_poll_iocb *poll = io_poll_get_single(req);
-	int v;
+	int v, ret;
 
 	/* req->task == current here, checking PF_EXITING is safe */
 	if (unlikely(req->task->flags & PF_EXITING))
@@ -5657,7 +6489,7 @@ static int io_poll_check_events(struct io_kiocb *req)
 
 		/* tw handler should be the owner, and so have some references */
 		if (WARN_ON_ONCE(!(v & IO_POLL_REF_MASK)))
-			return 0;
+			return IO_POLL_DONE;
 		if (v & IO_POLL_CANCEL_FLAG)
 			return -ECANCELED;
 		/*
@@ -5686,19 +6518,25 @@ static int io_poll_check_events(struct io_kiocb *req)
 
 		/* multishot, just fill an CQE and proceed */
 		if (req->result && !(poll->events & EPOLLONESHOT)) {
-			__poll_t mask = mangle_poll(req->result & poll->events);
-			bool filled;
+			if (req->flags & REQ_F_APOLL_MULTISHOT) {
+				/* reissue, the request posts its own CQEs */
+				io_tw_lock(ctx, locked);
+				ret = io_issue_sqe(req, IO_URING_F_NONBLOCK |
+							IO_URING_F_MULTISHOT);
+				if (ret == IO_MULTISHOT_STOP)
+					return IO_POLL_REMOVE_POLL_USE_RES;
+				if (ret && ret != -EAGAIN)
+					return ret;
+			} else {
+				__poll_t mask = mangle_poll(req->result &
+							    poll->events);
 
-			spin_lock(&ctx->completion_lock);
-			filled = io_fill_cqe_aux(ctx, req->user_data, mask,
-						 IORING_CQE_F_MORE);
-			io_commit_cqring(ctx);
-			spin_unlock(&ctx->completion_lock);
-			if (unlikely(!filled))
-				return -ECANCELED;
-			io_cqring_ev_posted(ctx);
+				if (unlikely(!io_post_aux_cqe(ctx, req->user_data,
+							mask, IORING_CQE_F_MORE)))
+					return -ECANCELED;
+			}
 		} else if (req->result) {
-			return 0;
+			return IO_POLL_DONE;
 		}
 
 		/* force the next iteration to vfs_poll() */
@@ -5711,7 +6549,7 @@ static int io_poll_check_events(struct io_kiocb *req)
 	} while (atomic_sub_return(v & IO_POLL_REF_MASK, &req->poll_refs) &
 					IO_POLL_REF_MASK);
 
-	return 1;
+	return IO_POLL_NO_ACTION;
 }
 
 static void io_poll_task_func(struct io_kiocb *req, bool *locked)
@@ -5719,11 +6557,11 @@ static void io_poll_task_func(struct io_kiocb *req, bool *locked)
 	struct io_ring_ctx *ctx = req->ctx;
 	int ret;
 
-	ret = io_poll_check_events(req);
-	if (ret > 0)
+	ret = io_poll_check_events(req, locked);
+	if (ret == IO_POLL_NO_ACTION)
 		return;
 
-	if (!ret) {
+	if (ret == IO_POLL_DONE) {
 		req->result = mangle_poll(req->result & req->poll.events);
 	} else {
 		req->result = ret;
@@ -5742,8 +6580,8 @@ static void io_apoll_task_func(struct io_kiocb *req, bool *locked)
 	struct io_ring_ctx *ctx = req->ctx;
 	int ret;
 
-	ret = io_poll_check_events(req);
-	if (ret > 0)
+	ret = io_poll_check_events(req, locked);
+	if (ret == IO_POLL_NO_ACTION)
 		return;
 
 	io_tw_lock(req->ctx, locked);
@@ -5752,8 +6590,10 @@ static void io_apoll_task_func(struct io_kiocb *req, bool *locked)
 	hash_del(&req->hash_node);
 	spin_unlock(&ctx->completion_lock);
 
-	if (!ret)
+	if (ret == IO_POLL_DONE)
 		io_req_task_submit(req, locked);
+	else if (ret == IO_POLL_REMOVE_POLL_USE_RES)
+		io_req_complete_post(req, req->result, req->compl.cflags);
 	else
 		io_req_complete_failed(req, ret);
 }
@@ -5973,13 +6813,16 @@ static int io_arm_poll_handler(struct io_kiocb *req)
 	struct io_ring_ctx *ctx = req->ctx;
 	struct async_poll *apoll;
 	struct io_poll_table ipt;
-	__poll_t mask = EPOLLONESHOT | POLLERR | POLLPRI;
+	__poll_t mask = POLLERR | POLLPRI;
 	int ret;
 
 	if (!req->file || !file_can_poll(req->file))
 		return IO_APOLL_ABORTED;
 	if (!def->pollin && !def->pollout)
 		return IO_APOLL_ABORTED;
+	/* multishot requests stay armed and get reissued off every wakeup */
+	if (!(req->flags & REQ_F_APOLL_MULTISHOT))
+		mask |= EPOLLONESHOT;
 
 	if (def->pollin) {
 		mask |= POLLIN | POLLRDNORM;
@@ -6733,6 +7576,14 @@ static int io_req_prep(struct io_kiocb *req, const struct io_uring_sqe *sqe)
 		return io_symlinkat_prep(req, sqe);
 	case IORING_OP_LINKAT:
 		return io_linkat_prep(req, sqe);
+	case IORING_OP_MSG_RING:
+		return io_msg_ring_prep(req, sqe);
+	case IORING_OP_SEND_ZC:
+		return io_sendzc_prep(req, sqe);
+	case IORING_OP_URING_CMD:
+		return io_uring_cmd_prep(req, sqe);
+	case IORING_OP_SOCKET:
+		return io_socket_prep(req, sqe);
 	}
 
 	printk_once(KERN_WARNING "io_uring: unhandled opcode %d\n",
@@ -6760,6 +7611,8 @@ static int io_req_prep_async(struct io_kiocb *req)
 		return io_recvmsg_prep_async(req);
 	case IORING_OP_CONNECT:
 		return io_connect_prep_async(req);
+	case IORING_OP_URING_CMD:
+		return io_uring_cmd_prep_async(req);
 	}
 	printk_once(KERN_WARNING "io_uring: prep_async() bad opcode %d\n",
 		    req->opcode);
@@ -6853,7 +7706,8 @@ fail:
 
 static void io_clean_op(struct io_kiocb *req)
 {
-	if (req->flags & REQ_F_BUFFER_SELECTED) {
+	if ((req->flags & (REQ_F_BUFFER_SELECTED | REQ_F_BUFFER_RING)) ==
+	    REQ_F_BUFFER_SELECTED) {
 		switch (req->opcode) {
 		case IORING_OP_READV:
 		case IORING_OP_READ_FIXED:
@@ -6910,6 +7764,9 @@ static void io_clean_op(struct io_kiocb *req)
 			putname(req->hardlink.oldpath);
 			putname(req->hardlink.newpath);
 			break;
+		case IORING_OP_SEND_ZC:
+			io_notif_discard(req->sendzc.notif);
+			break;
 		}
 	}
 	if ((req->flags & REQ_F_POLLED) && req->apoll) {
@@ -7047,6 +7904,18 @@ static int io_issue_sqe(struct io_kiocb *req, unsigned int issue_flags)
 	case IORING_OP_LINKAT:
 		ret = io_linkat(req, issue_flags);
 		break;
+	case IORING_OP_SEND_ZC:
+		ret = io_sendzc(req, issue_flags);
+		break;
+	case IORING_OP_URING_CMD:
+		ret = io_uring_cmd(req, issue_flags);
+		break;
+	case IORING_OP_MSG_RING:
+		ret = io_msg_ring(req, issue_flags);
+		break;
+	case IORING_OP_SOCKET:
+		ret = io_socket(req, issue_flags);
+		break;
 	default:
 		ret = -EINVAL;
 		break;
@@ -7376,7 +8245,8 @@ static int io_init_req(struct io_ring_ctx *ctx, struct io_kiocb *req,
 	/* enforce forwards compatibility on users */
 	if (unlikely(sqe_flags & ~SQE_VALID_FLAGS))
 		return -EINVAL;
-	if (unlikely(req->opcode >= IORING_OP_LAST))
+	if (unlikely(req->opcode >= IORING_OP_LAST ||
+		     io_op_defs[req->opcode].not_supported))
 		return -EINVAL;
 	if (!io_check_restriction(ctx, req, sqe_flags))
 		return -EACCES;
@@ -7403,7 +8273,7 @@ static int io_init_req(struct io_ring_ctx *ctx, struct io_kiocb *req,
 	 */
 	if (!state->plug_started && state->ios_left > 1 &&
 	    io_op_defs[req->opcode].plug) {
-		blk_start_plug(&state->plug);
+		blk_start_plug_nr_ios(&state->plug, state->ios_left);
 		state->plug_started = true;
 	}
 
@@ -7561,8 +8431,12 @@ static const struct io_uring_sqe *io_get_sqe(struct io_ring_ctx *ctx)
 	 *    though the application is the one updating it.
 	 */
 	head = READ_ONCE(ctx->sq_array[sq_idx]);
-	if (likely(head < ctx->sq_entries))
+	if (likely(head < ctx->sq_entries)) {
+		/* double index for 128-byte SQEs, twice as long */
+		if (ctx->flags & IORING_SETUP_SQE128)
+			head <<= 1;
 		return &ctx->sq_sqes[head];
+	}
 
 	/* drop invalid entries */
 	spin_lock(&ctx->completion_lock);
@@ -7799,6 +8673,9 @@ struct io_wait_queue {
 	struct io_ring_ctx *ctx;
 	unsigned cq_tail;
 	unsigned nr_timeouts;
+	/* don't wake for completions before ->min_timeout, if set */
+	bool min_wait_pending;
+	ktime_t min_timeout;
 };
 
 static inline bool io_should_wake(struct io_wait_queue *iowq)
@@ -7822,13 +8699,53 @@ static int io_wake_function(struct wait_queue_entry *curr, unsigned int mode,
 
 	/*
 	 * Cannot safely flush overflowed CQEs from here, ensure we wake up
-	 * the task, and the next invocation will do it.
+	 * the task, and the next invocation will do it. Inside the min wait
+	 * window completions just accumulate, the timer ends it.
 	 */
-	if (io_should_wake(iowq) || test_bit(0, &iowq->ctx->check_cq_overflow))
+	if ((!READ_ONCE(iowq->min_wait_pending) && io_should_wake(iowq)) ||
+	    test_bit(0, &iowq->ctx->check_cq_overflow))
 		return autoremove_wake_function(curr, mode, wake_flags, key);
 	return -1;
 }
 
+static inline bool io_allowed_defer_tw_run(struct io_ring_ctx *ctx)
+{
+	return ctx->submitter_task == current;
+}
+
+static int io_run_local_work(struct io_ring_ctx *ctx)
+{
+	struct llist_node *node;
+	struct io_kiocb *req, *tmp;
+	bool locked;
+	int ret = 0;
+
+	if (llist_empty(&ctx->work_llist))
+		return 0;
+
+	locked = mutex_trylock(&ctx->uring_lock);
+	while ((node = llist_del_all(&ctx->work_llist)) != NULL) {
+		/* llist_add() pushes to the head, restore the queueing order */
+		node = llist_reverse_order(node);
+		llist_for_each_entry_safe(req, tmp, node,
+					  io_task_work.fallback_node) {
+			req->io_task_work.func(req, &locked);
+			ret++;
+		}
+		if (unlikely(need_resched())) {
+			if (locked)
+				break;
+			cond_resched();
+		}
+	}
+	if (locked) {
+		if (ctx->submit_state.compl_nr)
+			io_submit_flush_completions(ctx);
+		mutex_unlock(&ctx->uring_lock);
+	}
+	return ret;
+}
+
 static int io_run_task_work_sig(void)
 {
 	if (io_run_task_work())
@@ -7858,11 +8775,16 @@ static inline int io_cqring_wait_schedule(struct io_ring_ctx *ctx,
 
 	/* make sure we run task_work before checking for signals */
 	ret = io_run_task_work_sig();
-	if (ret || io_should_wake(iowq))
+	if (ret)
 		return ret;
+	if (!iowq->min_wait_pending && io_should_wake(iowq))
+		return 0;
 	/* let the caller flush overflows, retry */
 	if (test_bit(0, &ctx->check_cq_overflow))
 		return 1;
+	/* deferred task_work got queued, run it and recheck */
+	if (!llist_empty(&ctx->work_llist))
+		return 1;
 
 	/*
 	 * Mark us as being in io_wait if we have pending requests, so cpufreq
@@ -7872,8 +8794,13 @@ static inline int io_cqring_wait_schedule(struct io_ring_ctx *ctx,
 	if (current_pending_io())
 		current->in_iowait = 1;
 	ret = 1;
-	if (!schedule_hrtimeout(timeout, HRTIMER_MODE_ABS))
+	if (iowq->min_wait_pending) {
+		/* window over, from now on wake as usual and recheck */
+		if (!schedule_hrtimeout(&iowq->min_timeout, HRTIMER_MODE_ABS))
+			WRITE_ONCE(iowq->min_wait_pending, false);
+	} else if (!schedule_hrtimeout(timeout, HRTIMER_MODE_ABS)) {
 		ret = -ETIME;
+	}
 	current->in_iowait = 0;
 	return ret;
 }
@@ -7884,7 +8811,7 @@ static inline int io_cqring_wait_schedule(struct io_ring_ctx *ctx,
  */
 static int io_cqring_wait(struct io_ring_ctx *ctx, int min_events,
 			  const sigset_t __user *sig, size_t sigsz,
-			  struct __kernel_timespec __user *uts)
+			  struct __kernel_timespec __user *uts, u32 min_wait_usec)
 {
 	struct io_wait_queue iowq;
 	struct io_rings *rings = ctx->rings;
@@ -7895,7 +8822,7 @@ static int io_cqring_wait(struct io_ring_ctx *ctx, int min_events,
 		io_cqring_overflow_flush(ctx);
 		if (io_cqring_events(ctx) >= min_events)
 			return 0;
-		if (!io_run_task_work())
+		if (!io_run_task_work() && !io_run_local_work(ctx))
 			break;
 	} while (1);
 
@@ -7926,6 +8853,14 @@ static int io_cqring_wait(struct io_ring_ctx *ctx, int min_events,
 	iowq.ctx = ctx;
 	iowq.nr_timeouts = atomic_read(&ctx->cq_timeouts);
 	iowq.cq_tail = READ_ONCE(ctx->rings->cq.head) + min_events;
+	iowq.min_wait_pending = false;
+	if (min_wait_usec) {
+		/* never sleep past the overall timeout */
+		iowq.min_timeout = ktime_add_us(ktime_get(), min_wait_usec);
+		if (ktime_after(iowq.min_timeout, timeout))
+			iowq.min_timeout = timeout;
+		iowq.min_wait_pending = true;
+	}
 
 	trace_io_uring_cqring_wait(ctx, min_events);
 	do {
@@ -7934,6 +8869,7 @@ static int io_cqring_wait(struct io_ring_ctx *ctx, int min_events,
 			ret = -EBUSY;
 			break;
 		}
+		io_run_local_work(ctx);
 		prepare_to_wait_exclusive(&ctx->cq_wait, &iowq.wq,
 						TASK_INTERRUPTIBLE);
 		ret = io_cqring_wait_schedule(ctx, &iowq, &timeout);
@@ -8174,13 +9110,58 @@ static bool io_alloc_file_tables(struct io_file_table *table, unsigned nr_files)
 {
 	table->files = kvcalloc(nr_files, sizeof(table->files[0]),
 				GFP_KERNEL_ACCOUNT);
-	return !!table->files;
+	if (unlikely(!table->files))
+		return false;
+
+	table->bitmap = bitmap_zalloc(nr_files, GFP_KERNEL_ACCOUNT);
+	if (unlikely(!table->bitmap)) {
+		kvfree(table->files);
+		table->files = NULL;
+		return false;
+	}
+	table->alloc_hint = 0;
+	return true;
 }
 
 static void io_free_file_tables(struct io_file_table *table)
 {
 	kvfree(table->files);
+	bitmap_free(table->bitmap);
 	table->files = NULL;
+	table->bitmap = NULL;
+}
+
+static inline void io_file_bitmap_set(struct io_file_table *table, int bit)
+{
+	WARN_ON_ONCE(test_bit(bit, table->bitmap));
+	__set_bit(bit, table->bitmap);
+	table->alloc_hint = bit + 1;
+}
+
+static inline void io_file_bitmap_clear(struct io_file_table *table, int bit)
+{
+	__clear_bit(bit, table->bitmap);
+	table->alloc_hint = bit;
+}
+
+/* find a free fixed file slot, starting at the last one used or freed */
+static int io_file_bitmap_get(struct io_ring_ctx *ctx)
+{
+	struct io_file_table *table = &ctx->file_table;
+	unsigned long nr = ctx->nr_user_files;
+	int ret;
+
+	do {
+		ret = find_next_zero_bit(table->bitmap, nr, table->alloc_hint);
+		if (ret != nr)
+			return ret;
+		if (!table->alloc_hint)
+			break;
+		nr = table->alloc_hint;
+		table->alloc_hint = 0;
+	} while (1);
+
+	return -ENFILE;
 }
 
 static void __io_sqe_files_unregister(struct io_ring_ctx *ctx)
@@ -8458,6 +9439,7 @@ static int io_sqe_files_register(struct io_ring_ctx *ctx, void __user *arg,
 			goto out_fput;
 		}
 		io_fixed_file_set(io_fixed_file_slot(&ctx->file_table, i), file);
+		io_file_bitmap_set(&ctx->file_table, i);
 	}
 
 	io_rsrc_node_switch(ctx, NULL);
@@ -8493,24 +9475,37 @@ static int io_queue_rsrc_removal(struct io_rsrc_data *data, unsigned idx,
 	return 0;
 }
 
-static int io_install_fixed_file(struct io_kiocb *req, struct file *file,
-				 unsigned int issue_flags, u32 slot_index)
+/*
+ * Install @file into the fixed file table, replacing what was there.
+ * @file_index is the 1-based sqe->file_index, or IORING_FILE_INDEX_ALLOC to
+ * pick a free slot, in which case the chosen index is returned.
+ * Called with ->uring_lock held, the caller still owns @file on error.
+ */
+static int __io_install_fixed_file(struct io_ring_ctx *ctx, struct file *file,
+				   u32 file_index)
 {
-	struct io_ring_ctx *ctx = req->ctx;
-	bool force_nonblock = issue_flags & IO_URING_F_NONBLOCK;
+	bool alloc_slot = file_index == IORING_FILE_INDEX_ALLOC;
 	bool needs_switch = false;
 	struct io_fixed_file *file_slot;
+	u32 slot_index;
 	int ret = -EBADF;
 
-	io_ring_submit_lock(ctx, !force_nonblock);
 	if (file->f_op == &io_uring_fops)
 		goto err;
 	ret = -ENXIO;
 	if (!ctx->file_data)
 		goto err;
-	ret = -EINVAL;
-	if (slot_index >= ctx->nr_user_files)
-		goto err;
+	if (alloc_slot) {
+		ret = io_file_bitmap_get(ctx);
+		if (ret < 0)
+			goto err;
+		slot_index = ret;
+	} else {
+		slot_index = file_index - 1;
+		ret = -EINVAL;
+		if (slot_index >= ctx->nr_user_files)
+			goto err;
+	}
 
 	slot_index = array_index_nospec(slot_index, ctx->nr_user_files);
 	file_slot = io_fixed_file_slot(&ctx->file_table, slot_index);
@@ -8528,17 +9523,31 @@ static int io_install_fixed_file(struct io_kiocb *req, struct file *file,
 		if (ret)
 			goto err;
 		file_slot->file_ptr = 0;
+		io_file_bitmap_clear(&ctx->file_table, slot_index);
 		needs_switch = true;
 	}
 
 	*io_get_tag_slot(ctx->file_data, slot_index) = 0;
 	io_fixed_file_set(file_slot, file);
-	ret = 0;
+	io_file_bitmap_set(&ctx->file_table, slot_index);
+	ret = alloc_slot ? slot_index : 0;
 err:
 	if (needs_switch)
 		io_rsrc_node_switch(ctx, ctx->file_data);
+	return ret;
+}
+
+static int io_install_fixed_file(struct io_kiocb *req, struct file *file,
+				 unsigned int issue_flags, u32 file_index)
+{
+	struct io_ring_ctx *ctx = req->ctx;
+	bool force_nonblock = issue_flags & IO_URING_F_NONBLOCK;
+	int ret;
+
+	io_ring_submit_lock(ctx, !force_nonblock);
+	ret = __io_install_fixed_file(ctx, file, file_index);
 	io_ring_submit_unlock(ctx, !force_nonblock);
-	if (ret)
+	if (ret < 0)
 		fput(file);
 	return ret;
 }
@@ -8574,6 +9583,7 @@ static int io_close_fixed(struct io_kiocb *req, unsigned int issue_flags)
 		goto out;
 
 	file_slot->file_ptr = 0;
+	io_file_bitmap_clear(&ctx->file_table, offset);
 	io_rsrc_node_switch(ctx, ctx->file_data);
 	ret = 0;
 out:
@@ -8623,6 +9633,7 @@ static int __io_sqe_files_update(struct io_ring_ctx *ctx,
 			if (err)
 				break;
 			file_slot->file_ptr = 0;
+			io_file_bitmap_clear(&ctx->file_table, i);
 			needs_switch = true;
 		}
 		if (fd != -1) {
@@ -8646,6 +9657,7 @@ static int __io_sqe_files_update(struct io_ring_ctx *ctx,
 			}
 			*io_get_tag_slot(data, i) = tag;
 			io_fixed_file_set(file_slot, file);
+			io_file_bitmap_set(&ctx->file_table, i);
 		}
 	}
 
@@ -8900,8 +9912,8 @@ static void *io_mem_alloc(size_t size)
 	return (void *) __get_free_pages(gfp, get_order(size));
 }
 
-static unsigned long rings_size(unsigned sq_entries, unsigned cq_entries,
-				size_t *sq_offset)
+static unsigned long rings_size(struct io_ring_ctx *ctx, unsigned sq_entries,
+				unsigned cq_entries, size_t *sq_offset)
 {
 	struct io_rings *rings;
 	size_t off, sq_array_size;
@@ -8909,6 +9921,10 @@ static unsigned long rings_size(unsigned sq_entries, unsigned cq_entries,
 	off = struct_size(rings, cqes, cq_entries);
 	if (off == SIZE_MAX)
 		return SIZE_MAX;
+	if (ctx->flags & IORING_SETUP_CQE32) {
+		if (check_shl_overflow(off, 1, &off))
+			return SIZE_MAX;
+	}
 
 #ifdef CONFIG_SMP
 	off = ALIGN(off, SMP_CACHE_BYTES);
@@ -9355,13 +10371,143 @@ static int io_eventfd_unregister(struct io_ring_ctx *ctx)
 	return -ENXIO;
 }
 
+static void io_free_pbuf_ring(struct io_ring_ctx *ctx,
+			      struct io_buffer_list *bl)
+{
+	vunmap(bl->buf_ring);
+	unpin_user_pages(bl->buf_pages, bl->buf_nr_pages);
+	io_unaccount_mem(ctx, bl->buf_nr_pages);
+	kvfree(bl->buf_pages);
+	kfree(bl);
+}
+
+static int io_pin_pbuf_ring(struct io_ring_ctx *ctx,
+			    struct io_uring_buf_reg *reg,
+			    struct io_buffer_list *bl)
+{
+	unsigned long ring_size, end;
+	struct page **pages;
+	void *ptr;
+	int nr_pages, pret, ret;
+
+	ring_size = reg->ring_entries * sizeof(struct io_uring_buf);
+	if (check_add_overflow((unsigned long)reg->ring_addr, ring_size, &end))
+		return -EOVERFLOW;
+	nr_pages = (PAGE_ALIGN(end) - reg->ring_addr) >> PAGE_SHIFT;
+
+	pages = kvmalloc_array(nr_pages, sizeof(struct page *), GFP_KERNEL);
+	if (!pages)
+		return -ENOMEM;
+
+	pret = pin_user_pages_fast(reg->ring_addr, nr_pages,
+				   FOLL_WRITE | FOLL_LONGTERM, pages);
+	if (pret != nr_pages) {
+		ret = pret < 0 ? pret : -EFAULT;
+		goto err_unpin;
+	}
+
+	ret = io_account_mem(ctx, nr_pages);
+	if (ret)
+		goto err_unpin;
+
+	/* the ring may span several pages, give it one contiguous mapping */
+	ptr = vmap(pages, nr_pages, VM_MAP, PAGE_KERNEL);
+	if (!ptr) {
+		ret = -ENOMEM;
+		io_unaccount_mem(ctx, nr_pages);
+		goto err_unpin;
+	}
+
+	bl->buf_ring = ptr;
+	bl->buf_pages = pages;
+	bl->buf_nr_pages = nr_pages;
+	return 0;
+err_unpin:
+	if (pret > 0)
+		unpin_user_pages(pages, pret);
+	kvfree(pages);
+	return ret;
+}
+
+static int io_register_pbuf_ring(struct io_ring_ctx *ctx, void __user *arg)
+	__must_hold(&ctx->uring_lock)
+{
+	struct io_uring_buf_reg reg;
+	struct io_buffer_list *bl;
+	int ret;
+
+	if (copy_from_user(&reg, arg, sizeof(reg)))
+		return -EFAULT;
+	if (reg.pad || reg.resv[0] || reg.resv[1] || reg.resv[2])
+		return -EINVAL;
+	if (!reg.ring_addr)
+		return -EFAULT;
+	if (reg.ring_addr & ~PAGE_MASK)
+		return -EINVAL;
+	if (!is_power_of_2(reg.ring_entries))
+		return -EINVAL;
+	/* head and tail are u16, can't tell a full ring from an empty one */
+	if (reg.ring_entries >= 65536)
+		return -EINVAL;
+
+	if (xa_load(&ctx->io_buffers, reg.bgid) ||
+	    xa_load(&ctx->io_buf_rings, reg.bgid))
+		return -EEXIST;
+
+	bl = kzalloc(sizeof(*bl), GFP_KERNEL_ACCOUNT);
+	if (!bl)
+		return -ENOMEM;
+
+	ret = io_pin_pbuf_ring(ctx, &reg, bl);
+	if (ret) {
+		kfree(bl);
+		return ret;
+	}
+
+	bl->bgid = reg.bgid;
+	bl->mask = reg.ring_entries - 1;
+	ret = xa_err(xa_store(&ctx->io_buf_rings, reg.bgid, bl,
+			      GFP_KERNEL_ACCOUNT));
+	if (ret)
+		io_free_pbuf_ring(ctx, bl);
+	return ret;
+}
+
+static int io_unregister_pbuf_ring(struct io_ring_ctx *ctx, void __user *arg)
+	__must_hold(&ctx->uring_lock)
+{
+	struct io_uring_buf_reg reg;
+	struct io_buffer_list *bl;
+
+	if (copy_from_user(&reg, arg, sizeof(reg)))
+		return -EFAULT;
+	if (reg.pad || reg.resv[0] || reg.resv[1] || reg.resv[2])
+		return -EINVAL;
+
+	/*
+	 * Requests copy out what they selected and never look at the ring
+	 * again, so there is nothing inflight that could still reference it.
+	 */
+	bl = xa_erase(&ctx->io_buf_rings, reg.bgid);
+	if (!bl)
+		return -ENOENT;
+	io_free_pbuf_ring(ctx, bl);
+	return 0;
+}
+
 static void io_destroy_buffers(struct io_ring_ctx *ctx)
 {
+	struct io_buffer_list *bl;
 	struct io_buffer *buf;
 	unsigned long index;
 
 	xa_for_each(&ctx->io_buffers, index, buf)
 		__io_remove_buffers(ctx, buf, index, -1U);
+
+	xa_for_each(&ctx->io_buf_rings, index, bl) {
+		xa_erase(&ctx->io_buf_rings, index);
+		io_free_pbuf_ring(ctx, bl);
+	}
 }
 
 static void io_req_cache_free(struct list_head *list)
@@ -9416,6 +10562,8 @@ static void io_ring_ctx_free(struct io_ring_ctx *ctx)
 	io_destroy_buffers(ctx);
 	if (ctx->sq_creds)
 		put_cred(ctx->sq_creds);
+	if (ctx->submitter_task)
+		put_task_struct(ctx->submitter_task);
 
 	/* there are no registered resources left, nobody uses it */
 	if (ctx->rsrc_node)
@@ -9539,6 +10687,8 @@ static void io_ring_exit_work(struct work_struct *work)
 	 * as nobody else will be looking for them.
 	 */
 	do {
+		if (ctx->flags & IORING_SETUP_DEFER_TASKRUN)
+			io_move_task_work_from_local(ctx);
 		io_uring_try_cancel_requests(ctx, NULL, true);
 		if (ctx->sq_data) {
 			struct io_sq_data *sqd = ctx->sq_data;
@@ -9769,6 +10919,9 @@ static void io_uring_try_cancel_requests(struct io_ring_ctx *ctx,
 		ret |= io_kill_timeouts(ctx, task, cancel_all);
 		if (task)
 			ret |= io_run_task_work();
+		if ((ctx->flags & IORING_SETUP_DEFER_TASKRUN) &&
+		    io_allowed_defer_tw_run(ctx))
+			ret |= io_run_local_work(ctx) > 0;
 		if (!ret)
 			break;
 		cond_resched();
@@ -10050,7 +11203,7 @@ static int io_sqpoll_wait_sq(struct io_ring_ctx *ctx)
 
 static int io_get_ext_arg(unsigned flags, const void __user *argp, size_t *argsz,
 			  struct __kernel_timespec __user **ts,
-			  const sigset_t __user **sig)
+			  const sigset_t __user **sig, u32 *min_wait_usec)
 {
 	struct io_uring_getevents_arg arg;
 
@@ -10061,6 +11214,7 @@ static int io_get_ext_arg(unsigned flags, const void __user *argp, size_t *argsz
 	if (!(flags & IORING_ENTER_EXT_ARG)) {
 		*sig = (const sigset_t __user *) argp;
 		*ts = NULL;
+		*min_wait_usec = 0;
 		return 0;
 	}
 
@@ -10072,11 +11226,10 @@ static int io_get_ext_arg(unsigned flags, const void __user *argp, size_t *argsz
 		return -EINVAL;
 	if (copy_from_user(&arg, argp, sizeof(arg)))
 		return -EFAULT;
-	if (arg.pad)
-		return -EINVAL;
 	*sig = u64_to_user_ptr(arg.sigmask);
 	*argsz = arg.sigmask_sz;
 	*ts = u64_to_user_ptr(arg.ts);
+	*min_wait_usec = arg.min_wait_usec;
 	return 0;
 }
 
@@ -10134,6 +11287,10 @@ SYSCALL_DEFINE6(io_uring_enter, unsigned int, fd, u32, to_submit,
 		}
 		submitted = to_submit;
 	} else if (to_submit) {
+		ret = -EEXIST;
+		if (unlikely((ctx->flags & IORING_SETUP_SINGLE_ISSUER) &&
+			     ctx->submitter_task != current))
+			goto out;
 		ret = io_uring_add_tctx_node(ctx);
 		if (unlikely(ret))
 			goto out;
@@ -10147,11 +11304,21 @@ SYSCALL_DEFINE6(io_uring_enter, unsigned int, fd, u32, to_submit,
 	if (flags & IORING_ENTER_GETEVENTS) {
 		const sigset_t __user *sig;
 		struct __kernel_timespec __user *ts;
+		u32 min_wait_usec;
 
-		ret = io_get_ext_arg(flags, argp, &argsz, &ts, &sig);
+		ret = io_get_ext_arg(flags, argp, &argsz, &ts, &sig,
+				     &min_wait_usec);
 		if (unlikely(ret))
 			goto out;
 
+		/* deferred task_work can only be run by the submitter */
+		if (ctx->flags & IORING_SETUP_DEFER_TASKRUN) {
+			ret = -EEXIST;
+			if (!io_allowed_defer_tw_run(ctx))
+				goto out;
+			io_run_local_work(ctx);
+		}
+
 		min_complete = min(min_complete, ctx->cq_entries);
 
 		/*
@@ -10164,7 +11331,8 @@ SYSCALL_DEFINE6(io_uring_enter, unsigned int, fd, u32, to_submit,
 		    !(ctx->flags & IORING_SETUP_SQPOLL)) {
 			ret = io_iopoll_check(ctx, min_complete);
 		} else {
-			ret = io_cqring_wait(ctx, min_complete, sig, argsz, ts);
+			ret = io_cqring_wait(ctx, min_complete, sig, argsz, ts,
+					     min_wait_usec);
 		}
 	}
 
@@ -10271,8 +11439,21 @@ static void __io_uring_show_fdinfo(struct io_ring_ctx *ctx, struct seq_file *m)
 					req->task->task_works != NULL);
 	}
 	spin_unlock(&ctx->completion_lock);
-	if (has_lock)
+	if (has_lock) {
+		struct io_tctx_node *node;
+
+		/* a node on ->tctx_list pins the task's io-wq, see clean_tctx */
+		list_for_each_entry(node, &ctx->tctx_list, ctx_node) {
+			struct io_uring_task *tctx = node->task->io_uring;
+
+			if (!tctx || !tctx->io_wq)
+				continue;
+			seq_printf(m, "IoWq (pid %d):\n",
+				   task_pid_nr(node->task));
+			io_wq_show_fdinfo(tctx->io_wq, m);
+		}
 		mutex_unlock(&ctx->uring_lock);
+	}
 }
 
 static void io_uring_show_fdinfo(struct seq_file *m, struct file *f)
@@ -10314,7 +11495,7 @@ static int io_allocate_scq_urings(struct io_ring_ctx *ctx,
 	ctx->sq_entries = p->sq_entries;
 	ctx->cq_entries = p->cq_entries;
 
-	size = rings_size(p->sq_entries, p->cq_entries, &sq_array_offset);
+	size = rings_size(ctx, p->sq_entries, p->cq_entries, &sq_array_offset);
 	if (size == SIZE_MAX)
 		return -EOVERFLOW;
 
@@ -10329,7 +11510,11 @@ static int io_allocate_scq_urings(struct io_ring_ctx *ctx,
 	rings->sq_ring_entries = p->sq_entries;
 	rings->cq_ring_entries = p->cq_entries;
 
-	size = array_size(sizeof(struct io_uring_sqe), p->sq_entries);
+	if (p->flags & IORING_SETUP_SQE128)
+		size = array_size(2 * sizeof(struct io_uring_sqe),
+				  p->sq_entries);
+	else
+		size = array_size(sizeof(struct io_uring_sqe), p->sq_entries);
 	if (size == SIZE_MAX) {
 		io_mem_free(ctx->rings);
 		ctx->rings = NULL;
@@ -10389,6 +11574,15 @@ static int io_uring_create(unsigned entries, struct io_uring_params *p,
 		entries = IORING_MAX_ENTRIES;
 	}
 
+	/*
+	 * Deferred task_work is only ever run by the submitter task, which
+	 * must be known and can't be the SQPOLL thread.
+	 */
+	if ((p->flags & IORING_SETUP_DEFER_TASKRUN) &&
+	    (!(p->flags & IORING_SETUP_SINGLE_ISSUER) ||
+	     (p->flags & IORING_SETUP_SQPOLL)))
+		return -EINVAL;
+
 	/*
 	 * Use twice as many entries for the CQ ring. It's possible for the
 	 * application to drive a higher depth than the size of the SQ ring,
@@ -10424,6 +11618,9 @@ static int io_uring_create(unsigned entries, struct io_uring_params *p,
 	ctx->compat = in_compat_syscall();
 	if (!ns_capable_noaudit(&init_user_ns, CAP_IPC_LOCK))
 		ctx->user = get_uid(current_user());
+	if ((ctx->flags & IORING_SETUP_SINGLE_ISSUER) &&
+	    !(ctx->flags & IORING_SETUP_R_DISABLED))
+		ctx->submitter_task = get_task_struct(current);
 
 	/*
 	 * This is just grabbed for accounting purposes. When a process exits,
@@ -10470,7 +11667,7 @@ static int io_uring_create(unsigned entries, struct io_uring_params *p,
 			IORING_FEAT_CUR_PERSONALITY | IORING_FEAT_FAST_POLL |
 			IORING_FEAT_POLL_32BITS | IORING_FEAT_SQPOLL_NONFIXED |
 			IORING_FEAT_EXT_ARG | IORING_FEAT_NATIVE_WORKERS |
-			IORING_FEAT_RSRC_TAGS;
+			IORING_FEAT_RSRC_TAGS | IORING_FEAT_MIN_TIMEOUT;
 
 	if (copy_to_user(params, p, sizeof(*p))) {
 		ret = -EFAULT;
@@ -10521,7 +11718,9 @@ static long io_uring_setup(u32 entries, struct io_uring_params __user *params)
 	if (p.flags & ~(IORING_SETUP_IOPOLL | IORING_SETUP_SQPOLL |
 			IORING_SETUP_SQ_AFF | IORING_SETUP_CQSIZE |
 			IORING_SETUP_CLAMP | IORING_SETUP_ATTACH_WQ |
-			IORING_SETUP_R_DISABLED))
+			IORING_SETUP_R_DISABLED | IORING_SETUP_SQE128 |
+			IORING_SETUP_CQE32 | IORING_SETUP_SINGLE_ISSUER |
+			IORING_SETUP_DEFER_TASKRUN))
 		return -EINVAL;
 
 	return  io_uring_create(entries, &p, params);
@@ -10685,6 +11884,9 @@ static int io_register_enable_rings(struct io_ring_ctx *ctx)
 	if (!(ctx->flags & IORING_SETUP_R_DISABLED))
 		return -EBADFD;
 
+	if ((ctx->flags & IORING_SETUP_SINGLE_ISSUER) && !ctx->submitter_task)
+		ctx->submitter_task = get_task_struct(current);
+
 	if (ctx->restrictions.registered)
 		ctx->restricted = 1;
 
@@ -10923,6 +12125,8 @@ static bool io_register_op_must_quiesce(int op)
 	case IORING_REGISTER_IOWQ_AFF:
 	case IORING_UNREGISTER_IOWQ_AFF:
 	case IORING_REGISTER_IOWQ_MAX_WORKERS:
+	case IORING_REGISTER_PBUF_RING:
+	case IORING_UNREGISTER_PBUF_RING:
 		return false;
 	default:
 		return true;
@@ -11083,6 +12287,18 @@ static int __io_uring_register(struct io_ring_ctx *ctx, unsigned opcode,
 			break;
 		ret = io_register_iowq_max_workers(ctx, arg);
 		break;
+	case IORING_REGISTER_PBUF_RING:
+		ret = -EINVAL;
+		if (!arg || nr_args != 1)
+			break;
+		ret = io_register_pbuf_ring(ctx, arg);
+		break;
+	case IORING_UNREGISTER_PBUF_RING:
+		ret = -EINVAL;
+		if (!arg || nr_args != 1)
+			break;
+		ret = io_unregister_pbuf_ring(ctx, arg);
+		break;
 	default:
 		ret = -EINVAL;
 		break;
@@ -11144,6 +12360,7 @@ static int __init io_uring_init(void)
 	BUILD_BUG_SQE_ELEM(4,  __s32,  fd);
 	BUILD_BUG_SQE_ELEM(8,  __u64,  off);
 	BUILD_BUG_SQE_ELEM(8,  __u64,  addr2);
+	BUILD_BUG_SQE_ELEM(8,  __u32,  cmd_op);
 	BUILD_BUG_SQE_ELEM(16, __u64,  addr);
 	BUILD_BUG_SQE_ELEM(16, __u64,  splice_off_in);
 	BUILD_BUG_SQE_ELEM(24, __u32,  len);
@@ -11168,6 +12385,8 @@ static int __init io_uring_init(void)
 	BUILD_BUG_SQE_ELEM(42, __u16,  personality);
 	BUILD_BUG_SQE_ELEM(44, __s32,  splice_fd_in);
 	BUILD_BUG_SQE_ELEM(44, __u32,  file_index);
+	BUILD_BUG_SQE_ELEM(48, __u64,  addr3);
+	BUILD_BUG_SQE_ELEM(48, __u8,   cmd);
 
 	BUILD_BUG_ON(sizeof(struct io_uring_files_update) !=
 		     sizeof(struct io_uring_rsrc_update));
@@ -11181,6 +12400,8 @@ static int __init io_uring_init(void)
 	BUILD_BUG_ON(SQE_VALID_FLAGS >= (1 << 8));
 
 	BUILD_BUG_ON(ARRAY_SIZE(io_op_defs) != IORING_OP_LAST);
+	/* don't grow the per-op union of struct io_kiocb */
+	BUILD_BUG_ON(sizeof(struct io_uring_cmd) > 64);
 	BUILD_BUG_ON(__REQ_F_LAST_BIT > 8 * sizeof(int));
 
 	req_cachep = KMEM_CACHE(io_kiocb, SLAB_HWCACHE_ALIGN | SLAB_PANIC |
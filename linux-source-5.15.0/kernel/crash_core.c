@@ -7,6 +7,7 @@
 #include <linux/buildid.h>
 #include <linux/crash_core.h>
 #include <linux/init.h>
+#include <linux/pgtable.h>
 #include <linux/utsname.h>
 #include <linux/vmalloc.h>
 
@@ -418,7 +419,9 @@ static int __init crash_save_vmcoreinfo_init(void)
 	VMCOREINFO_SYMBOL_ARRAY(swapper_pg_dir);
 #endif
 	VMCOREINFO_SYMBOL(_stext);
-	VMCOREINFO_SYMBOL(vmap_area_list);
+#ifdef CONFIG_MMU
+	VMCOREINFO_ADDRESS(VMALLOC_START);
+#endif
 
 #ifndef CONFIG_NUMA
 	VMCOREINFO_SYMBOL(mem_map);
@@ -50,6 +50,8 @@ __param(int, run_test_mask, INT_MAX,
 		"\t\tid: 128,  name: pcpu_alloc_test\n"
 		"\t\tid: 256,  name: kvfree_rcu_1_arg_vmalloc_test\n"
 		"\t\tid: 512,  name: kvfree_rcu_2_arg_vmalloc_test\n"
+		"\t\tid: 1024, name: vm_map_ram_test\n"
+		"\t\tid: 2048, name: batch_small_size_alloc_test\n"
 		/* Add a new test case description here. */
 );
 
@@ -357,6 +359,80 @@ kvfree_rcu_2_arg_vmalloc_test(void)
 	return 0;
 }
 
+static int
+vm_map_ram_test(void)
+{
+	unsigned long nr_allocated;
+	unsigned int map_nr_pages;
+	unsigned char *v_ptr;
+	struct page **pages;
+	int i, rv = -1;
+
+	map_nr_pages = nr_pages > 0 ? nr_pages:1;
+	pages = kcalloc(map_nr_pages, sizeof(struct page *), GFP_KERNEL);
+	if (!pages)
+		return -1;
+
+	nr_allocated = alloc_pages_bulk_array(GFP_KERNEL, map_nr_pages, pages);
+	if (nr_allocated != map_nr_pages)
+		goto cleanup;
+
+	for (i = 0; i < test_loop_count; i++) {
+		v_ptr = vm_map_ram(pages, map_nr_pages, NUMA_NO_NODE);
+		if (!v_ptr)
+			goto cleanup;
+
+		*v_ptr = 'a';
+		vm_unmap_ram(v_ptr, map_nr_pages);
+	}
+
+	/* Success */
+	rv = 0;
+
+cleanup:
+	for (i = 0; i < nr_allocated; i++)
+		__free_page(pages[i]);
+
+	kfree(pages);
+	return rv;
+}
+
+/*
+ * Keep a batch of small areas of random size alive at a time, so
+ * that the busy and lazy trees stay populated while many workers
+ * allocate and free concurrently.
+ */
+#define SMALL_SIZE_BATCH 64
+
+static int
+batch_small_size_alloc_test(void)
+{
+	void *ptr[SMALL_SIZE_BATCH];
+	unsigned int n;
+	int i, j, nr;
+
+	for (i = 0; i < test_loop_count; i += SMALL_SIZE_BATCH) {
+		for (nr = 0; nr < SMALL_SIZE_BATCH; nr++) {
+			get_random_bytes(&n, sizeof(n));
+			n = (n % 16) + 1;
+
+			ptr[nr] = vmalloc(n * PAGE_SIZE);
+			if (!ptr[nr])
+				break;
+
+			*((__u8 *)ptr[nr]) = 1;
+		}
+
+		for (j = 0; j < nr; j++)
+			vfree(ptr[j]);
+
+		if (nr != SMALL_SIZE_BATCH)
+			return -1;
+	}
+
+	return 0;
+}
+
 struct test_case_desc {
 	const char *test_name;
 	int (*test_func)(void);
@@ -373,6 +449,8 @@ static struct test_case_desc test_case_array[] = {
 	{ "pcpu_alloc_test", pcpu_alloc_test },
 	{ "kvfree_rcu_1_arg_vmalloc_test", kvfree_rcu_1_arg_vmalloc_test },
 	{ "kvfree_rcu_2_arg_vmalloc_test", kvfree_rcu_2_arg_vmalloc_test },
+	{ "vm_map_ram_test", vm_map_ram_test },
+	{ "batch_small_size_alloc_test", batch_small_size_alloc_test },
 	/* Add a new test case here. */
 };
 
@@ -558,6 +636,37 @@ static void do_concurrent_test(void)
 			i, t->stop - t->start);
 	}
 
+	/*
+	 * Summarize every test over all workers, so that runs with a
+	 * different nr_threads can be compared to see how it scales.
+	 */
+	for (i = 0; i < ARRAY_SIZE(test_case_array); i++) {
+		u64 avg_usec = 0, max_usec = 0;
+		int j, nr_workers = 0;
+
+		if (!((run_test_mask & (1 << i)) >> i))
+			continue;
+
+		for (j = 0; j < nr_threads; j++) {
+			struct test_driver *t = &tdriver[j];
+
+			if (IS_ERR(t->task))
+				continue;
+
+			avg_usec += t->data[i].time;
+			max_usec = max(max_usec, t->data[i].time);
+			nr_workers++;
+		}
+
+		if (!nr_workers)
+			continue;
+
+		do_div(avg_usec, (u32) nr_workers);
+		pr_info("Scalability: %s workers: %d avg: %llu usec max: %llu usec\n",
+			test_case_array[i].test_name, nr_workers,
+			avg_usec, max_usec);
+	}
+
 	kvfree(tdriver);
 }
 
@@ -62,6 +62,7 @@
 #include <linux/tracehook.h>
 #include <linux/psi.h>
 #include <linux/seq_buf.h>
+#include <linux/random.h>
 #include "internal.h"
 #include <net/sock.h>
 #include <net/ip.h>
@@ -2126,9 +2127,17 @@ struct obj_stock {
 #endif
 };
 
+/*
+ * Number of memcgs whose charges are cached on each cpu. A cpu is usually
+ * shared by tasks from many cgroups, so a single cached memcg would be
+ * replaced, and its charge returned, on nearly every switch between them.
+ */
+#define NR_MEMCG_STOCK 7
+
 struct memcg_stock_pcp {
-	struct mem_cgroup *cached; /* this never be root cgroup */
-	unsigned int nr_pages;
+	/* these are never the root cgroup */
+	struct mem_cgroup *cached[NR_MEMCG_STOCK];
+	unsigned int nr_pages[NR_MEMCG_STOCK];
 	struct obj_stock task_obj;
 	struct obj_stock irq_obj;
 
@@ -2195,9 +2204,9 @@ static inline void put_obj_stock(unsigned long flags)
  * @memcg: memcg to consume from.
  * @nr_pages: how many pages to charge.
  *
- * The charges will only happen if @memcg matches the current cpu's memcg
- * stock, and at least @nr_pages are available in that stock.  Failure to
- * service an allocation will refill the stock.
+ * The charges will only happen if @memcg is one of the current cpu's
+ * cached memcgs, and at least @nr_pages are available in its stock.
+ * Failure to service an allocation will refill the stock.
  *
  * returns true if successful, false otherwise.
  */
@@ -2206,16 +2215,22 @@ static bool consume_stock(struct mem_cgroup *memcg, unsigned int nr_pages)
 	struct memcg_stock_pcp *stock;
 	unsigned long flags;
 	bool ret = false;
+	int i;
 
-	if (nr_pages > MEMCG_CHARGE_BATCH)
+	if (nr_pages > MEMCG_CHARGE_BATCH_MAX)
 		return ret;
 
 	local_irq_save(flags);
 
 	stock = this_cpu_ptr(&memcg_stock);
-	if (memcg == stock->cached && stock->nr_pages >= nr_pages) {
-		stock->nr_pages -= nr_pages;
-		ret = true;
+	for (i = 0; i < NR_MEMCG_STOCK; i++) {
+		if (memcg != stock->cached[i])
+			continue;
+		if (stock->nr_pages[i] >= nr_pages) {
+			stock->nr_pages[i] -= nr_pages;
+			ret = true;
+		}
+		break;
 	}
 
 	local_irq_restore(flags);
@@ -2224,24 +2239,32 @@ static bool consume_stock(struct mem_cgroup *memcg, unsigned int nr_pages)
 }
 
 /*
- * Returns stocks cached in percpu and reset cached information.
+ * Returns the stock cached in percpu slot @i and reset cached information.
  */
-static void drain_stock(struct memcg_stock_pcp *stock)
+static void drain_stock(struct memcg_stock_pcp *stock, int i)
 {
-	struct mem_cgroup *old = stock->cached;
+	struct mem_cgroup *old = stock->cached[i];
 
 	if (!old)
 		return;
 
-	if (stock->nr_pages) {
-		page_counter_uncharge(&old->memory, stock->nr_pages);
+	if (stock->nr_pages[i]) {
+		page_counter_uncharge(&old->memory, stock->nr_pages[i]);
 		if (do_memsw_account())
-			page_counter_uncharge(&old->memsw, stock->nr_pages);
-		stock->nr_pages = 0;
+			page_counter_uncharge(&old->memsw, stock->nr_pages[i]);
+		stock->nr_pages[i] = 0;
 	}
 
 	css_put(&old->css);
-	stock->cached = NULL;
+	stock->cached[i] = NULL;
+}
+
+static void drain_stocks(struct memcg_stock_pcp *stock)
+{
+	int i;
+
+	for (i = 0; i < NR_MEMCG_STOCK; i++)
+		drain_stock(stock, i);
 }
 
 static void drain_local_stock(struct work_struct *dummy)
@@ -2260,7 +2283,7 @@ static void drain_local_stock(struct work_struct *dummy)
 	drain_obj_stock(&stock->irq_obj);
 	if (in_task())
 		drain_obj_stock(&stock->task_obj);
-	drain_stock(stock);
+	drain_stocks(stock);
 	clear_bit(FLUSHING_CACHED_CHARGE, &stock->flags);
 
 	local_irq_restore(flags);
@@ -2274,19 +2297,32 @@ static void refill_stock(struct mem_cgroup *memcg, unsigned int nr_pages)
 {
 	struct memcg_stock_pcp *stock;
 	unsigned long flags;
+	int i, empty = -1;
 
 	local_irq_save(flags);
 
 	stock = this_cpu_ptr(&memcg_stock);
-	if (stock->cached != memcg) { /* reset if necessary */
-		drain_stock(stock);
+	for (i = 0; i < NR_MEMCG_STOCK; i++) {
+		if (stock->cached[i] == memcg)
+			break;
+		if (!stock->cached[i] && empty < 0)
+			empty = i;
+	}
+
+	if (i == NR_MEMCG_STOCK) {
+		/* Take a free slot, or evict a random memcg */
+		i = empty;
+		if (i < 0) {
+			i = prandom_u32_max(NR_MEMCG_STOCK);
+			drain_stock(stock, i);
+		}
 		css_get(&memcg->css);
-		stock->cached = memcg;
+		stock->cached[i] = memcg;
 	}
-	stock->nr_pages += nr_pages;
+	stock->nr_pages[i] += nr_pages;
 
-	if (stock->nr_pages > MEMCG_CHARGE_BATCH)
-		drain_stock(stock);
+	if (stock->nr_pages[i] > READ_ONCE(memcg->charge_batch))
+		drain_stock(stock, i);
 
 	local_irq_restore(flags);
 }
@@ -2313,13 +2349,18 @@ static void drain_all_stock(struct mem_cgroup *root_memcg)
 		struct memcg_stock_pcp *stock = &per_cpu(memcg_stock, cpu);
 		struct mem_cgroup *memcg;
 		bool flush = false;
+		int i;
 
 		rcu_read_lock();
-		memcg = stock->cached;
-		if (memcg && stock->nr_pages &&
-		    mem_cgroup_is_descendant(memcg, root_memcg))
-			flush = true;
-		else if (obj_stock_flush_required(stock, root_memcg))
+		for (i = 0; i < NR_MEMCG_STOCK; i++) {
+			memcg = READ_ONCE(stock->cached[i]);
+			if (memcg && READ_ONCE(stock->nr_pages[i]) &&
+			    mem_cgroup_is_descendant(memcg, root_memcg)) {
+				flush = true;
+				break;
+			}
+		}
+		if (!flush && obj_stock_flush_required(stock, root_memcg))
 			flush = true;
 		rcu_read_unlock();
 
@@ -2340,7 +2381,7 @@ static int memcg_hotplug_cpu_dead(unsigned int cpu)
 	struct memcg_stock_pcp *stock;
 
 	stock = &per_cpu(memcg_stock, cpu);
-	drain_stock(stock);
+	drain_stocks(stock);
 
 	return 0;
 }
@@ -2598,10 +2639,53 @@ out:
 	css_put(&memcg->css);
 }
 
+/*
+ * The charge batch of a memcg doubles, up to MEMCG_CHARGE_BATCH_MAX, each
+ * time its stock on some cpu runs dry while the memcg and its ancestors
+ * are well below their limits, so that busy memcgs walk the page counter
+ * hierarchy less often.
+ * It falls back to MEMCG_CHARGE_BATCH as soon as a batch does not fit
+ * under a limit anymore.
+ */
+static void memcg_grow_charge_batch(struct mem_cgroup *memcg)
+{
+	unsigned int batch = READ_ONCE(memcg->charge_batch);
+	struct mem_cgroup *iter;
+	unsigned long need, limit;
+
+	if (batch >= MEMCG_CHARGE_BATCH_MAX)
+		return;
+
+	/*
+	 * Every cpu may end up caching a batch, and a stock is charged to
+	 * all ancestors too: keep that clear of every limit up the
+	 * hierarchy, memsw included.
+	 */
+	need = 4UL * batch * num_online_cpus();
+	for (iter = memcg; iter; iter = parent_mem_cgroup(iter)) {
+		limit = min(READ_ONCE(iter->memory.max),
+			    READ_ONCE(iter->memory.high));
+		if (page_counter_read(&iter->memory) + need > limit)
+			return;
+		if (do_memsw_account() &&
+		    page_counter_read(&iter->memsw) + need >
+		    READ_ONCE(iter->memsw.max))
+			return;
+	}
+
+	WRITE_ONCE(memcg->charge_batch, 2 * batch);
+}
+
+static void memcg_reset_charge_batch(struct mem_cgroup *memcg)
+{
+	if (READ_ONCE(memcg->charge_batch) > MEMCG_CHARGE_BATCH)
+		WRITE_ONCE(memcg->charge_batch, MEMCG_CHARGE_BATCH);
+}
+
 static int try_charge_memcg(struct mem_cgroup *memcg, gfp_t gfp_mask,
 			unsigned int nr_pages)
 {
-	unsigned int batch = max(MEMCG_CHARGE_BATCH, nr_pages);
+	unsigned int batch = max(READ_ONCE(memcg->charge_batch), nr_pages);
 	int nr_retries = MAX_RECLAIM_RETRIES;
 	struct mem_cgroup *mem_over_limit;
 	struct page_counter *counter;
@@ -2629,6 +2713,7 @@ retry:
 	}
 
 	if (batch > nr_pages) {
+		memcg_reset_charge_batch(memcg);
 		batch = nr_pages;
 		goto retry;
 	}
@@ -2731,8 +2816,10 @@ force:
 	return 0;
 
 done_restock:
-	if (batch > nr_pages)
+	if (batch > nr_pages) {
 		refill_stock(memcg, batch - nr_pages);
+		memcg_grow_charge_batch(memcg);
+	}
 
 	/*
 	 * If the hierarchy is above the normal consumption range, schedule
@@ -5249,6 +5336,7 @@ static struct mem_cgroup *mem_cgroup_alloc(void)
 		goto fail;
 
 	INIT_WORK(&memcg->high_work, high_work_func);
+	memcg->charge_batch = MEMCG_CHARGE_BATCH;
 	INIT_LIST_HEAD(&memcg->oom_notify);
 	mutex_init(&memcg->thresholds_lock);
 	spin_lock_init(&memcg->move_lock);
@@ -3018,6 +3018,26 @@ static inline void wp_page_reuse(struct vm_fault *vmf)
 	count_vm_event(PGREUSE);
 }
 
+/*
+ * Linking a new anon_vma into the vma's anon_vma_chain relies on mmap_lock
+ * to keep vma_merge() and friends away, so faults running under the VMA
+ * lock retry with mmap_lock instead.
+ */
+vm_fault_t vmf_anon_prepare(struct vm_fault *vmf)
+{
+	struct vm_area_struct *vma = vmf->vma;
+
+	if (likely(vma->anon_vma))
+		return 0;
+	if (vmf->flags & FAULT_FLAG_VMA_LOCK) {
+		vma_end_read(vma);
+		return VM_FAULT_RETRY;
+	}
+	if (__anon_vma_prepare(vma))
+		return VM_FAULT_OOM;
+	return 0;
+}
+
 /*
  * Handle the case of a page which we actually need to copy to a new page.
  *
@@ -3043,10 +3063,12 @@ static vm_fault_t wp_page_copy(struct vm_fault *vmf)
 	pte_t entry;
 	int page_copied = 0;
 	struct mmu_notifier_range range;
+	vm_fault_t fault;
 	int ret;
 
-	if (unlikely(anon_vma_prepare(vma)))
-		goto oom;
+	fault = vmf_anon_prepare(vmf);
+	if (unlikely(fault))
+		goto out;
 
 	if (is_zero_pfn(pte_pfn(vmf->orig_pte))) {
 		new_page = alloc_zeroed_user_highpage_movable(vma,
@@ -3184,9 +3206,11 @@ static vm_fault_t wp_page_copy(struct vm_fault *vmf)
 oom_free_new:
 	put_page(new_page);
 oom:
+	fault = VM_FAULT_OOM;
+out:
 	if (old_page)
 		put_page(old_page);
-	return VM_FAULT_OOM;
+	return fault;
 }
 
 /**
@@ -3517,7 +3541,7 @@ static vm_fault_t remove_device_exclusive_entry(struct vm_fault *vmf)
 	if (!get_page_unless_zero(page))
 		return 0;
 
-	if (!lock_page_or_retry(page, vma->vm_mm, vmf->flags)) {
+	if (!lock_page_or_retry(page, vmf)) {
 		put_page(page);
 		return VM_FAULT_RETRY;
 	}
@@ -3571,6 +3595,15 @@ vm_fault_t do_swap_page(struct vm_fault *vmf)
 			vmf->page = pfn_swap_entry_to_page(entry);
 			ret = remove_device_exclusive_entry(vmf);
 		} else if (is_device_private_entry(entry)) {
+			if (vmf->flags & FAULT_FLAG_VMA_LOCK) {
+				/*
+				 * ->migrate_to_ram() walks the page tables
+				 * and expects mmap_lock to be held.
+				 */
+				vma_end_read(vma);
+				ret = VM_FAULT_RETRY;
+				goto out;
+			}
 			vmf->page = pfn_swap_entry_to_page(entry);
 			ret = vmf->page->pgmap->ops->migrate_to_ram(vmf);
 		} else if (is_hwpoison_entry(entry)) {
@@ -3652,7 +3685,7 @@ vm_fault_t do_swap_page(struct vm_fault *vmf)
 		goto out_release;
 	}
 
-	locked = lock_page_or_retry(page, vma->vm_mm, vmf->flags);
+	locked = lock_page_or_retry(page, vmf);
 
 	delayacct_clear_flag(current, DELAYACCT_PF_SWAPIN);
 	if (!locked) {
@@ -3834,8 +3867,9 @@ static vm_fault_t do_anonymous_page(struct vm_fault *vmf)
 	}
 
 	/* Allocate our own private page. */
-	if (unlikely(anon_vma_prepare(vma)))
-		goto oom;
+	ret = vmf_anon_prepare(vmf);
+	if (unlikely(ret))
+		return ret;
 	page = alloc_zeroed_user_highpage_movable(vma, vmf->address);
 	if (!page)
 		goto oom;
@@ -4278,8 +4312,9 @@ static vm_fault_t do_cow_fault(struct vm_fault *vmf)
 	struct vm_area_struct *vma = vmf->vma;
 	vm_fault_t ret;
 
-	if (unlikely(anon_vma_prepare(vma)))
-		return VM_FAULT_OOM;
+	ret = vmf_anon_prepare(vmf);
+	if (unlikely(ret))
+		return ret;
 
 	vmf->cow_page = alloc_page_vma(GFP_HIGHUSER_MOVABLE, vma, vmf->address);
 	if (!vmf->cow_page)
@@ -4471,8 +4506,15 @@ static vm_fault_t do_numa_page(struct vm_fault *vmf)
 	if (page_mapcount(page) > 1 && (vma->vm_flags & VM_SHARED))
 		flags |= TNF_SHARED;
 
-	last_cpupid = page_cpupid_last(page);
 	page_nid = page_to_nid(page);
+	/*
+	 * With tiering promotion, the cpupid of a page on a slow node holds
+	 * its scan time, so report the fault without a last cpupid.
+	 */
+	if (numa_promotion_enabled && !node_is_toptier(page_nid))
+		last_cpupid = (-1 & LAST_CPUPID_MASK);
+	else
+		last_cpupid = page_cpupid_last(page);
 	target_nid = numa_migrate_prep(page, vma, vmf->address, page_nid,
 			&flags);
 	if (target_nid == NUMA_NO_NODE) {
@@ -4901,6 +4943,94 @@ vm_fault_t handle_mm_fault(struct vm_area_struct *vma, unsigned long address,
 }
 EXPORT_SYMBOL_GPL(handle_mm_fault);
 
+#ifdef CONFIG_PER_VMA_LOCK
+/*
+ * Lockless variant of find_vma(). Concurrent rbtree rotations may make the
+ * walk miss the VMA or land on a neighbour, but every node it visits stays
+ * allocated until the RCU grace period ends, and the caller revalidates the
+ * range once the VMA is locked.
+ */
+static struct vm_area_struct *find_vma_rcu(struct mm_struct *mm,
+					   unsigned long addr)
+{
+	struct rb_node *rb_node = READ_ONCE(mm->mm_rb.rb_node);
+	struct vm_area_struct *vma = NULL;
+
+	while (rb_node) {
+		struct vm_area_struct *tmp;
+
+		tmp = rb_entry(rb_node, struct vm_area_struct, vm_rb);
+		if (READ_ONCE(tmp->vm_end) > addr) {
+			vma = tmp;
+			if (READ_ONCE(tmp->vm_start) <= addr)
+				break;
+			rb_node = READ_ONCE(rb_node->rb_left);
+		} else
+			rb_node = READ_ONCE(rb_node->rb_right);
+	}
+	return vma;
+}
+
+/*
+ * Page faults that can run under the VMA lock alone. Anything that may need
+ * mmap_lock for its own bookkeeping (stack expansion, userfaultfd, hugetlb)
+ * or whose ->fault handler is not known to cope with it keeps using
+ * mmap_lock.
+ */
+static bool vma_can_fault_locked(struct vm_area_struct *vma)
+{
+	if (vma->vm_flags & (VM_GROWSDOWN | VM_GROWSUP))
+		return false;
+	if (is_vm_hugetlb_page(vma) || userfaultfd_armed(vma))
+		return false;
+	return vma_is_anonymous(vma) || vma->vm_ops->fault == filemap_fault;
+}
+
+/*
+ * Lookup and lock a VMA under RCU protection. Returned VMA is guaranteed to be
+ * stable and not isolated. If the VMA is not found or is being modified the
+ * function returns NULL.
+ */
+struct vm_area_struct *lock_vma_under_rcu(struct mm_struct *mm,
+					  unsigned long address)
+{
+	struct vm_area_struct *vma;
+
+	rcu_read_lock();
+	vma = find_vma_rcu(mm, address);
+	if (!vma)
+		goto inval;
+
+	if (!vma_start_read(vma))
+		goto inval;
+
+	/* Check since vm_start/vm_end might change before we lock the VMA */
+	if (unlikely(address < vma->vm_start || address >= vma->vm_end))
+		goto inval_end_read;
+
+	/* Check if the VMA got isolated after we found it */
+	if (vma->detached) {
+		vma_end_read(vma);
+		count_vm_vma_lock_event(VMA_LOCK_MISS);
+		rcu_read_unlock();
+		return NULL;
+	}
+
+	if (!vma_can_fault_locked(vma))
+		goto inval_end_read;
+
+	rcu_read_unlock();
+	return vma;
+
+inval_end_read:
+	vma_end_read(vma);
+inval:
+	rcu_read_unlock();
+	count_vm_vma_lock_event(VMA_LOCK_ABORT);
+	return NULL;
+}
+#endif /* CONFIG_PER_VMA_LOCK */
+
 #ifndef __PAGETABLE_P4D_FOLDED
 /*
  * Allocate p4d page table.
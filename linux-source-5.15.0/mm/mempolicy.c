@@ -770,6 +770,7 @@ static int vma_replace_policy(struct vm_area_struct *vma,
 			goto err_out;
 	}
 
+	vma_start_write(vma);
 	old = vma->vm_policy;
 	vma->vm_policy = new; /* protected by mmap_lock */
 	mpol_put(old);
@@ -1209,7 +1210,7 @@ static struct page *new_page(struct page *page, unsigned long start)
 		struct page *thp;
 
 		thp = alloc_hugepage_vma(GFP_TRANSHUGE, vma, address,
-					 HPAGE_PMD_ORDER);
+					 thp_order(page));
 		if (!thp)
 			return NULL;
 		prep_transhuge_page(thp);
@@ -2356,6 +2357,71 @@ static void sp_free(struct sp_node *n)
 	kmem_cache_free(sn_cache, n);
 }
 
+bool numa_promotion_enabled = false;
+/* Pages promoted to a node per second, in MB */
+static unsigned int numa_promotion_rate_limit_MBps = 65536;
+/* Pages whose hint fault came later than this after the scan are cold */
+static unsigned int numa_promotion_hot_threshold_ms = MSEC_PER_SEC;
+
+#ifdef CONFIG_NUMA_BALANCING
+/* Time between the scan of a page on a slow node and its hint fault */
+static unsigned int numa_hint_fault_latency(struct page *page)
+{
+	int last_time, time;
+
+	time = jiffies_to_msecs(jiffies);
+	last_time = xchg_page_access_time(page, time);
+
+	return (time - last_time) & PAGE_ACCESS_TIME_MASK;
+}
+
+/*
+ * Returns true if more than @rate_limit pages have been candidates for
+ * promotion to @pgdat during the last second.
+ */
+static bool numa_promotion_rate_limit(struct pglist_data *pgdat,
+				      unsigned long rate_limit, int nr)
+{
+	unsigned long nr_cand;
+	unsigned int now, start;
+
+	now = jiffies_to_msecs(jiffies);
+	mod_node_page_state(pgdat, PGPROMOTE_CANDIDATE, nr);
+	nr_cand = node_page_state(pgdat, PGPROMOTE_CANDIDATE);
+	start = READ_ONCE(pgdat->nbp_rl_start);
+	if (now - start > MSEC_PER_SEC &&
+	    cmpxchg(&pgdat->nbp_rl_start, start, now) == start)
+		WRITE_ONCE(pgdat->nbp_rl_nr_cand, nr_cand);
+
+	return nr_cand - READ_ONCE(pgdat->nbp_rl_nr_cand) >= rate_limit;
+}
+
+/*
+ * Memory tiering: a page on a slow node is hot, and promoted to the fast
+ * node @dst_nid, if it took a hint fault soon after it was scanned and the
+ * promotion rate limit of @dst_nid has not been reached yet.
+ */
+static bool numa_promote_hot_page(struct page *page, int dst_nid)
+{
+	unsigned long rate_limit;
+
+	if (numa_hint_fault_latency(page) >=
+	    READ_ONCE(numa_promotion_hot_threshold_ms))
+		return false;
+
+	rate_limit = (unsigned long)READ_ONCE(numa_promotion_rate_limit_MBps) <<
+		     (20 - PAGE_SHIFT);
+
+	return !numa_promotion_rate_limit(NODE_DATA(dst_nid), rate_limit,
+					  thp_nr_pages(page));
+}
+#else
+static inline bool numa_promote_hot_page(struct page *page, int dst_nid)
+{
+	return false;
+}
+#endif /* CONFIG_NUMA_BALANCING */
+
 /**
  * mpol_misplaced - check whether current page node is valid in policy
  *
@@ -2434,7 +2500,12 @@ int mpol_misplaced(struct page *page, struct vm_area_struct *vma, unsigned long
 	if (pol->flags & MPOL_F_MORON) {
 		polnid = thisnid;
 
-		if (!should_numa_migrate_memory(current, page, curnid, thiscpu))
+		if (numa_promotion_enabled && !node_is_toptier(curnid)) {
+			if (!node_is_toptier(thisnid) ||
+			    !numa_promote_hot_page(page, thisnid))
+				goto out;
+		} else if (!should_numa_migrate_memory(current, page, curnid,
+						       thiscpu))
 			goto out;
 	}
 
@@ -3009,8 +3080,90 @@ static struct kobj_attribute numa_demotion_enabled_attr =
 	__ATTR(demotion_enabled, 0644, numa_demotion_enabled_show,
 	       numa_demotion_enabled_store);
 
+static ssize_t numa_promotion_enabled_show(struct kobject *kobj,
+					   struct kobj_attribute *attr,
+					   char *buf)
+{
+	return sysfs_emit(buf, "%s\n",
+			  numa_promotion_enabled ? "true" : "false");
+}
+
+static ssize_t numa_promotion_enabled_store(struct kobject *kobj,
+					    struct kobj_attribute *attr,
+					    const char *buf, size_t count)
+{
+	if (!strncmp(buf, "true", 4) || !strncmp(buf, "1", 1))
+		numa_promotion_enabled = true;
+	else if (!strncmp(buf, "false", 5) || !strncmp(buf, "0", 1))
+		numa_promotion_enabled = false;
+	else
+		return -EINVAL;
+
+	return count;
+}
+
+static struct kobj_attribute numa_promotion_enabled_attr =
+	__ATTR(promotion_enabled, 0644, numa_promotion_enabled_show,
+	       numa_promotion_enabled_store);
+
+static ssize_t promotion_rate_limit_MBps_show(struct kobject *kobj,
+					      struct kobj_attribute *attr,
+					      char *buf)
+{
+	return sysfs_emit(buf, "%u\n", numa_promotion_rate_limit_MBps);
+}
+
+static ssize_t promotion_rate_limit_MBps_store(struct kobject *kobj,
+					       struct kobj_attribute *attr,
+					       const char *buf, size_t count)
+{
+	unsigned int val;
+	int err;
+
+	err = kstrtouint(buf, 10, &val);
+	if (err)
+		return err;
+
+	WRITE_ONCE(numa_promotion_rate_limit_MBps, val);
+	return count;
+}
+
+static struct kobj_attribute numa_promotion_rate_limit_attr =
+	__ATTR(promotion_rate_limit_MBps, 0644, promotion_rate_limit_MBps_show,
+	       promotion_rate_limit_MBps_store);
+
+static ssize_t promotion_hot_threshold_ms_show(struct kobject *kobj,
+					       struct kobj_attribute *attr,
+					       char *buf)
+{
+	return sysfs_emit(buf, "%u\n", numa_promotion_hot_threshold_ms);
+}
+
+static ssize_t promotion_hot_threshold_ms_store(struct kobject *kobj,
+						struct kobj_attribute *attr,
+						const char *buf, size_t count)
+{
+	unsigned int val;
+	int err;
+
+	err = kstrtouint(buf, 10, &val);
+	if (err)
+		return err;
+
+	WRITE_ONCE(numa_promotion_hot_threshold_ms, val);
+	return count;
+}
+
+static struct kobj_attribute numa_promotion_hot_threshold_attr =
+	__ATTR(promotion_hot_threshold_ms, 0644,
+	       promotion_hot_threshold_ms_show,
+	       promotion_hot_threshold_ms_store);
+
 static struct attribute *numa_attrs[] = {
 	&numa_demotion_enabled_attr.attr,
+	&numa_promotion_enabled_attr.attr,
+	&numa_promotion_rate_limit_attr.attr,
+	&numa_promotion_hot_threshold_attr.attr,
 	NULL,
 };
 
@@ -580,6 +580,14 @@ void migrate_page_states(struct page *newpage, struct page *page)
 	 * future migrations of this same page.
 	 */
 	cpupid = page_cpupid_xchg_last(page, -1);
+	/*
+	 * The cpupid of pages on slow nodes holds the scan time when tiering
+	 * promotion is enabled, it means nothing on the other tier.
+	 */
+	if (numa_promotion_enabled &&
+	    node_is_toptier(page_to_nid(page)) !=
+	    node_is_toptier(page_to_nid(newpage)))
+		cpupid = -1;
 	page_cpupid_xchg_last(newpage, cpupid);
 
 	ksm_migrate_page(newpage, page);
@@ -1638,7 +1646,7 @@ struct page *alloc_migration_target(struct page *page, unsigned long private)
 		 */
 		gfp_mask &= ~__GFP_RECLAIM;
 		gfp_mask |= GFP_TRANSHUGE;
-		order = HPAGE_PMD_ORDER;
+		order = thp_order(page);
 	}
 	zidx = zone_idx(page_zone(page));
 	if (is_highmem_idx(zidx) || zidx == ZONE_MOVABLE)
@@ -2136,8 +2144,23 @@ static int numamigrate_isolate_page(pg_data_t *pgdat, struct page *page)
 		return 0;
 
 	/* Avoid migrating to a node that is nearly full */
-	if (!migrate_balanced_pgdat(pgdat, nr_pages))
+	if (!migrate_balanced_pgdat(pgdat, nr_pages)) {
+		int z;
+
+		if (!numa_promotion_enabled)
+			return 0;
+		/*
+		 * Have kswapd demote cold pages off the fast node, to make
+		 * room for promoting the hot ones.
+		 */
+		for (z = pgdat->nr_zones - 1; z >= 0; z--) {
+			if (populated_zone(pgdat->node_zones + z))
+				break;
+		}
+		wakeup_kswapd(pgdat->node_zones + z, 0,
+			      compound_order(page), ZONE_MOVABLE);
 		return 0;
+	}
 
 	if (isolate_lru_page(page))
 		return 0;
@@ -2170,6 +2193,7 @@ int migrate_misplaced_page(struct page *page, struct vm_area_struct *vma,
 	new_page_t *new;
 	bool compound;
 	int nr_pages = thp_nr_pages(page);
+	int page_nid = page_to_nid(page);
 
 	/*
 	 * PTE mapped THP or HugeTLB page can't reach here so the page could
@@ -2213,8 +2237,12 @@ int migrate_misplaced_page(struct page *page, struct vm_area_struct *vma,
 			putback_lru_page(page);
 		}
 		isolated = 0;
-	} else
+	} else {
 		count_vm_numa_events(NUMA_PAGE_MIGRATE, nr_pages);
+		if (!node_is_toptier(page_nid) && node_is_toptier(node))
+			mod_node_page_state(pgdat, PGPROMOTE_SUCCESS,
+					    nr_pages);
+	}
 	BUG_ON(!list_empty(&migratepages));
 	return isolated;
 
@@ -485,6 +485,7 @@ static __always_inline void vma_rb_erase_ignore(struct vm_area_struct *vma,
 	validate_mm_rb(root, ignore);
 
 	__vma_rb_erase(vma, root);
+	vma_mark_detached(vma, true);
 }
 
 static __always_inline void vma_rb_erase(struct vm_area_struct *vma,
@@ -649,8 +650,12 @@ void __vma_link_rb(struct mm_struct *mm, struct vm_area_struct *vma,
 	 * (to be consistent with what we did on the way down), and then
 	 * immediately update the gap to the correct value. Finally we
 	 * rebalance the rbtree after all augmented values have been set.
+	 *
+	 * Page faults walk the rbtree under RCU (see lock_vma_under_rcu()),
+	 * so publish the node only once it is fully initialized.
 	 */
-	rb_link_node(&vma->vm_rb, rb_parent, rb_link);
+	vma_mark_detached(vma, false);
+	rb_link_node_rcu(&vma->vm_rb, rb_parent, rb_link);
 	vma->rb_subtree_gap = 0;
 	vma_gap_update(vma);
 	vma_rb_insert(vma, &mm->mm_rb);
@@ -750,6 +755,10 @@ int __vma_adjust(struct vm_area_struct *vma, unsigned long start,
 	long adjust_next = 0;
 	int remove_next = 0;
 
+	vma_start_write(vma);
+	if (next)
+		vma_start_write(next);
+
 	if (next && !insert) {
 		struct vm_area_struct *exporter = NULL, *importer = NULL;
 
@@ -833,6 +842,9 @@ int __vma_adjust(struct vm_area_struct *vma, unsigned long start,
 		}
 	}
 again:
+	/* The second pass of mprotect case 6 removes the vma after next */
+	if (next)
+		vma_start_write(next);
 	vma_adjust_trans_huge(orig_vma, start, end, adjust_next);
 
 	if (file) {
@@ -2679,6 +2691,7 @@ detach_vmas_to_be_unmapped(struct mm_struct *mm, struct vm_area_struct *vma,
 	insertion_point = (prev ? &prev->vm_next : &mm->mmap);
 	vma->vm_prev = NULL;
 	do {
+		vma_start_write(vma);
 		vma_rb_erase(vma, &mm->mm_rb);
 		mm->map_count--;
 		tail_vma = vma;
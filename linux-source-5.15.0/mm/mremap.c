@@ -586,6 +586,12 @@ static unsigned long move_vma(struct vm_area_struct *vma,
 	if (mm->map_count >= sysctl_max_map_count - 3)
 		return -ENOMEM;
 
+	/*
+	 * move_page_tables() moves PTEs and whole page tables out from under
+	 * the source VMA, keep page faults under the VMA lock away from it.
+	 */
+	vma_start_write(vma);
+
 	if (vma->vm_ops && vma->vm_ops->may_split) {
 		if (vma->vm_start != old_addr)
 			err = vma->vm_ops->may_split(vma, old_addr);
@@ -620,6 +626,7 @@ static unsigned long move_vma(struct vm_area_struct *vma,
 			vm_unacct_memory(new_len >> PAGE_SHIFT);
 		return -ENOMEM;
 	}
+	vma_start_write(new_vma);
 
 	moved_len = move_page_tables(vma, old_addr, new_vma, new_addr, old_len,
 				     need_rmap_locks);
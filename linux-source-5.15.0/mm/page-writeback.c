@@ -2470,17 +2470,19 @@ static void account_page_dirtied(struct page *page,
 	if (mapping_can_writeback(mapping)) {
 		struct bdi_writeback *wb;
 
+		long nr = thp_nr_pages(page);
+
 		inode_attach_wb(inode, page);
 		wb = inode_to_wb(inode);
 
-		__inc_lruvec_page_state(page, NR_FILE_DIRTY);
-		__inc_zone_page_state(page, NR_ZONE_WRITE_PENDING);
-		__inc_node_page_state(page, NR_DIRTIED);
-		inc_wb_stat(wb, WB_RECLAIMABLE);
-		inc_wb_stat(wb, WB_DIRTIED);
-		task_io_account_write(PAGE_SIZE);
-		current->nr_dirtied++;
-		__this_cpu_inc(bdp_ratelimits);
+		__mod_lruvec_page_state(page, NR_FILE_DIRTY, nr);
+		__mod_zone_page_state(page_zone(page), NR_ZONE_WRITE_PENDING, nr);
+		__mod_node_page_state(page_pgdat(page), NR_DIRTIED, nr);
+		__add_wb_stat(wb, WB_RECLAIMABLE, nr);
+		__add_wb_stat(wb, WB_DIRTIED, nr);
+		task_io_account_write(nr * PAGE_SIZE);
+		current->nr_dirtied += nr;
+		__this_cpu_add(bdp_ratelimits, nr);
 
 		mem_cgroup_track_foreign_dirty(page, wb);
 	}
@@ -2495,10 +2497,12 @@ void account_page_cleaned(struct page *page, struct address_space *mapping,
 			  struct bdi_writeback *wb)
 {
 	if (mapping_can_writeback(mapping)) {
-		dec_lruvec_page_state(page, NR_FILE_DIRTY);
-		dec_zone_page_state(page, NR_ZONE_WRITE_PENDING);
-		dec_wb_stat(wb, WB_RECLAIMABLE);
-		task_io_account_cancelled_write(PAGE_SIZE);
+		long nr = thp_nr_pages(page);
+
+		mod_lruvec_page_state(page, NR_FILE_DIRTY, -nr);
+		mod_zone_page_state(page_zone(page), NR_ZONE_WRITE_PENDING, -nr);
+		__add_wb_stat(wb, WB_RECLAIMABLE, -nr);
+		task_io_account_cancelled_write(nr * PAGE_SIZE);
 	}
 }
 
@@ -2577,11 +2581,12 @@ void account_page_redirty(struct page *page)
 		struct inode *inode = mapping->host;
 		struct bdi_writeback *wb;
 		struct wb_lock_cookie cookie = {};
+		long nr = thp_nr_pages(page);
 
 		wb = unlocked_inode_to_wb_begin(inode, &cookie);
-		current->nr_dirtied--;
-		dec_node_page_state(page, NR_DIRTIED);
-		dec_wb_stat(wb, WB_DIRTIED);
+		current->nr_dirtied -= nr;
+		mod_node_page_state(page_pgdat(page), NR_DIRTIED, -nr);
+		__add_wb_stat(wb, WB_DIRTIED, -nr);
 		unlocked_inode_to_wb_end(inode, &cookie);
 	}
 }
@@ -2758,9 +2763,12 @@ int clear_page_dirty_for_io(struct page *page)
 		 */
 		wb = unlocked_inode_to_wb_begin(inode, &cookie);
 		if (TestClearPageDirty(page)) {
-			dec_lruvec_page_state(page, NR_FILE_DIRTY);
-			dec_zone_page_state(page, NR_ZONE_WRITE_PENDING);
-			dec_wb_stat(wb, WB_RECLAIMABLE);
+			long nr = thp_nr_pages(page);
+
+			mod_lruvec_page_state(page, NR_FILE_DIRTY, -nr);
+			mod_zone_page_state(page_zone(page),
+					    NR_ZONE_WRITE_PENDING, -nr);
+			__add_wb_stat(wb, WB_RECLAIMABLE, -nr);
 			ret = 1;
 		}
 		unlocked_inode_to_wb_end(inode, &cookie);
@@ -2795,6 +2803,7 @@ static void wb_inode_writeback_end(struct bdi_writeback *wb)
 int test_clear_page_writeback(struct page *page)
 {
 	struct address_space *mapping = page_mapping(page);
+	long nr = thp_nr_pages(page);
 	int ret;
 
 	lock_page_memcg(page);
@@ -2811,7 +2820,7 @@ int test_clear_page_writeback(struct page *page)
 			if (bdi->capabilities & BDI_CAP_WRITEBACK_ACCT) {
 				struct bdi_writeback *wb = inode_to_wb(inode);
 
-				dec_wb_stat(wb, WB_WRITEBACK);
+				__add_wb_stat(wb, WB_WRITEBACK, -nr);
 				__wb_writeout_inc(wb);
 				if (!mapping_tagged(mapping,
 						    PAGECACHE_TAG_WRITEBACK))
@@ -2828,9 +2837,9 @@ int test_clear_page_writeback(struct page *page)
 		ret = TestClearPageWriteback(page);
 	}
 	if (ret) {
-		dec_lruvec_page_state(page, NR_WRITEBACK);
-		dec_zone_page_state(page, NR_ZONE_WRITE_PENDING);
-		inc_node_page_state(page, NR_WRITTEN);
+		mod_lruvec_page_state(page, NR_WRITEBACK, -nr);
+		mod_zone_page_state(page_zone(page), NR_ZONE_WRITE_PENDING, -nr);
+		mod_node_page_state(page_pgdat(page), NR_WRITTEN, nr);
 	}
 	unlock_page_memcg(page);
 	return ret;
@@ -2839,6 +2848,7 @@ int test_clear_page_writeback(struct page *page)
 int __test_set_page_writeback(struct page *page, bool keep_write)
 {
 	struct address_space *mapping = page_mapping(page);
+	long nr = thp_nr_pages(page);
 	int ret, access_ret;
 
 	lock_page_memcg(page);
@@ -2861,7 +2871,7 @@ int __test_set_page_writeback(struct page *page, bool keep_write)
 			if (bdi->capabilities & BDI_CAP_WRITEBACK_ACCT) {
 				struct bdi_writeback *wb = inode_to_wb(inode);
 
-				inc_wb_stat(wb, WB_WRITEBACK);
+				__add_wb_stat(wb, WB_WRITEBACK, nr);
 				if (!on_wblist)
 					wb_inode_writeback_start(wb);
 			}
@@ -2883,8 +2893,8 @@ int __test_set_page_writeback(struct page *page, bool keep_write)
 		ret = TestSetPageWriteback(page);
 	}
 	if (!ret) {
-		inc_lruvec_page_state(page, NR_WRITEBACK);
-		inc_zone_page_state(page, NR_ZONE_WRITE_PENDING);
+		mod_lruvec_page_state(page, NR_WRITEBACK, nr);
+		mod_zone_page_state(page_zone(page), NR_ZONE_WRITE_PENDING, nr);
 	}
 	unlock_page_memcg(page);
 	access_ret = arch_make_page_accessible(page);
@@ -269,6 +269,96 @@ void do_page_cache_ra(struct readahead_control *ractl,
 	page_cache_ra_unbounded(ractl, nr_to_read, lookahead_size);
 }
 
+static int ra_alloc_page(struct readahead_control *ractl, pgoff_t index,
+		pgoff_t mark, unsigned int order, gfp_t gfp)
+{
+	struct page *page = __page_cache_alloc_order(gfp, order);
+	int err;
+
+	if (!page)
+		return -ENOMEM;
+	mark = round_up(mark, 1UL << order);
+	if (index == mark)
+		SetPageReadahead(page);
+	err = add_to_page_cache_lru(page, ractl->mapping, index, gfp);
+	if (err)
+		put_page(page);
+	else
+		ractl->_nr_pages += 1UL << order;
+	return err;
+}
+
+/*
+ * page_cache_ra_order() reads the readahead window using large pages for
+ * mappings which support them.  @new_order is the order of the page that
+ * triggered the readahead; the pages allocated here may grow beyond it as
+ * long as the stream stays sequential, up to MAX_PAGECACHE_ORDER.
+ */
+void page_cache_ra_order(struct readahead_control *ractl,
+		struct file_ra_state *ra, unsigned int new_order)
+{
+	struct address_space *mapping = ractl->mapping;
+	pgoff_t index = readahead_index(ractl);
+	loff_t isize = i_size_read(mapping->host);
+	pgoff_t mark = index + ra->size - ra->async_size;
+	gfp_t gfp = readahead_gfp_mask(mapping);
+	LIST_HEAD(page_pool);
+	unsigned int nofs;
+	pgoff_t limit;
+	int err = 0;
+
+	if (!MAX_PAGECACHE_ORDER || !mapping_thp_support(mapping) ||
+	    mapping->a_ops->readpages || ra->size < 4 || !isize)
+		goto fallback;
+
+	limit = (isize - 1) >> PAGE_SHIFT;
+	limit = min(limit, index + ra->size - 1);
+
+	if (new_order < MAX_PAGECACHE_ORDER) {
+		new_order += 2;
+		new_order = min_t(unsigned int, new_order, MAX_PAGECACHE_ORDER);
+		while ((1UL << new_order) > ra->size)
+			new_order--;
+	}
+
+	/* See page_cache_ra_unbounded() */
+	nofs = memalloc_nofs_save();
+	filemap_invalidate_lock_shared(mapping);
+	while (index <= limit) {
+		unsigned int order = new_order;
+
+		/* Align with smaller pages if needed; order 1 is not usable */
+		if (index & ((1UL << order) - 1)) {
+			order = __ffs(index);
+			if (order == 1)
+				order = 0;
+		}
+		/* Don't allocate pages past EOF */
+		while (index + (1UL << order) - 1 > limit) {
+			if (--order == 1)
+				order = 0;
+		}
+		err = ra_alloc_page(ractl, index, mark, order, gfp);
+		if (err)
+			break;
+		index += 1UL << order;
+	}
+
+	read_pages(ractl, &page_pool, false);
+	filemap_invalidate_unlock_shared(mapping);
+	memalloc_nofs_restore(nofs);
+
+	/*
+	 * If there were already pages in the page cache, then we may have
+	 * left some gaps.  Let the regular readahead code take care of this
+	 * situation.
+	 */
+	if (!err)
+		return;
+fallback:
+	do_page_cache_ra(ractl, ra->size, ra->async_size);
+}
+
 /*
  * Chunk the readahead into 2 megabyte units, so that we don't pin too much
  * memory at once.
@@ -436,13 +526,14 @@ static int try_context_readahead(struct address_space *mapping,
  * A minimal readahead algorithm for trivial sequential/random reads.
  */
 static void ondemand_readahead(struct readahead_control *ractl,
-		bool hit_readahead_marker, unsigned long req_size)
+		struct page *page, unsigned long req_size)
 {
 	struct backing_dev_info *bdi = inode_to_bdi(ractl->mapping->host);
 	struct file_ra_state *ra = ractl->ra;
 	unsigned long max_pages = ra->ra_pages;
 	unsigned long add_pages;
 	unsigned long index = readahead_index(ractl);
+	unsigned int order = page ? thp_order(page) : 0;
 	pgoff_t prev_index;
 
 	/*
@@ -476,7 +567,7 @@ static void ondemand_readahead(struct readahead_control *ractl,
 	 * Query the pagecache for async_size, which normally equals to
 	 * readahead size. Ramp it up and use it as the new readahead size.
 	 */
-	if (hit_readahead_marker) {
+	if (page) {
 		pgoff_t start;
 
 		rcu_read_lock();
@@ -549,7 +640,7 @@ readit:
 	}
 
 	ractl->_index = ra->start;
-	do_page_cache_ra(ractl, ra->size, ra->async_size);
+	page_cache_ra_order(ractl, ra, order);
 }
 
 void page_cache_sync_ra(struct readahead_control *ractl,
@@ -577,7 +668,7 @@ void page_cache_sync_ra(struct readahead_control *ractl,
 	}
 
 	/* do read-ahead */
-	ondemand_readahead(ractl, false, req_count);
+	ondemand_readahead(ractl, NULL, req_count);
 }
 EXPORT_SYMBOL_GPL(page_cache_sync_ra);
 
@@ -588,6 +679,9 @@ void page_cache_async_ra(struct readahead_control *ractl,
 	if (!ractl->ra->ra_pages)
 		return;
 
+	/* The marker is kept on the head of a large page */
+	page = thp_head(page);
+
 	/*
 	 * Same bit is used for PG_readahead and PG_reclaim.
 	 */
@@ -606,7 +700,7 @@ void page_cache_async_ra(struct readahead_control *ractl,
 		return;
 
 	/* do read-ahead */
-	ondemand_readahead(ractl, true, req_count);
+	ondemand_readahead(ractl, page, req_count);
 }
 EXPORT_SYMBOL_GPL(page_cache_async_ra);
 
@@ -55,7 +55,7 @@ static DECLARE_WORK(slab_caches_to_rcu_destroy_work,
  */
 #define SLAB_NEVER_MERGE (SLAB_RED_ZONE | SLAB_POISON | SLAB_STORE_USER | \
 		SLAB_TRACE | SLAB_TYPESAFE_BY_RCU | SLAB_NOLEAKTRACE | \
-		SLAB_FAILSLAB | kasan_never_merge())
+		SLAB_FAILSLAB | SLAB_SHEAVES | kasan_never_merge())
 
 #define SLAB_MERGE_SAME (SLAB_RECLAIM_ACCOUNT | SLAB_CACHE_DMA | \
 			 SLAB_CACHE_DMA32 | SLAB_ACCOUNT)
@@ -304,6 +304,10 @@ out_free_cache:
  * cacheline.  This can be beneficial if you're counting cycles as closely
  * as davem.
  *
+ * %SLAB_SHEAVES - Keep a per-cpu array of free objects in front of the
+ * slabs, refilled and flushed in bulk.  This helps caches with very high
+ * allocation and free rates; SLUB only.
+ *
  * Return: a pointer to the cache on success, NULL on failure.
  */
 struct kmem_cache *
@@ -413,6 +417,10 @@ EXPORT_SYMBOL(kmem_cache_create_usercopy);
  * cacheline.  This can be beneficial if you're counting cycles as closely
  * as davem.
  *
+ * %SLAB_SHEAVES - Keep a per-cpu array of free objects in front of the
+ * slabs, refilled and flushed in bulk.  This helps caches with very high
+ * allocation and free rates; SLUB only.
+ *
  * Return: a pointer to the cache on success, NULL on failure.
  */
 struct kmem_cache *
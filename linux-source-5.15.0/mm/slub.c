@@ -230,6 +230,12 @@ static inline bool kmem_cache_has_cpu_partial(struct kmem_cache *s)
  */
 #define MAX_PARTIAL 10
 
+/*
+ * Maximum number of objects in a cpu sheaf. Half of it is refilled at once
+ * through an array on the stack.
+ */
+#define SHEAF_MAX_CAPACITY 64
+
 #define DEBUG_DEFAULT_FLAGS (SLAB_CONSISTENCY_CHECKS | SLAB_RED_ZONE | \
 				SLAB_POISON | SLAB_STORE_USER)
 
@@ -2597,6 +2603,35 @@ static inline void unfreeze_partials_cpu(struct kmem_cache *s,
 
 #endif	/* CONFIG_SLUB_CPU_PARTIAL */
 
+static void sheaf_free_objects(struct kmem_cache *s, void **p, size_t nr);
+
+/*
+ * Return all objects of a cpu sheaf to their slabs. The sheaf must be
+ * locked, or belong to a cpu that is gone.
+ */
+static void __flush_cpu_sheaf(struct kmem_cache *s,
+			      struct slub_percpu_sheaf *sheaf)
+{
+	if (!sheaf->size)
+		return;
+
+	sheaf_free_objects(s, sheaf->objects, sheaf->size);
+	sheaf->size = 0;
+	stat(s, SHEAF_FLUSH);
+}
+
+static void flush_cpu_sheaf(struct kmem_cache *s)
+{
+	unsigned long flags;
+
+	if (!s->cpu_sheaves)
+		return;
+
+	local_lock_irqsave(&s->cpu_sheaves->lock, flags);
+	__flush_cpu_sheaf(s, this_cpu_ptr(s->cpu_sheaves));
+	local_unlock_irqrestore(&s->cpu_sheaves->lock, flags);
+}
+
 static inline void flush_slab(struct kmem_cache *s, struct kmem_cache_cpu *c)
 {
 	unsigned long flags;
@@ -2623,8 +2658,15 @@ static inline void flush_slab(struct kmem_cache *s, struct kmem_cache_cpu *c)
 static inline void __flush_cpu_slab(struct kmem_cache *s, int cpu)
 {
 	struct kmem_cache_cpu *c = per_cpu_ptr(s->cpu_slab, cpu);
-	void *freelist = c->freelist;
-	struct page *page = c->page;
+	void *freelist;
+	struct page *page;
+
+	/* The sheaf may free objects into the cpu slab, so flush it first */
+	if (s->cpu_sheaves)
+		__flush_cpu_sheaf(s, per_cpu_ptr(s->cpu_sheaves, cpu));
+
+	freelist = c->freelist;
+	page = c->page;
 
 	c->page = NULL;
 	c->freelist = NULL;
@@ -2658,6 +2700,7 @@ static void flush_cpu_slab(struct work_struct *w)
 	sfw = container_of(w, struct slub_flush_work, work);
 
 	s = sfw->s;
+	flush_cpu_sheaf(s);
 	c = this_cpu_ptr(s->cpu_slab);
 
 	if (c->page)
@@ -2670,6 +2713,9 @@ static bool has_cpu_slab(int cpu, struct kmem_cache *s)
 {
 	struct kmem_cache_cpu *c = per_cpu_ptr(s->cpu_slab, cpu);
 
+	if (s->cpu_sheaves && per_cpu_ptr(s->cpu_sheaves, cpu)->size)
+		return true;
+
 	return c->page || slub_percpu_partial(c);
 }
 
@@ -3099,6 +3145,115 @@ static void *__slab_alloc(struct kmem_cache *s, gfp_t gfpflags, int node,
 	return p;
 }
 
+/*
+ * Take up to @nr objects from the cpu slab, or new slabs, for a sheaf. The
+ * allocation hooks are left to slab_alloc_node() when the objects are
+ * handed out. Returns the number of objects stored at @p.
+ */
+static unsigned int sheaf_alloc_objects(struct kmem_cache *s, gfp_t gfpflags,
+					unsigned int nr, void **p)
+{
+	struct kmem_cache_cpu *c;
+	unsigned long flags;
+	unsigned int i;
+
+	c = slub_get_cpu_ptr(s->cpu_slab);
+	local_lock_irqsave(&s->cpu_slab->lock, flags);
+
+	for (i = 0; i < nr; i++) {
+		void *object = c->freelist;
+
+		if (unlikely(!object)) {
+			/* See kmem_cache_alloc_bulk() */
+			c->tid = next_tid(c->tid);
+
+			local_unlock_irqrestore(&s->cpu_slab->lock, flags);
+
+			p[i] = ___slab_alloc(s, gfpflags, NUMA_NO_NODE,
+					     _RET_IP_, c);
+			if (unlikely(!p[i])) {
+				slub_put_cpu_ptr(s->cpu_slab);
+				return i;
+			}
+
+			c = this_cpu_ptr(s->cpu_slab);
+			local_lock_irqsave(&s->cpu_slab->lock, flags);
+			continue;
+		}
+		c->freelist = get_freepointer(s, object);
+		p[i] = object;
+	}
+	c->tid = next_tid(c->tid);
+	local_unlock_irqrestore(&s->cpu_slab->lock, flags);
+	slub_put_cpu_ptr(s->cpu_slab);
+
+	return i;
+}
+
+/*
+ * The sheaf ran empty: refill half of it in one go and return one more
+ * object for the caller. The sheaf is unlocked while the objects are
+ * allocated, so frees may have filled it up in the meantime.
+ *
+ * Objects from pfmemalloc slabs are only for the caller, who was allowed
+ * to dip into the reserves: the sheaf hands objects out without looking
+ * at gfp flags, so the surplus ones go straight back to their slabs.
+ */
+static void *refill_sheaf(struct kmem_cache *s, gfp_t gfpflags)
+{
+	void *objects[SHEAF_MAX_CAPACITY / 2];
+	struct slub_percpu_sheaf *sheaf;
+	unsigned long flags;
+	unsigned int nr, i, nr_free = 0;
+
+	nr = sheaf_alloc_objects(s, gfpflags, s->sheaf_capacity / 2, objects);
+	if (unlikely(!nr))
+		return NULL;
+
+	local_lock_irqsave(&s->cpu_sheaves->lock, flags);
+	sheaf = this_cpu_ptr(s->cpu_sheaves);
+	for (i = 1; i < nr; i++) {
+		if (likely(sheaf->size < s->sheaf_capacity &&
+			   !PageSlabPfmemalloc(virt_to_head_page(objects[i]))))
+			sheaf->objects[sheaf->size++] = objects[i];
+		else
+			objects[1 + nr_free++] = objects[i];
+	}
+	local_unlock_irqrestore(&s->cpu_sheaves->lock, flags);
+
+	if (unlikely(nr_free))
+		sheaf_free_objects(s, objects + 1, nr_free);
+
+	return objects[0];
+}
+
+/*
+ * Allocation fastpath of caches with sheaves. The sheaf is only ever
+ * touched by its own cpu under the local lock, so no atomic operations
+ * are needed to take an object off it.
+ */
+static __always_inline void *alloc_from_sheaf(struct kmem_cache *s,
+					      gfp_t gfpflags)
+{
+	struct slub_percpu_sheaf *sheaf;
+	unsigned long flags;
+	void *object = NULL;
+
+	local_lock_irqsave(&s->cpu_sheaves->lock, flags);
+	sheaf = this_cpu_ptr(s->cpu_sheaves);
+	if (likely(sheaf->size))
+		object = sheaf->objects[--sheaf->size];
+	local_unlock_irqrestore(&s->cpu_sheaves->lock, flags);
+
+	if (likely(object)) {
+		stat(s, SHEAF_ALLOC_HIT);
+		return object;
+	}
+
+	stat(s, SHEAF_ALLOC_MISS);
+	return refill_sheaf(s, gfpflags);
+}
+
 /*
  * If the object has been wiped upon free, make sure it's fully initialized by
  * zeroing out freelist pointer.
@@ -3139,6 +3294,11 @@ static __always_inline void *slab_alloc_node(struct kmem_cache *s,
 	if (unlikely(object))
 		goto out;
 
+	if (s->cpu_sheaves && node == NUMA_NO_NODE) {
+		object = alloc_from_sheaf(s, gfpflags);
+		goto init;
+	}
+
 redo:
 	/*
 	 * Must read kmem_cache cpu data via this cpu ptr. Preemption is
@@ -3213,6 +3373,7 @@ redo:
 		stat(s, ALLOC_FASTPATH);
 	}
 
+init:
 	maybe_wipe_obj_freeptr(s, object);
 	init = slab_want_init_on_alloc(gfpflags, s);
 
@@ -3488,10 +3649,57 @@ redo:
 
 }
 
+/*
+ * Free fastpath of caches with sheaves, for objects of the local node. The
+ * free hooks run here, as the object will not pass slab_free() again when
+ * it leaves the sheaf. Returns false if the object was not dealt with.
+ */
+static __always_inline bool free_to_sheaf(struct kmem_cache *s,
+					  struct page *page, void *object)
+{
+	struct slub_percpu_sheaf *sheaf;
+	unsigned long flags;
+
+	if (IS_ENABLED(CONFIG_NUMA) && page_to_nid(page) != numa_mem_id())
+		return false;
+	if (is_kfence_address(object))
+		return false;
+	/* see refill_sheaf(), reserve objects must not be handed out freely */
+	if (unlikely(PageSlabPfmemalloc(page)))
+		return false;
+
+	memcg_slab_free_hook(s, &object, 1);
+	/* KASAN might put the object into quarantine, delaying its reuse */
+	if (unlikely(slab_free_hook(s, object, slab_want_init_on_free(s))))
+		return true;
+
+	local_lock_irqsave(&s->cpu_sheaves->lock, flags);
+	sheaf = this_cpu_ptr(s->cpu_sheaves);
+	if (unlikely(sheaf->size == s->sheaf_capacity)) {
+		unsigned int half = s->sheaf_capacity / 2;
+
+		/* Make room by returning the oldest half to the slabs */
+		sheaf_free_objects(s, sheaf->objects, half);
+		memmove(sheaf->objects, sheaf->objects + half,
+			(sheaf->size - half) * sizeof(void *));
+		sheaf->size -= half;
+		stat(s, SHEAF_FREE_MISS);
+	} else {
+		stat(s, SHEAF_FREE_HIT);
+	}
+	sheaf->objects[sheaf->size++] = object;
+	local_unlock_irqrestore(&s->cpu_sheaves->lock, flags);
+
+	return true;
+}
+
 static __always_inline void slab_free(struct kmem_cache *s, struct page *page,
 				      void *head, void *tail, int cnt,
 				      unsigned long addr)
 {
+	if (s->cpu_sheaves && !tail && free_to_sheaf(s, page, head))
+		return;
+
 	/*
 	 * With KASAN enabled slab_free_freelist_hook modifies the freelist
 	 * to remove objects, whose reuse must be delayed.
@@ -3623,6 +3831,25 @@ int build_detached_freelist(struct kmem_cache *s, size_t size,
 	return first_skipped_index;
 }
 
+/*
+ * Free objects coming out of a sheaf straight to their slabs. The free hooks
+ * were already run when they were put on the sheaf, or do not apply as the
+ * objects never left it.
+ */
+static void sheaf_free_objects(struct kmem_cache *s, void **p, size_t nr)
+{
+	do {
+		struct detached_freelist df;
+
+		nr = build_detached_freelist(s, nr, p, &df);
+		if (!df.page)
+			continue;
+
+		do_slab_free(df.s, df.page, df.freelist, df.tail, df.cnt,
+			     _RET_IP_);
+	} while (likely(nr));
+}
+
 /* Note that interrupts must be enabled when calling this function. */
 void kmem_cache_free_bulk(struct kmem_cache *s, size_t size, void **p)
 {
@@ -3894,6 +4121,25 @@ static inline int alloc_kmem_cache_cpus(struct kmem_cache *s)
 	return 1;
 }
 
+static int alloc_cpu_sheaves(struct kmem_cache *s)
+{
+	int cpu;
+
+	if (!s->sheaf_capacity)
+		return 1;
+
+	s->cpu_sheaves = __alloc_percpu(sizeof(struct slub_percpu_sheaf) +
+					s->sheaf_capacity * sizeof(void *),
+					sizeof(void *));
+	if (!s->cpu_sheaves)
+		return 0;
+
+	for_each_possible_cpu(cpu)
+		local_lock_init(&per_cpu_ptr(s->cpu_sheaves, cpu)->lock);
+
+	return 1;
+}
+
 static struct kmem_cache *kmem_cache_node;
 
 /*
@@ -3955,6 +4201,7 @@ static void free_kmem_cache_nodes(struct kmem_cache *s)
 void __kmem_cache_release(struct kmem_cache *s)
 {
 	cache_random_seq_destroy(s);
+	free_percpu(s->cpu_sheaves);
 	free_percpu(s->cpu_slab);
 	free_kmem_cache_nodes(s);
 }
@@ -3993,6 +4240,25 @@ static void set_min_partial(struct kmem_cache *s, unsigned long min)
 	s->min_partial = min;
 }
 
+static void set_sheaf_capacity(struct kmem_cache *s)
+{
+	/*
+	 * Sheaves are refilled and flushed half a sheaf at a time. They
+	 * would bypass the debug checks done in the slow paths, so caches
+	 * being debugged do not get them.
+	 */
+	if (!(s->flags & SLAB_SHEAVES) || kmem_cache_debug(s))
+		s->sheaf_capacity = 0;
+	else if (s->size >= PAGE_SIZE)
+		s->sheaf_capacity = 8;
+	else if (s->size >= 1024)
+		s->sheaf_capacity = 16;
+	else if (s->size >= 256)
+		s->sheaf_capacity = 32;
+	else
+		s->sheaf_capacity = SHEAF_MAX_CAPACITY;
+}
+
 static void set_cpu_partial(struct kmem_cache *s)
 {
 #ifdef CONFIG_SLUB_CPU_PARTIAL
@@ -4202,6 +4468,7 @@ static int kmem_cache_open(struct kmem_cache *s, slab_flags_t flags)
 	set_min_partial(s, ilog2(s->size) / 2);
 
 	set_cpu_partial(s);
+	set_sheaf_capacity(s);
 
 #ifdef CONFIG_NUMA
 	s->remote_node_defrag_ratio = 1000;
@@ -4216,7 +4483,7 @@ static int kmem_cache_open(struct kmem_cache *s, slab_flags_t flags)
 	if (!init_kmem_cache_nodes(s))
 		goto error;
 
-	if (alloc_kmem_cache_cpus(s))
+	if (alloc_kmem_cache_cpus(s) && alloc_cpu_sheaves(s))
 		return 0;
 
 error:
@@ -5425,6 +5692,12 @@ static ssize_t cpu_partial_store(struct kmem_cache *s, const char *buf,
 }
 SLAB_ATTR(cpu_partial);
 
+static ssize_t sheaf_capacity_show(struct kmem_cache *s, char *buf)
+{
+	return sysfs_emit(buf, "%u\n", s->sheaf_capacity);
+}
+SLAB_ATTR_RO(sheaf_capacity);
+
 static ssize_t ctor_show(struct kmem_cache *s, char *buf)
 {
 	if (!s->ctor)
@@ -5729,6 +6002,11 @@ STAT_ATTR(CPU_PARTIAL_ALLOC, cpu_partial_alloc);
 STAT_ATTR(CPU_PARTIAL_FREE, cpu_partial_free);
 STAT_ATTR(CPU_PARTIAL_NODE, cpu_partial_node);
 STAT_ATTR(CPU_PARTIAL_DRAIN, cpu_partial_drain);
+STAT_ATTR(SHEAF_ALLOC_HIT, sheaf_alloc_hit);
+STAT_ATTR(SHEAF_ALLOC_MISS, sheaf_alloc_miss);
+STAT_ATTR(SHEAF_FREE_HIT, sheaf_free_hit);
+STAT_ATTR(SHEAF_FREE_MISS, sheaf_free_miss);
+STAT_ATTR(SHEAF_FLUSH, sheaf_flush);
 #endif	/* CONFIG_SLUB_STATS */
 
 static struct attribute *slab_attrs[] = {
@@ -5738,6 +6016,7 @@ static struct attribute *slab_attrs[] = {
 	&order_attr.attr,
 	&min_partial_attr.attr,
 	&cpu_partial_attr.attr,
+	&sheaf_capacity_attr.attr,
 	&objects_attr.attr,
 	&objects_partial_attr.attr,
 	&partial_attr.attr,
@@ -5793,6 +6072,11 @@ static struct attribute *slab_attrs[] = {
 	&cpu_partial_free_attr.attr,
 	&cpu_partial_node_attr.attr,
 	&cpu_partial_drain_attr.attr,
+	&sheaf_alloc_hit_attr.attr,
+	&sheaf_alloc_miss_attr.attr,
+	&sheaf_free_hit_attr.attr,
+	&sheaf_free_miss_attr.attr,
+	&sheaf_flush_attr.attr,
 #endif
 #ifdef CONFIG_FAILSLAB
 	&failslab_attr.attr,
@@ -255,6 +255,56 @@ int invalidate_inode_page(struct page *page)
 	return invalidate_complete_page(mapping, page);
 }
 
+/*
+ * Handle a page which is only partly inside the byte range [@start, @end].
+ * Zero the part being truncated and, for a large page, try to split it so
+ * that the subpages wholly inside the range can be removed.  A large page
+ * which cannot be split is removed completely unless it is dirty.
+ *
+ * Returns false if the page could not be dealt with and is kept; the caller
+ * must then leave its indices alone.
+ */
+static bool truncate_inode_partial_page(struct page *page, loff_t start,
+		loff_t end)
+{
+	loff_t pos = page_offset(page);
+	unsigned int offset, length;
+
+	if (pos < start)
+		offset = start - pos;
+	else
+		offset = 0;
+	length = thp_size(page);
+	if (pos + length <= (u64)end)
+		length = length - offset;
+	else
+		length = end + 1 - pos - offset;
+
+	wait_on_page_writeback(page);
+	if (length == thp_size(page)) {
+		truncate_inode_page(page->mapping, page);
+		return true;
+	}
+
+	/*
+	 * We may be zeroing pages we're about to discard, but it avoids
+	 * doing a complex calculation here, and then doing the zeroing
+	 * anyway if the page split fails.
+	 */
+	zero_user(page, offset, length);
+	cleancache_invalidate_page(page->mapping, page);
+	if (page_has_private(page))
+		do_invalidatepage(page, offset, length);
+	if (!PageTransHuge(page))
+		return true;
+	if (split_huge_page(page) == 0)
+		return true;
+	if (PageDirty(page))
+		return false;
+	truncate_inode_page(page->mapping, page);
+	return true;
+}
+
 /**
  * truncate_inode_pages_range - truncate range of pages specified by start & end byte offsets
  * @mapping: mapping to truncate
@@ -284,24 +334,20 @@ void truncate_inode_pages_range(struct address_space *mapping,
 {
 	pgoff_t		start;		/* inclusive */
 	pgoff_t		end;		/* exclusive */
-	unsigned int	partial_start;	/* inclusive */
-	unsigned int	partial_end;	/* exclusive */
 	struct pagevec	pvec;
 	pgoff_t		indices[PAGEVEC_SIZE];
 	pgoff_t		index;
+	struct page	*page;
+	bool		same_page;
 	int		i;
 
 	if (mapping_empty(mapping))
 		goto out;
 
-	/* Offsets within partial pages */
-	partial_start = lstart & (PAGE_SIZE - 1);
-	partial_end = (lend + 1) & (PAGE_SIZE - 1);
-
 	/*
 	 * 'start' and 'end' always covers the range of pages to be fully
-	 * truncated. Partial pages are covered with 'partial_start' at the
-	 * start of the range and 'partial_end' at the end of the range.
+	 * truncated. Pages at either end of the range, possibly large ones,
+	 * may only be partly covered and are dealt with separately.
 	 * Note that 'end' is exclusive while 'lend' is inclusive.
 	 */
 	start = (lstart + PAGE_SIZE - 1) >> PAGE_SHIFT;
@@ -330,37 +376,27 @@ void truncate_inode_pages_range(struct address_space *mapping,
 		cond_resched();
 	}
 
-	if (partial_start) {
-		struct page *page = find_lock_page(mapping, start - 1);
-		if (page) {
-			unsigned int top = PAGE_SIZE;
-			if (start > end) {
-				/* Truncation within a single page */
-				top = partial_end;
-				partial_end = 0;
-			}
-			wait_on_page_writeback(page);
-			zero_user_segment(page, partial_start, top);
-			cleancache_invalidate_page(mapping, page);
-			if (page_has_private(page))
-				do_invalidatepage(page, partial_start,
-						  top - partial_start);
-			unlock_page(page);
-			put_page(page);
+	same_page = (lstart >> PAGE_SHIFT) == (lend >> PAGE_SHIFT);
+	page = find_lock_head(mapping, lstart >> PAGE_SHIFT);
+	if (page) {
+		same_page = lend < page_offset(page) + thp_size(page);
+		if (!truncate_inode_partial_page(page, lstart, lend)) {
+			start = page->index + thp_nr_pages(page);
+			if (same_page)
+				end = page->index;
 		}
+		unlock_page(page);
+		put_page(page);
+		page = NULL;
 	}
-	if (partial_end) {
-		struct page *page = find_lock_page(mapping, end);
-		if (page) {
-			wait_on_page_writeback(page);
-			zero_user_segment(page, 0, partial_end);
-			cleancache_invalidate_page(mapping, page);
-			if (page_has_private(page))
-				do_invalidatepage(page, 0,
-						  partial_end);
-			unlock_page(page);
-			put_page(page);
-		}
+
+	if (!same_page)
+		page = find_lock_head(mapping, lend >> PAGE_SHIFT);
+	if (page) {
+		if (!truncate_inode_partial_page(page, lstart, lend))
+			end = page->index;
+		unlock_page(page);
+		put_page(page);
 	}
 	/*
 	 * If the truncation happened within a single page no pages
@@ -391,11 +427,13 @@ void truncate_inode_pages_range(struct address_space *mapping,
 			if (xa_is_value(page))
 				continue;
 
+			page = thp_head(page);
 			lock_page(page);
-			WARN_ON(page_to_index(page) != index);
+			WARN_ON(!thp_contains(page, index));
 			wait_on_page_writeback(page);
 			truncate_inode_page(mapping, page);
 			unlock_page(page);
+			index = page->index + thp_nr_pages(page) - 1;
 		}
 		truncate_exceptional_pvec_entries(mapping, &pvec, indices);
 		pagevec_release(&pvec);
@@ -578,6 +616,9 @@ invalidate_complete_page2(struct address_space *mapping, struct page *page)
 	if (mapping->a_ops->freepage)
 		mapping->a_ops->freepage(page);
 
+	/* a large page holds a pagecache ref for each of its subpages */
+	if (PageTransHuge(page) && !PageHuge(page))
+		page_ref_sub(page, thp_nr_pages(page) - 1);
 	put_page(page);	/* pagecache ref */
 	return 1;
 failed:
@@ -645,8 +686,13 @@ int invalidate_inode_pages2_range(struct address_space *mapping,
 				did_range_unmap = 1;
 			}
 
+			/*
+			 * A large page is invalidated as a whole, even if the
+			 * range only covers part of it.
+			 */
+			page = thp_head(page);
 			lock_page(page);
-			WARN_ON(page_to_index(page) != index);
+			WARN_ON(!thp_contains(page, index));
 			if (page->mapping != mapping) {
 				unlock_page(page);
 				continue;
@@ -664,6 +710,7 @@ int invalidate_inode_pages2_range(struct address_space *mapping,
 			}
 			if (ret2 < 0)
 				ret = ret2;
+			index = page->index + thp_nr_pages(page) - 1;
 			unlock_page(page);
 		}
 		pagevec_remove_exceptionals(&pvec);
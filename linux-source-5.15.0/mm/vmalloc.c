@@ -715,17 +715,9 @@ EXPORT_SYMBOL(vmalloc_to_pfn);
 #define DEBUG_AUGMENT_LOWEST_MATCH_CHECK 0
 
 
-static DEFINE_SPINLOCK(vmap_area_lock);
 static DEFINE_SPINLOCK(free_vmap_area_lock);
-/* Export for kexec only */
-LIST_HEAD(vmap_area_list);
-static struct rb_root vmap_area_root = RB_ROOT;
 static bool vmap_initialized __read_mostly;
 
-static struct rb_root purge_vmap_area_root = RB_ROOT;
-static LIST_HEAD(purge_vmap_area_list);
-static DEFINE_SPINLOCK(purge_vmap_area_lock);
-
 /*
  * This kmem_cache is used for vmap_area objects. Instead of
  * allocating from slab we reuse an object from this cache to
@@ -759,6 +751,66 @@ static struct rb_root free_vmap_area_root = RB_ROOT;
  */
 static DEFINE_PER_CPU(struct vmap_area *, ne_fit_preload_node);
 
+/*
+ * Busy and lazily freed areas are not kept in one tree protected by
+ * one lock, they are spread over an array of vmap nodes instead. The
+ * KVA space is split into zones of vmap_zone_size bytes which are
+ * assigned to the nodes in a round-robin manner, and an area belongs
+ * to the node of the zone its start address falls into. That way
+ * allocating, freeing and looking up areas on different CPUs mostly
+ * takes different locks.
+ *
+ * The free space is still one global tree. To keep the common small
+ * allocations away from free_vmap_area_lock, a node also caches the
+ * purged areas of up to MAX_VA_SIZE_PAGES pages in per-size pools,
+ * which are given out again to the CPUs mapped to that node. Pools
+ * are decayed back to the free tree on each purge.
+ */
+#define MAX_VA_SIZE_PAGES 256
+
+struct vmap_pool {
+	struct list_head head;
+	unsigned long len;
+};
+
+static struct vmap_node {
+	/* Pools of purged areas, indexed by size in pages. */
+	struct vmap_pool pool[MAX_VA_SIZE_PAGES];
+	spinlock_t pool_lock;
+
+	/* Allocated areas, sorted by address. */
+	struct {
+		struct rb_root root;
+		struct list_head head;
+		spinlock_t lock;
+	} busy;
+
+	/* Freed areas which still wait for a TLB flush. */
+	struct {
+		struct rb_root root;
+		struct list_head head;
+		spinlock_t lock;
+	} lazy;
+
+	/* Areas detached from the lazy tree by a purge in progress. */
+	struct list_head purge_list;
+} single, *vmap_nodes __read_mostly = &single;
+
+static unsigned int nr_vmap_nodes __read_mostly = 1;
+static unsigned int vmap_zone_size __read_mostly = 1;
+
+static inline unsigned int
+addr_to_node_id(unsigned long addr)
+{
+	return (addr / vmap_zone_size) % nr_vmap_nodes;
+}
+
+static inline struct vmap_node *
+addr_to_node(unsigned long addr)
+{
+	return &vmap_nodes[addr_to_node_id(addr)];
+}
+
 static __always_inline unsigned long
 va_size(struct vmap_area *va)
 {
@@ -799,10 +851,11 @@ unsigned long vmalloc_nr_pages(void)
 	return atomic_long_read(&nr_vmalloc_pages);
 }
 
-static struct vmap_area *find_vmap_area_exceed_addr(unsigned long addr)
+static struct vmap_area *
+__find_vmap_area_exceed_addr(unsigned long addr, struct rb_root *root)
 {
 	struct vmap_area *va = NULL;
-	struct rb_node *n = vmap_area_root.rb_node;
+	struct rb_node *n = root->rb_node;
 
 	while (n) {
 		struct vmap_area *tmp;
@@ -821,9 +874,10 @@ static struct vmap_area *find_vmap_area_exceed_addr(unsigned long addr)
 	return va;
 }
 
-static struct vmap_area *__find_vmap_area(unsigned long addr)
+static struct vmap_area *
+__find_vmap_area(unsigned long addr, struct rb_root *root)
 {
-	struct rb_node *n = vmap_area_root.rb_node;
+	struct rb_node *n = root->rb_node;
 
 	while (n) {
 		struct vmap_area *va;
@@ -1465,12 +1519,14 @@ __alloc_vmap_area(unsigned long size, unsigned long align,
  */
 static void free_vmap_area(struct vmap_area *va)
 {
+	struct vmap_node *vn = addr_to_node(va->va_start);
+
 	/*
 	 * Remove from the busy tree/list.
 	 */
-	spin_lock(&vmap_area_lock);
-	unlink_va(va, &vmap_area_root);
-	spin_unlock(&vmap_area_lock);
+	spin_lock(&vn->busy.lock);
+	unlink_va(va, &vn->busy.root);
+	spin_unlock(&vn->busy.lock);
 
 	/*
 	 * Insert/Merge it back to the free tree/list.
@@ -1503,6 +1559,76 @@ preload_this_cpu_lock(spinlock_t *lock, gfp_t gfp_mask, int node)
 		kmem_cache_free(vmap_area_cachep, va);
 }
 
+static inline struct vmap_pool *
+size_to_va_pool(struct vmap_node *vn, unsigned long size)
+{
+	unsigned int idx = (size - 1) / PAGE_SIZE;
+
+	if (idx < MAX_VA_SIZE_PAGES)
+		return &vn->pool[idx];
+
+	return NULL;
+}
+
+static bool
+node_pool_add_va(struct vmap_node *vn, struct vmap_area *va)
+{
+	struct vmap_pool *vp;
+
+	vp = size_to_va_pool(vn, va_size(va));
+	if (!vp)
+		return false;
+
+	spin_lock(&vn->pool_lock);
+	list_add(&va->list, &vp->head);
+	vp->len++;
+	spin_unlock(&vn->pool_lock);
+
+	return true;
+}
+
+/*
+ * Take a purged area of exactly @size bytes from the pool of the node
+ * this CPU maps to. Only requests for the whole vmalloc space are served
+ * this way, everything else goes to the global free tree.
+ */
+static struct vmap_area *
+node_alloc(unsigned long size, unsigned long align,
+	unsigned long vstart, unsigned long vend)
+{
+	struct vmap_area *va = NULL;
+	struct vmap_node *vn;
+	struct vmap_pool *vp;
+
+	if (nr_vmap_nodes == 1)
+		return NULL;
+
+	if (vstart != VMALLOC_START || vend != VMALLOC_END)
+		return NULL;
+
+	vn = &vmap_nodes[raw_smp_processor_id() % nr_vmap_nodes];
+	vp = size_to_va_pool(vn, size);
+	if (!vp || list_empty(&vp->head))
+		return NULL;
+
+	spin_lock(&vn->pool_lock);
+	if (!list_empty(&vp->head)) {
+		va = list_first_entry(&vp->head, struct vmap_area, list);
+
+		if (IS_ALIGNED(va->va_start, align) && va_size(va) == size) {
+			list_del_init(&va->list);
+			vp->len--;
+		} else {
+			/* Rotate it, so the next request sees another one. */
+			list_move_tail(&va->list, &vp->head);
+			va = NULL;
+		}
+	}
+	spin_unlock(&vn->pool_lock);
+
+	return va;
+}
+
 /*
  * Allocate a region of KVA of the specified size and alignment, within the
  * vstart and vend.
@@ -1512,6 +1638,7 @@ static struct vmap_area *alloc_vmap_area(unsigned long size,
 				unsigned long vstart, unsigned long vend,
 				int node, gfp_t gfp_mask)
 {
+	struct vmap_node *vn;
 	struct vmap_area *va;
 	unsigned long freed;
 	unsigned long addr;
@@ -1528,20 +1655,32 @@ static struct vmap_area *alloc_vmap_area(unsigned long size,
 	might_sleep();
 	gfp_mask = gfp_mask & GFP_RECLAIM_MASK;
 
-	va = kmem_cache_alloc_node(vmap_area_cachep, gfp_mask, node);
-	if (unlikely(!va))
-		return ERR_PTR(-ENOMEM);
-
 	/*
-	 * Only scan the relevant parts containing pointers to other objects
-	 * to avoid false negatives.
+	 * A pooled area comes ready to use, so neither a new vmap_area
+	 * object nor free_vmap_area_lock is needed then.
 	 */
-	kmemleak_scan_area(&va->rb_node, SIZE_MAX, gfp_mask);
+	va = node_alloc(size, align, vstart, vend);
+	if (va) {
+		addr = va->va_start;
+	} else {
+		va = kmem_cache_alloc_node(vmap_area_cachep, gfp_mask, node);
+		if (unlikely(!va))
+			return ERR_PTR(-ENOMEM);
+
+		/*
+		 * Only scan the relevant parts containing pointers to other
+		 * objects to avoid false negatives.
+		 */
+		kmemleak_scan_area(&va->rb_node, SIZE_MAX, gfp_mask);
+		addr = vend;
+	}
 
 retry:
-	preload_this_cpu_lock(&free_vmap_area_lock, gfp_mask, node);
-	addr = __alloc_vmap_area(size, align, vstart, vend);
-	spin_unlock(&free_vmap_area_lock);
+	if (addr == vend) {
+		preload_this_cpu_lock(&free_vmap_area_lock, gfp_mask, node);
+		addr = __alloc_vmap_area(size, align, vstart, vend);
+		spin_unlock(&free_vmap_area_lock);
+	}
 
 	/*
 	 * If an allocation fails, the "vend" address is
@@ -1554,9 +1693,10 @@ retry:
 	va->va_end = addr + size;
 	va->vm = NULL;
 
-	spin_lock(&vmap_area_lock);
-	insert_vmap_area(va, &vmap_area_root, &vmap_area_list);
-	spin_unlock(&vmap_area_lock);
+	vn = addr_to_node(va->va_start);
+	spin_lock(&vn->busy.lock);
+	insert_vmap_area(va, &vn->busy.root, &vn->busy.head);
+	spin_unlock(&vn->busy.lock);
 
 	BUG_ON(!IS_ALIGNED(va->va_start, align));
 	BUG_ON(va->va_start < vstart);
@@ -1654,38 +1794,20 @@ void set_iounmap_nonlazy(void)
 #endif /* CONFIG_X86_64 */
 
 /*
- * Purges all lazily-freed vmap areas.
+ * Return a list of detached areas to the global free tree.
  */
-static bool __purge_vmap_area_lazy(unsigned long start, unsigned long end)
+static void reclaim_list_global(struct list_head *head)
 {
 	unsigned long resched_threshold;
-	struct list_head local_pure_list;
 	struct vmap_area *va, *n_va;
 
-	lockdep_assert_held(&vmap_purge_lock);
-
-	spin_lock(&purge_vmap_area_lock);
-	purge_vmap_area_root = RB_ROOT;
-	list_replace_init(&purge_vmap_area_list, &local_pure_list);
-	spin_unlock(&purge_vmap_area_lock);
-
-	if (unlikely(list_empty(&local_pure_list)))
-		return false;
-
-	start = min(start,
-		list_first_entry(&local_pure_list,
-			struct vmap_area, list)->va_start);
-
-	end = max(end,
-		list_last_entry(&local_pure_list,
-			struct vmap_area, list)->va_end);
+	if (list_empty(head))
+		return;
 
-	flush_tlb_kernel_range(start, end);
 	resched_threshold = lazy_max_pages() << 1;
 
 	spin_lock(&free_vmap_area_lock);
-	list_for_each_entry_safe(va, n_va, &local_pure_list, list) {
-		unsigned long nr = (va->va_end - va->va_start) >> PAGE_SHIFT;
+	list_for_each_entry_safe(va, n_va, head, list) {
 		unsigned long orig_start = va->va_start;
 		unsigned long orig_end = va->va_end;
 
@@ -1704,12 +1826,115 @@ static bool __purge_vmap_area_lazy(unsigned long start, unsigned long end)
 			kasan_release_vmalloc(orig_start, orig_end,
 					      va->va_start, va->va_end);
 
-		atomic_long_sub(nr, &vmap_lazy_nr);
-
 		if (atomic_long_read(&vmap_lazy_nr) < resched_threshold)
 			cond_resched_lock(&free_vmap_area_lock);
 	}
 	spin_unlock(&free_vmap_area_lock);
+}
+
+/*
+ * Give back ~25% of the pooled areas of a node to the free tree, or all
+ * of them if @full_decay is set, so that pools neither pin KVA forever
+ * nor keep an allocation that needs a bigger block from succeeding.
+ */
+static void decay_va_pool_node(struct vmap_node *vn, bool full_decay)
+{
+	LIST_HEAD(decay_list);
+	struct vmap_area *va;
+	unsigned long n_decay;
+	int i;
+
+	spin_lock(&vn->pool_lock);
+	for (i = 0; i < MAX_VA_SIZE_PAGES; i++) {
+		struct vmap_pool *vp = &vn->pool[i];
+
+		n_decay = full_decay ? vp->len : vp->len >> 2;
+		for (; n_decay; n_decay--) {
+			va = list_last_entry(&vp->head, struct vmap_area, list);
+			list_move(&va->list, &decay_list);
+			vp->len--;
+		}
+	}
+	spin_unlock(&vn->pool_lock);
+
+	reclaim_list_global(&decay_list);
+}
+
+static void purge_vmap_node(struct vmap_node *vn)
+{
+	unsigned long nr_purged_pages = 0;
+	struct vmap_area *va, *n_va;
+	LIST_HEAD(local_list);
+
+	list_for_each_entry_safe(va, n_va, &vn->purge_list, list) {
+		list_del_init(&va->list);
+		nr_purged_pages += va_size(va) >> PAGE_SHIFT;
+
+		/*
+		 * Small vmalloc areas are kept in the pool of the node for
+		 * reuse, the rest goes back to the global free tree.
+		 */
+		if (nr_vmap_nodes > 1 && size_to_va_pool(vn, va_size(va)) &&
+				va->va_start >= VMALLOC_START &&
+				va->va_end <= VMALLOC_END) {
+			kasan_release_vmalloc(va->va_start, va->va_end,
+					      va->va_start, va->va_end);
+
+			if (node_pool_add_va(vn, va))
+				continue;
+		}
+
+		list_add_tail(&va->list, &local_list);
+	}
+
+	atomic_long_sub(nr_purged_pages, &vmap_lazy_nr);
+	reclaim_list_global(&local_list);
+}
+
+/*
+ * Purges all lazily-freed vmap areas.
+ */
+static bool __purge_vmap_area_lazy(unsigned long start, unsigned long end,
+				   bool full_pool_decay)
+{
+	struct vmap_node *vn;
+	bool found = false;
+	int i;
+
+	lockdep_assert_held(&vmap_purge_lock);
+
+	for (i = 0; i < nr_vmap_nodes; i++) {
+		vn = &vmap_nodes[i];
+
+		if (nr_vmap_nodes > 1)
+			decay_va_pool_node(vn, full_pool_decay);
+
+		spin_lock(&vn->lazy.lock);
+		vn->lazy.root = RB_ROOT;
+		list_replace_init(&vn->lazy.head, &vn->purge_list);
+		spin_unlock(&vn->lazy.lock);
+
+		if (list_empty(&vn->purge_list))
+			continue;
+
+		start = min(start, list_first_entry(&vn->purge_list,
+				struct vmap_area, list)->va_start);
+
+		end = max(end, list_last_entry(&vn->purge_list,
+				struct vmap_area, list)->va_end);
+
+		found = true;
+	}
+
+	if (unlikely(!found))
+		return false;
+
+	/* One flush covers the lazy areas of all nodes. */
+	flush_tlb_kernel_range(start, end);
+
+	for (i = 0; i < nr_vmap_nodes; i++)
+		purge_vmap_node(&vmap_nodes[i]);
+
 	return true;
 }
 
@@ -1720,19 +1945,20 @@ static bool __purge_vmap_area_lazy(unsigned long start, unsigned long end)
 static void try_purge_vmap_area_lazy(void)
 {
 	if (mutex_trylock(&vmap_purge_lock)) {
-		__purge_vmap_area_lazy(ULONG_MAX, 0);
+		__purge_vmap_area_lazy(ULONG_MAX, 0, false);
 		mutex_unlock(&vmap_purge_lock);
 	}
 }
 
 /*
- * Kick off a purge of the outstanding lazy areas.
+ * Kick off a purge of the outstanding lazy areas. The node pools are
+ * drained as well, this is called when the KVA space runs out.
  */
 static void purge_vmap_area_lazy(void)
 {
 	mutex_lock(&vmap_purge_lock);
 	purge_fragmented_blocks_allcpus();
-	__purge_vmap_area_lazy(ULONG_MAX, 0);
+	__purge_vmap_area_lazy(ULONG_MAX, 0, true);
 	mutex_unlock(&vmap_purge_lock);
 }
 
@@ -1743,22 +1969,22 @@ static void purge_vmap_area_lazy(void)
  */
 static void free_vmap_area_noflush(struct vmap_area *va)
 {
+	struct vmap_node *vn = addr_to_node(va->va_start);
 	unsigned long nr_lazy;
 
-	spin_lock(&vmap_area_lock);
-	unlink_va(va, &vmap_area_root);
-	spin_unlock(&vmap_area_lock);
+	spin_lock(&vn->busy.lock);
+	unlink_va(va, &vn->busy.root);
+	spin_unlock(&vn->busy.lock);
 
 	nr_lazy = atomic_long_add_return((va->va_end - va->va_start) >>
 				PAGE_SHIFT, &vmap_lazy_nr);
 
 	/*
-	 * Merge or place it to the purge tree/list.
+	 * Merge or place it to the lazy tree/list of its node.
 	 */
-	spin_lock(&purge_vmap_area_lock);
-	merge_or_add_vmap_area(va,
-		&purge_vmap_area_root, &purge_vmap_area_list);
-	spin_unlock(&purge_vmap_area_lock);
+	spin_lock(&vn->lazy.lock);
+	merge_or_add_vmap_area(va, &vn->lazy.root, &vn->lazy.head);
+	spin_unlock(&vn->lazy.lock);
 
 	/* After this point, we may free va at any time */
 	if (unlikely(nr_lazy > lazy_max_pages()))
@@ -1778,13 +2004,50 @@ static void free_unmap_vmap_area(struct vmap_area *va)
 	free_vmap_area_noflush(va);
 }
 
+/*
+ * Find the area containing @addr and return it with the busy lock of its
+ * node held. An area is kept in the node of its start address, so a
+ * lookup by an address inside an area spanning several zones may have
+ * to visit other nodes:
+ *
+ *      <----va---->
+ * -|-----|-----|-----|-----|-
+ *     1     2     0     1
+ *
+ * va lives in node 1, looking it up by an address in the zones of node
+ * 2 or 0 needs extra work, which is not the common case.
+ */
+static struct vmap_area *
+find_vmap_area_lock(unsigned long addr, struct vmap_node **vnp)
+{
+	struct vmap_area *va;
+	struct vmap_node *vn;
+	int i, j;
+
+	i = j = addr_to_node_id(addr);
+	do {
+		vn = &vmap_nodes[i];
+
+		spin_lock(&vn->busy.lock);
+		va = __find_vmap_area(addr, &vn->busy.root);
+		if (va) {
+			*vnp = vn;
+			return va;
+		}
+		spin_unlock(&vn->busy.lock);
+	} while ((i = (i + 1) % nr_vmap_nodes) != j);
+
+	return NULL;
+}
+
 static struct vmap_area *find_vmap_area(unsigned long addr)
 {
 	struct vmap_area *va;
+	struct vmap_node *vn;
 
-	spin_lock(&vmap_area_lock);
-	va = __find_vmap_area(addr);
-	spin_unlock(&vmap_area_lock);
+	va = find_vmap_area_lock(addr, &vn);
+	if (va)
+		spin_unlock(&vn->busy.lock);
 
 	return va;
 }
@@ -2104,7 +2367,7 @@ static void _vm_unmap_aliases(unsigned long start, unsigned long end, int flush)
 
 	mutex_lock(&vmap_purge_lock);
 	purge_fragmented_blocks_allcpus();
-	if (!__purge_vmap_area_lazy(start, end) && flush)
+	if (!__purge_vmap_area_lazy(start, end, false) && flush)
 		flush_tlb_kernel_range(start, end);
 	mutex_unlock(&vmap_purge_lock);
 }
@@ -2283,24 +2546,28 @@ void __init vm_area_register_early(struct vm_struct *vm, size_t align)
 	vm_area_add_early(vm);
 }
 
-static void vmap_init_free_space(void)
+static void __init vmap_init_free_space(void)
 {
 	unsigned long vmap_start = 1;
 	const unsigned long vmap_end = ULONG_MAX;
-	struct vmap_area *busy, *free;
+	struct vm_struct *busy;
+	struct vmap_area *free;
 
 	/*
 	 *     B     F     B     B     B     F
 	 * -|-----|.....|-----|-----|-----|.....|-
 	 *  |           The KVA space           |
 	 *  |<--------------------------------->|
+	 *
+	 * The busy areas are spread over the vmap nodes at this point,
+	 * walk the early vmlist instead, which is sorted by address.
 	 */
-	list_for_each_entry(busy, &vmap_area_list, list) {
-		if (busy->va_start - vmap_start > 0) {
+	for (busy = vmlist; busy; busy = busy->next) {
+		if ((unsigned long)busy->addr - vmap_start > 0) {
 			free = kmem_cache_zalloc(vmap_area_cachep, GFP_NOWAIT);
 			if (!WARN_ON_ONCE(!free)) {
 				free->va_start = vmap_start;
-				free->va_end = busy->va_start;
+				free->va_end = (unsigned long)busy->addr;
 
 				insert_vmap_area_augment(free, NULL,
 					&free_vmap_area_root,
@@ -2308,7 +2575,7 @@ static void vmap_init_free_space(void)
 			}
 		}
 
-		vmap_start = busy->va_end;
+		vmap_start = (unsigned long)busy->addr + busy->size;
 	}
 
 	if (vmap_end - vmap_start > 0) {
@@ -2324,9 +2591,57 @@ static void vmap_init_free_space(void)
 	}
 }
 
+static void __init vmap_init_nodes(void)
+{
+	struct vmap_node *vn;
+	int i, n;
+
+#if BITS_PER_LONG == 64
+	/*
+	 * Use one node per possible CPU, up to 128 of them. The KVA space
+	 * is too small on 32-bit systems to be split up this way.
+	 */
+	n = clamp_t(unsigned int, num_possible_cpus(), 1, 128);
+
+	if (n > 1) {
+		vn = kmalloc_array(n, sizeof(*vn), GFP_NOWAIT | __GFP_NOWARN);
+		if (vn) {
+			/* Node partition is 16 pages. */
+			vmap_zone_size = (1 << 4) * PAGE_SIZE;
+			nr_vmap_nodes = n;
+			vmap_nodes = vn;
+		} else {
+			pr_err("Failed to allocate vmap nodes, using a single one\n");
+		}
+	}
+#endif
+
+	for (n = 0; n < nr_vmap_nodes; n++) {
+		vn = &vmap_nodes[n];
+
+		vn->busy.root = RB_ROOT;
+		INIT_LIST_HEAD(&vn->busy.head);
+		spin_lock_init(&vn->busy.lock);
+
+		vn->lazy.root = RB_ROOT;
+		INIT_LIST_HEAD(&vn->lazy.head);
+		spin_lock_init(&vn->lazy.lock);
+
+		INIT_LIST_HEAD(&vn->purge_list);
+
+		for (i = 0; i < MAX_VA_SIZE_PAGES; i++) {
+			INIT_LIST_HEAD(&vn->pool[i].head);
+			vn->pool[i].len = 0;
+		}
+
+		spin_lock_init(&vn->pool_lock);
+	}
+}
+
 void __init vmalloc_init(void)
 {
 	struct vmap_area *va;
+	struct vmap_node *vn;
 	struct vm_struct *tmp;
 	int i;
 
@@ -2335,6 +2650,8 @@ void __init vmalloc_init(void)
 	 */
 	vmap_area_cachep = KMEM_CACHE(vmap_area, SLAB_PANIC);
 
+	vmap_init_nodes();
+
 	for_each_possible_cpu(i) {
 		struct vmap_block_queue *vbq;
 		struct vfree_deferred *p;
@@ -2356,7 +2673,9 @@ void __init vmalloc_init(void)
 		va->va_start = (unsigned long)tmp->addr;
 		va->va_end = va->va_start + tmp->size;
 		va->vm = tmp;
-		insert_vmap_area(va, &vmap_area_root, &vmap_area_list);
+
+		vn = addr_to_node(va->va_start);
+		insert_vmap_area(va, &vn->busy.root, &vn->busy.head);
 	}
 
 	/*
@@ -2379,9 +2698,11 @@ static inline void setup_vmalloc_vm_locked(struct vm_struct *vm,
 static void setup_vmalloc_vm(struct vm_struct *vm, struct vmap_area *va,
 			      unsigned long flags, const void *caller)
 {
-	spin_lock(&vmap_area_lock);
+	struct vmap_node *vn = addr_to_node(va->va_start);
+
+	spin_lock(&vn->busy.lock);
 	setup_vmalloc_vm_locked(vm, va, flags, caller);
-	spin_unlock(&vmap_area_lock);
+	spin_unlock(&vn->busy.lock);
 }
 
 static void clear_vm_uninitialized_flag(struct vm_struct *vm)
@@ -2502,17 +2823,20 @@ struct vm_struct *find_vm_area(const void *addr)
  */
 struct vm_struct *remove_vm_area(const void *addr)
 {
+	struct vmap_node *vn;
 	struct vmap_area *va;
 
 	might_sleep();
 
-	spin_lock(&vmap_area_lock);
-	va = __find_vmap_area((unsigned long)addr);
-	if (va && va->vm) {
+	va = find_vmap_area_lock((unsigned long)addr, &vn);
+	if (!va)
+		return NULL;
+
+	if (va->vm) {
 		struct vm_struct *vm = va->vm;
 
 		va->vm = NULL;
-		spin_unlock(&vmap_area_lock);
+		spin_unlock(&vn->busy.lock);
 
 		kasan_free_shadow(vm);
 		free_unmap_vmap_area(va);
@@ -2520,7 +2844,7 @@ struct vm_struct *remove_vm_area(const void *addr)
 		return vm;
 	}
 
-	spin_unlock(&vmap_area_lock);
+	spin_unlock(&vn->busy.lock);
 	return NULL;
 }
 
@@ -3296,6 +3620,50 @@ static int aligned_vread(char *buf, char *addr, unsigned long count)
 	return copied;
 }
 
+/*
+ * Find the lowest area which ends above @addr over all nodes and return
+ * its node with the busy lock held, or NULL if there is none.
+ */
+static struct vmap_node *
+find_vmap_area_exceed_addr_lock(unsigned long addr, struct vmap_area **va)
+{
+	unsigned long va_start_lowest;
+	struct vmap_node *vn;
+	int i;
+
+repeat:
+	for (i = 0, va_start_lowest = 0; i < nr_vmap_nodes; i++) {
+		vn = &vmap_nodes[i];
+
+		spin_lock(&vn->busy.lock);
+		*va = __find_vmap_area_exceed_addr(addr, &vn->busy.root);
+
+		if (*va)
+			if (!va_start_lowest || (*va)->va_start < va_start_lowest)
+				va_start_lowest = (*va)->va_start;
+		spin_unlock(&vn->busy.lock);
+	}
+
+	/*
+	 * The area might have gone away after its node was unlocked. That
+	 * is rare, just repeat the search then.
+	 */
+	if (va_start_lowest) {
+		vn = addr_to_node(va_start_lowest);
+
+		spin_lock(&vn->busy.lock);
+		*va = __find_vmap_area(va_start_lowest, &vn->busy.root);
+
+		if (*va)
+			return vn;
+
+		spin_unlock(&vn->busy.lock);
+		goto repeat;
+	}
+
+	return NULL;
+}
+
 /**
  * vread() - read vmalloc area in a safe way.
  * @buf:     buffer for reading data
@@ -3323,38 +3691,36 @@ static int aligned_vread(char *buf, char *addr, unsigned long count)
 long vread(char *buf, char *addr, unsigned long count)
 {
 	struct vmap_area *va;
+	struct vmap_node *vn;
 	struct vm_struct *vm;
 	char *vaddr, *buf_start = buf;
 	unsigned long buflen = count;
-	unsigned long n;
+	unsigned long n, next;
 
 	/* Don't allow overflow */
 	if ((unsigned long) addr + count < count)
 		count = -(unsigned long) addr;
 
-	spin_lock(&vmap_area_lock);
-	va = find_vmap_area_exceed_addr((unsigned long)addr);
-	if (!va)
+	vn = find_vmap_area_exceed_addr_lock((unsigned long)addr, &va);
+	if (!vn)
 		goto finished;
 
 	/* no intersects with alive vmap_area */
 	if ((unsigned long)addr + count <= va->va_start)
-		goto finished;
-
-	list_for_each_entry_from(va, &vmap_area_list, list) {
-		if (!count)
-			break;
-
-		if (!va->vm)
-			continue;
+		goto finished_unlock;
 
+	do {
 		vm = va->vm;
+		if (!vm)
+			goto next_va;
+
 		vaddr = (char *) vm->addr;
 		if (addr >= vaddr + get_vm_area_size(vm))
-			continue;
+			goto next_va;
+
 		while (addr < vaddr) {
 			if (count == 0)
-				goto finished;
+				goto finished_unlock;
 			*buf = '\0';
 			buf++;
 			addr++;
@@ -3370,9 +3736,16 @@ long vread(char *buf, char *addr, unsigned long count)
 		buf += n;
 		addr += n;
 		count -= n;
-	}
+next_va:
+		next = va->va_end;
+		spin_unlock(&vn->busy.lock);
+	} while (count && (vn = find_vmap_area_exceed_addr_lock(next, &va)));
+
+	goto finished;
+
+finished_unlock:
+	spin_unlock(&vn->busy.lock);
 finished:
-	spin_unlock(&vmap_area_lock);
 
 	if (buf == buf_start)
 		return 0;
@@ -3719,14 +4092,15 @@ retry:
 	}
 
 	/* insert all vm's */
-	spin_lock(&vmap_area_lock);
 	for (area = 0; area < nr_vms; area++) {
-		insert_vmap_area(vas[area], &vmap_area_root, &vmap_area_list);
+		struct vmap_node *vn = addr_to_node(vas[area]->va_start);
 
+		spin_lock(&vn->busy.lock);
+		insert_vmap_area(vas[area], &vn->busy.root, &vn->busy.head);
 		setup_vmalloc_vm_locked(vms[area], vas[area], VM_ALLOC,
 				 pcpu_get_vm_areas);
+		spin_unlock(&vn->busy.lock);
 	}
-	spin_unlock(&vmap_area_lock);
 
 	kfree(vas);
 	return vms;
@@ -3829,26 +4203,35 @@ bool vmalloc_dump_obj(void *object)
 	const void *caller;
 	struct vm_struct *vm;
 	struct vmap_area *va;
+	struct vmap_node *vn;
 	unsigned long addr;
 	unsigned int nr_pages;
+	int i, j;
 
-	if (!spin_trylock(&vmap_area_lock))
-		return false;
-	va = __find_vmap_area((unsigned long)objp);
-	if (!va) {
-		spin_unlock(&vmap_area_lock);
+	i = j = addr_to_node_id((unsigned long)objp);
+	do {
+		vn = &vmap_nodes[i];
+
+		if (!spin_trylock(&vn->busy.lock))
+			return false;
+		va = __find_vmap_area((unsigned long)objp, &vn->busy.root);
+		if (va)
+			break;
+		spin_unlock(&vn->busy.lock);
+	} while ((i = (i + 1) % nr_vmap_nodes) != j);
+
+	if (!va)
 		return false;
-	}
 
 	vm = va->vm;
 	if (!vm) {
-		spin_unlock(&vmap_area_lock);
+		spin_unlock(&vn->busy.lock);
 		return false;
 	}
 	addr = (unsigned long)vm->addr;
 	caller = vm->caller;
 	nr_pages = vm->nr_pages;
-	spin_unlock(&vmap_area_lock);
+	spin_unlock(&vn->busy.lock);
 	pr_cont(" %u-page vmalloc region starting at %#lx allocated at %pS\n",
 		nr_pages, addr, caller);
 	return true;
@@ -3856,33 +4239,11 @@ bool vmalloc_dump_obj(void *object)
 #endif
 
 #ifdef CONFIG_PROC_FS
-static void *s_start(struct seq_file *m, loff_t *pos)
-	__acquires(&vmap_purge_lock)
-	__acquires(&vmap_area_lock)
-{
-	mutex_lock(&vmap_purge_lock);
-	spin_lock(&vmap_area_lock);
-
-	return seq_list_start(&vmap_area_list, *pos);
-}
-
-static void *s_next(struct seq_file *m, void *p, loff_t *pos)
-{
-	return seq_list_next(p, &vmap_area_list, pos);
-}
-
-static void s_stop(struct seq_file *m, void *p)
-	__releases(&vmap_area_lock)
-	__releases(&vmap_purge_lock)
-{
-	spin_unlock(&vmap_area_lock);
-	mutex_unlock(&vmap_purge_lock);
-}
-
-static void show_numa_info(struct seq_file *m, struct vm_struct *v)
+static void show_numa_info(struct seq_file *m, struct vm_struct *v,
+			   unsigned int *counters)
 {
 	if (IS_ENABLED(CONFIG_NUMA)) {
-		unsigned int nr, *counters = m->private;
+		unsigned int nr;
 
 		if (!counters)
 			return;
@@ -3905,26 +4266,30 @@ static void show_numa_info(struct seq_file *m, struct vm_struct *v)
 
 static void show_purge_info(struct seq_file *m)
 {
+	struct vmap_node *vn;
 	struct vmap_area *va;
+	int i;
 
-	spin_lock(&purge_vmap_area_lock);
-	list_for_each_entry(va, &purge_vmap_area_list, list) {
-		seq_printf(m, "0x%pK-0x%pK %7ld unpurged vm_area\n",
-			(void *)va->va_start, (void *)va->va_end,
-			va->va_end - va->va_start);
+	for (i = 0; i < nr_vmap_nodes; i++) {
+		vn = &vmap_nodes[i];
+
+		spin_lock(&vn->lazy.lock);
+		list_for_each_entry(va, &vn->lazy.head, list) {
+			seq_printf(m, "0x%pK-0x%pK %7ld unpurged vm_area\n",
+				(void *)va->va_start, (void *)va->va_end,
+				va->va_end - va->va_start);
+		}
+		spin_unlock(&vn->lazy.lock);
 	}
-	spin_unlock(&purge_vmap_area_lock);
 }
 
-static int s_show(struct seq_file *m, void *p)
+static void show_vmap_area(struct seq_file *m, struct vmap_area *va,
+			   unsigned int *counters)
 {
-	struct vmap_area *va;
 	struct vm_struct *v;
 
-	va = list_entry(p, struct vmap_area, list);
-
 	/*
-	 * s_show can encounter race with remove_vm_area, !vm on behalf
+	 * We can encounter race with remove_vm_area, !vm on behalf
 	 * of vmap area is being tear down or vm_map_ram allocation.
 	 */
 	if (!va->vm) {
@@ -3932,7 +4297,7 @@ static int s_show(struct seq_file *m, void *p)
 			(void *)va->va_start, (void *)va->va_end,
 			va->va_end - va->va_start);
 
-		return 0;
+		return;
 	}
 
 	v = va->vm;
@@ -3967,33 +4332,48 @@ static int s_show(struct seq_file *m, void *p)
 	if (is_vmalloc_addr(v->pages))
 		seq_puts(m, " vpages");
 
-	show_numa_info(m, v);
+	show_numa_info(m, v, counters);
 	seq_putc(m, '\n');
+}
+
+/*
+ * The busy areas are listed node by node, so the output is sorted by
+ * address only within each node.
+ */
+static int vmalloc_info_show(struct seq_file *m, void *p)
+{
+	unsigned int *counters = NULL;
+	struct vmap_node *vn;
+	struct vmap_area *va;
+	int i;
+
+	if (IS_ENABLED(CONFIG_NUMA))
+		counters = kmalloc_array(nr_node_ids, sizeof(unsigned int),
+					 GFP_KERNEL);
+
+	mutex_lock(&vmap_purge_lock);
+	for (i = 0; i < nr_vmap_nodes; i++) {
+		vn = &vmap_nodes[i];
+
+		spin_lock(&vn->busy.lock);
+		list_for_each_entry(va, &vn->busy.head, list)
+			show_vmap_area(m, va, counters);
+		spin_unlock(&vn->busy.lock);
+	}
 
 	/*
 	 * As a final step, dump "unpurged" areas.
 	 */
-	if (list_is_last(&va->list, &vmap_area_list))
-		show_purge_info(m);
+	show_purge_info(m);
+	mutex_unlock(&vmap_purge_lock);
 
+	kfree(counters);
 	return 0;
 }
 
-static const struct seq_operations vmalloc_op = {
-	.start = s_start,
-	.next = s_next,
-	.stop = s_stop,
-	.show = s_show,
-};
-
 static int __init proc_vmalloc_init(void)
 {
-	if (IS_ENABLED(CONFIG_NUMA))
-		proc_create_seq_private("vmallocinfo", 0400, NULL,
-				&vmalloc_op,
-				nr_node_ids * sizeof(unsigned int), NULL);
-	else
-		proc_create_seq("vmallocinfo", 0400, NULL, &vmalloc_op);
+	proc_create_single("vmallocinfo", 0400, NULL, vmalloc_info_show);
 	return 0;
 }
 module_init(proc_vmalloc_init);
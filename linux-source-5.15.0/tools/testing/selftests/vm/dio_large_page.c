@@ -0,0 +1,115 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Direct I/O writes into a range which is cached in a large page cache page,
+ * starting somewhere other than at the head of that page.  The write must
+ * invalidate the cached copy, so that a buffered read afterwards returns the
+ * new data.
+ *
+ * Large pages come from readahead on filesystems which support them (XFS),
+ * so run this on such a filesystem: dio_large_page [directory]
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../kselftest.h"
+
+#define FILE_SIZE	(4UL << 20)
+#define BLOCK		4096UL
+
+static char *buf;
+
+static void populate_cache(int fd)
+{
+	unsigned long pos;
+
+	/* Drop the cache, then read sequentially so readahead ramps up */
+	if (posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED))
+		ksft_exit_fail_msg("fadvise: %s\n", strerror(errno));
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	for (pos = 0; pos < FILE_SIZE; pos += BLOCK)
+		if (pread(fd, buf, BLOCK, pos) != BLOCK)
+			ksft_exit_fail_msg("pread: %s\n", strerror(errno));
+}
+
+static int check(int fd, unsigned long pos, char c)
+{
+	unsigned long i;
+
+	if (pread(fd, buf, BLOCK, pos) != BLOCK)
+		ksft_exit_fail_msg("pread: %s\n", strerror(errno));
+	for (i = 0; i < BLOCK; i++)
+		if (buf[i] != c)
+			return 0;
+	return 1;
+}
+
+int main(int argc, char **argv)
+{
+	/* block offsets which are not the head of any large page */
+	static const unsigned long offsets[] = {
+		BLOCK, 5 * BLOCK, (1UL << 20) + 3 * BLOCK, (3UL << 20) - BLOCK,
+	};
+	const char *dir = argc > 1 ? argv[1] : ".";
+	char path[4096];
+	unsigned long pos;
+	int fd, dfd, i;
+
+	ksft_print_header();
+	ksft_set_plan(sizeof(offsets) / sizeof(offsets[0]));
+
+	if (posix_memalign((void **)&buf, BLOCK, BLOCK))
+		ksft_exit_fail_msg("posix_memalign failed\n");
+
+	snprintf(path, sizeof(path), "%s/dio_large_page.XXXXXX", dir);
+	fd = mkstemp(path);
+	if (fd < 0)
+		ksft_exit_fail_msg("mkstemp: %s\n", strerror(errno));
+	unlink(path);
+
+	memset(buf, 'a', BLOCK);
+	for (pos = 0; pos < FILE_SIZE; pos += BLOCK)
+		if (pwrite(fd, buf, BLOCK, pos) != BLOCK)
+			ksft_exit_fail_msg("pwrite: %s\n", strerror(errno));
+	if (fsync(fd))
+		ksft_exit_fail_msg("fsync: %s\n", strerror(errno));
+
+	snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+	dfd = open(path, O_RDWR | O_DIRECT);
+	if (dfd < 0) {
+		if (errno == EINVAL)
+			ksft_exit_skip("O_DIRECT not supported in %s\n", dir);
+		ksft_exit_fail_msg("open O_DIRECT: %s\n", strerror(errno));
+	}
+
+	for (i = 0; i < sizeof(offsets) / sizeof(offsets[0]); i++) {
+		pos = offsets[i];
+		populate_cache(fd);
+
+		memset(buf, 'b' + i, BLOCK);
+		if (pwrite(dfd, buf, BLOCK, pos) != BLOCK)
+			ksft_exit_fail_msg("O_DIRECT pwrite: %s\n",
+					   strerror(errno));
+
+		if (check(fd, pos, 'b' + i) && check(fd, pos - BLOCK, 'a') &&
+		    check(fd, pos + BLOCK, 'a'))
+			ksft_test_result_pass("dio write at %lu\n", pos);
+		else
+			ksft_test_result_fail("stale data after dio write at %lu\n",
+					      pos);
+
+		/* restore the block for the next round */
+		memset(buf, 'a', BLOCK);
+		if (pwrite(dfd, buf, BLOCK, pos) != BLOCK)
+			ksft_exit_fail_msg("O_DIRECT pwrite: %s\n",
+					   strerror(errno));
+	}
+
+	close(dfd);
+	close(fd);
+	return ksft_get_fail_cnt() ? ksft_exit_fail() : ksft_exit_pass();
+}